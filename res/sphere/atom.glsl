@@ -0,0 +1,39 @@
+// Position and radius of an atom as it is drawn, shared by the shaders of the sphere passes
+// Moves the atom into its copy of the asymmetric unit, the procedural animation has already been applied by animation-cs.glsl
+struct Element
+{
+	vec3 color;
+	float radius;
+};
+
+layout(std140, binding = 0) uniform elementBlock
+{
+	Element elements[32];
+};
+
+#ifdef INSTANCING
+// Each instance is one copy of the asymmetric unit within the biological assembly
+layout(std430, binding = 3) readonly buffer instanceBlock
+{
+	mat4 instanceTransforms[];
+};
+#endif
+
+vec4 atomPosition(vec4 position, uint instance)
+{
+	vec4 vertexPosition = position;
+
+#ifdef INSTANCING
+	vertexPosition.xyz = (instanceTransforms[instance] * vec4(vertexPosition.xyz, 1.0)).xyz;
+#endif
+
+	return vertexPosition;
+}
+
+// The id holds the element in its lowest 8 bits, coarse levels of detail store their fitted radius in the upper 8 bits,
+// which are zero for atoms, as a code c with radius = c*c/256 (see LevelOfDetail.h)
+float atomRadius(uint id)
+{
+	uint radiusCode = bitfieldExtract(id,24,8);
+	return radiusCode > 0 ? float(radiusCode*radiusCode)/256.0 : elements[bitfieldExtract(id,0,8)].radius;
+}
@@ -0,0 +1,47 @@
+#version 450
+
+// Builds one level of the depth hierarchy used for occlusion culling
+// Level 0 is a copy of the depth buffer, each further texel holds the farthest depth of the texels it covers in the level below
+// Texels at the border of levels with an odd size also cover the last row or column of the level below, so nothing is left out
+layout(local_size_x = 8, local_size_y = 8) in;
+
+uniform int level;
+
+layout(binding = 0) uniform sampler2D depthTexture;
+layout(r32f, binding = 0) uniform readonly image2D sourceImage;
+layout(r32f, binding = 1) uniform writeonly image2D destinationImage;
+
+void main()
+{
+	ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(destinationImage);
+
+	if (any(greaterThanEqual(coord, size)))
+		return;
+
+	if (level == 0)
+	{
+		imageStore(destinationImage, coord, vec4(texelFetch(depthTexture, coord, 0).r));
+		return;
+	}
+
+	ivec2 sourceSize = imageSize(sourceImage);
+	ivec2 first = 2 * coord;
+	ivec2 last = min(first + ivec2(1), sourceSize - ivec2(1));
+
+	if (coord.x == size.x - 1)
+		last.x = sourceSize.x - 1;
+
+	if (coord.y == size.y - 1)
+		last.y = sourceSize.y - 1;
+
+	float depth = 0.0;
+
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+			depth = max(depth, imageLoad(sourceImage, ivec2(x, y)).r);
+	}
+
+	imageStore(destinationImage, coord, vec4(depth));
+}
@@ -0,0 +1,166 @@
+#version 450
+
+// Two-phase occlusion culling of the chunks of the segments selected for the current frame, one invocation per chunk and copy of the assembly
+// Phase 0 draws the chunks that were visible in the previous frame without testing them
+// Phase 1 tests all chunks against the depth hierarchy built from what phase 0 has drawn, records their visibility for the next frame
+// and draws the ones that have become visible, so disoccluded chunks appear in the same frame instead of one frame late
+// Commands are appended through an atomic counter, the command buffers have been cleared so that unused commands draw nothing
+layout(local_size_x = 64) in;
+
+uniform mat4 modelViewMatrix;
+uniform mat4 projectionMatrix;
+uniform uint chunkCount;
+uniform uint segmentCount;
+uniform uint instanceCount;
+uniform uint phase;
+uniform int hierarchyLevels;
+
+// With vertex pulling the commands are read as DrawArraysIndirectCommand, which spans the first four fields and draws six vertices per sphere
+uniform bool arrayCommands = false;
+
+layout(binding = 0) uniform sampler2D depthHierarchy;
+
+// Indices of a chunk with its bounds in the space of the asymmetric unit, enclosing the spheres of influence of its atoms
+struct Chunk
+{
+	vec4 bounds;
+	uint first;
+	uint count;
+	uint segment;
+	uint level;
+};
+
+struct DrawElementsIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 3) readonly buffer instanceBlock
+{
+	mat4 instanceTransforms[];
+};
+
+layout(std430, binding = 4) readonly buffer chunkBlock
+{
+	Chunk chunks[];
+};
+
+// Level selected for each segment and copy, or ~0 if the copy of the segment lies outside of the view frustum
+layout(std430, binding = 5) readonly buffer selectionBlock
+{
+	uint selection[];
+};
+
+layout(std430, binding = 6) buffer visibilityBlock
+{
+	uint visibility[];
+};
+
+layout(std430, binding = 7) buffer commandBlock
+{
+	uint commandCount;
+	DrawElementsIndirectCommand commands[];
+};
+
+bool occluded(vec4 bounds)
+{
+	vec3 center = (modelViewMatrix * vec4(bounds.xyz, 1.0)).xyz;
+
+	// the radius is in Angstrom, the model view matrix scales it into view space like the spheres themselves
+	float radius = length((modelViewMatrix * vec4(bounds.w, 0.0, 0.0, 0.0)).xyz);
+
+	// the depth range of the bounds is not known if they reach behind the near plane
+	vec4 nearest = projectionMatrix * vec4(center.xy, center.z + radius, 1.0);
+
+	if (nearest.w <= 0.0 || nearest.z < -nearest.w)
+		return false;
+
+	float depth = 0.5 * nearest.z / nearest.w + 0.5;
+
+	// screen rectangle of the bounds from the corners of the box around them
+	vec2 minimum = vec2(1.0);
+	vec2 maximum = vec2(-1.0);
+
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 projected = projectionMatrix * vec4(corner, 1.0);
+
+		if (projected.w <= 0.0)
+			return false;
+
+		minimum = min(minimum, projected.xy / projected.w);
+		maximum = max(maximum, projected.xy / projected.w);
+	}
+
+	ivec2 size = textureSize(depthHierarchy, 0);
+	vec2 minimumPixel = clamp((0.5 * minimum + 0.5) * vec2(size), vec2(0.0), vec2(size - ivec2(1)));
+	vec2 maximumPixel = clamp((0.5 * maximum + 0.5) * vec2(size), vec2(0.0), vec2(size - ivec2(1)));
+
+	// the level at which the rectangle covers at most five by five texels, coarser levels would mostly reach past the silhouette of the protein
+	vec2 extent = maximumPixel - minimumPixel;
+	int level = clamp(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))) - 2, 0, hierarchyLevels - 1);
+
+	ivec2 levelSize = textureSize(depthHierarchy, level);
+	ivec2 first = min(ivec2(minimumPixel) >> level, levelSize - ivec2(1));
+	ivec2 last = min(ivec2(maximumPixel) >> level, levelSize - ivec2(1));
+
+	float farthest = 0.0;
+
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+			farthest = max(farthest, texelFetch(depthHierarchy, ivec2(x, y), level).r);
+	}
+
+	return depth > farthest;
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+
+	if (index >= chunkCount * instanceCount)
+		return;
+
+	uint chunkIndex = index % chunkCount;
+	uint instance = index / chunkCount;
+	Chunk chunk = chunks[chunkIndex];
+
+	if (selection[instance * segmentCount + chunk.segment] != chunk.level)
+		return;
+
+	bool visible = false;
+
+	if (phase == 0)
+	{
+		visible = (visibility[index] != 0);
+	}
+	else
+	{
+		vec4 bounds = chunk.bounds;
+
+		if (instanceCount > 1)
+			bounds.xyz = (instanceTransforms[instance] * vec4(bounds.xyz, 1.0)).xyz;
+
+		bool wasVisible = (visibility[index] != 0);
+		bool isVisible = !occluded(bounds);
+
+		visibility[index] = isVisible ? 1 : 0;
+		visible = isVisible && !wasVisible;
+	}
+
+	if (visible)
+	{
+		uint command = atomicAdd(commandCount, 1);
+
+		if (arrayCommands)
+			commands[command] = DrawElementsIndirectCommand(chunk.count * 6, 1, chunk.first * 6, int(instance), 0);
+		else
+			commands[command] = DrawElementsIndirectCommand(chunk.count, 1, chunk.first, 0, instance);
+	}
+}
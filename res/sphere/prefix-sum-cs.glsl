@@ -0,0 +1,92 @@
+#version 450
+
+// Exclusive prefix sum of an array of unsigned integers in blocks of 1024 values, used for compacting the intersection lists
+// The scan pass replaces every block by its exclusive prefix sum and writes the total of each block to the sums,
+// which are scanned the same way. The add pass then adds the scanned sum of each block to all of its values
+layout(local_size_x = 512) in;
+
+uniform uint valueCount;
+uniform uint pass;
+
+layout(std430, binding = 4) buffer valueBlock
+{
+	uint values[];
+};
+
+layout(std430, binding = 5) buffer sumBlock
+{
+	uint sums[];
+};
+
+const uint blockSize = 2u * gl_WorkGroupSize.x;
+shared uint block[blockSize];
+
+void main()
+{
+	uint thread = gl_LocalInvocationID.x;
+	uint first = gl_WorkGroupID.x * blockSize;
+	uint a = first + thread;
+	uint b = a + gl_WorkGroupSize.x;
+
+	if (pass == 1)
+	{
+		uint sum = sums[gl_WorkGroupID.x];
+
+		if (a < valueCount)
+			values[a] += sum;
+
+		if (b < valueCount)
+			values[b] += sum;
+
+		return;
+	}
+
+	block[thread] = a < valueCount ? values[a] : 0u;
+	block[thread + gl_WorkGroupSize.x] = b < valueCount ? values[b] : 0u;
+
+	// work-efficient scan by Blelloch, reducing up the tree and sweeping back down
+	uint stride = 1u;
+
+	for (uint d = blockSize >> 1; d > 0u; d >>= 1)
+	{
+		barrier();
+
+		if (thread < d)
+		{
+			uint i = stride * (2u * thread + 1u) - 1u;
+			uint j = stride * (2u * thread + 2u) - 1u;
+			block[j] += block[i];
+		}
+
+		stride <<= 1;
+	}
+
+	if (thread == 0)
+	{
+		sums[gl_WorkGroupID.x] = block[blockSize - 1u];
+		block[blockSize - 1u] = 0;
+	}
+
+	for (uint d = 1u; d < blockSize; d <<= 1)
+	{
+		stride >>= 1;
+		barrier();
+
+		if (thread < d)
+		{
+			uint i = stride * (2u * thread + 1u) - 1u;
+			uint j = stride * (2u * thread + 2u) - 1u;
+			uint value = block[i];
+			block[i] = block[j];
+			block[j] += value;
+		}
+	}
+
+	barrier();
+
+	if (a < valueCount)
+		values[a] = block[thread];
+
+	if (b < valueCount)
+		values[b] = block[thread + gl_WorkGroupSize.x];
+}
@@ -0,0 +1,4 @@
+// Quantized positions are tightly packed normalized 16 bit integers, which storage buffers expose as the 32 bit words holding them
+// Position v of the array of words consists of the 16 bit components 3v to 3v+2
+#define QUANTIZED_COMPONENT(words, k) float(bitfieldExtract(words[(k) >> 1], int(((k) & 1u) * 16u), 16)) / 65535.0
+#define QUANTIZED_POSITION(words, v) vec3(QUANTIZED_COMPONENT(words, 3u * (v)), QUANTIZED_COMPONENT(words, 3u * (v) + 1u), QUANTIZED_COMPONENT(words, 3u * (v) + 2u))
@@ -1,4 +1,6 @@
 #version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
 
 uniform mat4 modelViewProjectionMatrix;
 uniform mat4 inverseModelViewProjectionMatrix;
@@ -26,6 +28,18 @@ layout(std430, binding = 1) buffer intersectionBuffer
 	BufferEntry intersections[];
 };
 
+#ifdef COMPACTION
+// Compacted lists are built in two passes over the same spheres, the first one only counts the entries of each pixel
+// A prefix sum over the counts gives the first entry of each pixel, so that the second pass stores the entries of every
+// pixel next to each other, using the offset image as the number of entries stored so far
+uniform bool counting;
+
+layout(std430, binding = 5) buffer listOffsetBuffer
+{
+	uint listOffsets[];
+};
+#endif
+
 struct Sphere
 {			
 	bool hit;
@@ -88,8 +102,36 @@ void main()
 	if (entry.near > position.w)
 		discard;	
 
+#ifdef COMPACTION
+	uint pixel = uint(gl_FragCoord.y) * uint(imageSize(offsetImage).x) + uint(gl_FragCoord.x);
+
+	if (counting)
+	{
+		atomicAdd(listOffsets[pixel],1);
+		discard;
+	}
+
+	uint slot = imageAtomicAdd(offsetImage,ivec2(gl_FragCoord.xy),1);
+
+	// never spill into the entries of the next pixel, should the second pass see more fragments than the first
+	if (slot >= listOffsets[pixel+1]-listOffsets[pixel])
+		discard;
+
+	uint index = listOffsets[pixel]+slot+1;
+
+	if (index >= uint(intersections.length()))
+		discard;
+
+	uint prev = 0;
+#else
+	// entries that do not fit into the buffer are dropped, the count still grows so that the renderer learns how many the frame needed
 	uint index = atomicAdd(count,1);
+
+	if (index >= uint(intersections.length()))
+		discard;
+
 	uint prev = imageAtomicExchange(offsetImage,ivec2(gl_FragCoord.xy),index);
+#endif
 
 	entry.far = length(sphere.far.xyz-near.xyz);
 
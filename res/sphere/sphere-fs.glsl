@@ -1,4 +1,6 @@
 #version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
 
 uniform mat4 modelViewProjectionMatrix;
 uniform mat4 inverseModelViewProjectionMatrix;
@@ -7,9 +9,15 @@ in vec4 gFragmentPosition;
 flat in vec4 gSpherePosition;
 flat in float gSphereRadius;
 flat in uint gSphereId;
+flat in uvec2 gAtomId;
 
-out vec4 fragPosition;
-out vec4 fragNormal;
+layout(location = 0) out vec4 fragPosition;
+layout(location = 1) out vec4 fragNormal;
+
+#ifdef PICKING
+// Index of the visible atom plus one and index of its copy, zero where no atom is hit
+layout(location = 2) out uvec2 fragAtomId;
+#endif
 
 struct Sphere
 {			
@@ -71,5 +79,8 @@ void main()
 	float depth = calcDepth(sphere.near.xyz);
 	fragPosition = vec4(sphere.near.xyz,length(sphere.near.xyz-near.xyz));
 	fragNormal = vec4(sphere.normal,uintBitsToFloat(gSphereId));
+#ifdef PICKING
+	fragAtomId = uvec2(gAtomId.x + 1, gAtomId.y);
+#endif
 	gl_FragDepth = depth;
 }
\ No newline at end of file
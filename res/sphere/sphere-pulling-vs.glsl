@@ -0,0 +1,101 @@
+#version 450
+#extension GL_ARB_shading_language_include : require
+#include "/defines.glsl"
+#include "/atom.glsl"
+#include "/quantization.glsl"
+#include "/bounds.glsl"
+
+// Alternative to sphere-vs.glsl and sphere-gs.glsl without a geometry shader
+// Every sphere is drawn as two triangles of six vertices, each vertex pulls the data of its atom from storage buffers
+// and computes the bounding polygon of the sphere on its own, keeping only the corner it stands for
+uniform mat4 modelViewMatrix;
+uniform mat4 projectionMatrix;
+uniform float radiusScale;
+uniform float clipRadiusScale;
+uniform float nearPlaneZ = -0.125;
+
+#if defined(QUANTIZATION) && !defined(ANIMATION)
+// Quantized positions are normalized relative to the bounds of their timestep, attributes are stored once for all timesteps
+// Animated positions come from the animation pass, which has already decoded them
+uniform vec3 positionOffset;
+uniform vec3 positionExtent;
+
+layout(std430, binding = 4) readonly buffer positionBlock
+{
+	uint positions[];
+};
+
+layout(std430, binding = 6) readonly buffer attributeBlock
+{
+	uint attributes[];
+};
+#else
+layout(std430, binding = 4) readonly buffer positionBlock
+{
+	vec4 positions[];
+};
+#endif
+
+// Vertex indices of all levels of detail, the ranges drawn are given in spheres and turned into vertices by the commands
+layout(std430, binding = 7) readonly buffer indexBlock
+{
+	uint indices[];
+};
+
+// Index of the copy of the asymmetric unit, still an instanced attribute so that indirect draws select it through their base instance
+layout(location = 3) in uint instance;
+
+out vec4 gFragmentPosition;
+flat out vec4 gSpherePosition;
+flat out float gSphereRadius;
+flat out uint gSphereId;
+flat out uvec2 gAtomId;
+
+// Vertices of the two triangles in terms of the triangle strip the geometry shader emits,
+// and the bounding lines whose intersection gives each vertex of the strip
+const int triangleVertices[6] = int[6](0, 1, 2, 2, 1, 3);
+const int stripCorners[4] = int[4](N - 1, 0, N - 2, 1);
+
+void main()
+{
+	uint sphere = uint(gl_VertexID) / 6u;
+	uint vertex = indices[sphere];
+	int corner = stripCorners[triangleVertices[uint(gl_VertexID) % 6u]];
+
+#if defined(QUANTIZATION) && !defined(ANIMATION)
+	vec4 currentPosition = vec4(positionOffset + QUANTIZED_POSITION(positions, vertex) * positionExtent, uintBitsToFloat(attributes[vertex]));
+#else
+	vec4 currentPosition = positions[vertex];
+#endif
+
+	vec4 spherePosition = atomPosition(currentPosition, instance);
+
+	uint sphereId = floatBitsToUint(spherePosition.w);
+	float sphereRadius = atomRadius(sphereId)*radiusScale;
+	float sphereClipRadius = atomRadius(sphereId)*clipRadiusScale;
+
+	gSphereId = sphereId;
+	gAtomId = uvec2(vertex, instance);
+	gSpherePosition = spherePosition;
+	gSphereRadius = sphereRadius;
+
+	vec4 c = modelViewMatrix * vec4(spherePosition.xyz,1.0);
+	float radius = length(modelViewMatrix * vec4(sphereRadius,0.0,0.0,0.0));
+	float clipRadius = length(modelViewMatrix * vec4(sphereClipRadius,0.0,0.0,0.0));
+
+	// spheres reaching the near plane are dropped, all vertices of their triangles are moved outside of the clip volume
+	if (c.z + clipRadius >= nearPlaneZ)
+	{
+		gFragmentPosition = vec4(2.0, 2.0, 2.0, 1.0);
+		gl_Position = gFragmentPosition;
+		return;
+	}
+
+	line2D boundingLines[N + 1];
+	float maxZ = min(nearPlaneZ, c.z);
+	getBoundingLines(c.xyz, radius, nearPlaneZ, maxZ, boundingLines);
+
+	vec4 pos = vec4(intersect(boundingLines[corner], boundingLines[corner+1]), maxZ, 1.0);
+	gFragmentPosition = projectionMatrix * pos;
+	gl_Position = gFragmentPosition;
+}
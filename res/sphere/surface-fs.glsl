@@ -2,6 +2,7 @@
 #extension GL_ARB_shading_language_include : require
 #include "/defines.glsl"
 #include "/globals.glsl"
+#include "/atom.glsl"
 
 layout(pixel_center_integer) in vec4 gl_FragCoord;
 
@@ -35,12 +36,6 @@ out vec4 surfaceNormal;
 out vec4 surfaceDiffuse;
 out vec4 sphereDiffuse;
 
-struct Element
-{
-	vec3 color;
-	float radius;
-};
-
 struct Residue
 {
 	vec4 color;
@@ -51,11 +46,6 @@ struct Chain
 	vec4 color;
 };
 
-layout(std140, binding = 0) uniform elementBlock
-{
-	Element elements[32];
-};
-
 layout(std140, binding = 1) uniform residueBlock
 {
 	Residue residues[32];
@@ -63,7 +53,7 @@ layout(std140, binding = 1) uniform residueBlock
 
 layout(std140, binding = 2) uniform chainBlock
 {
-	Chain chains[64];
+	Chain chains[256];
 };
 
 struct BufferEntry
@@ -81,6 +71,17 @@ layout(std430, binding = 1) buffer intersectionBuffer
 	BufferEntry intersections[];
 };
 
+#ifdef COMPACTION
+// First entry of each pixel in compacted lists, which hold the entries of a pixel next to each other
+layout(std430, binding = 5) buffer listOffsetBuffer
+{
+	uint listOffsets[];
+};
+#endif
+
+#ifdef STATISTICS
+// Statistics of the lists of the current frame, accumulated by all pixels and read back by the renderer a few frames later
+// intersectionCount holds the pixels whose ray has hit the surface, the others refer to the pixels with a non-empty list
 layout(std430, binding = 2) buffer statisticsBuffer
 {
 	uint intersectionCount;
@@ -88,6 +89,7 @@ layout(std430, binding = 2) buffer statisticsBuffer
 	uint totalEntryCount;
 	uint maximumEntryCount;
 };
+#endif
 
 struct Sphere
 {			
@@ -131,15 +133,38 @@ void main()
 	uint entryCount = 0;
 	uint indices[maxEntries];
 
+#ifdef COMPACTION
+	// the offset texture holds the number of entries the spawn pass tried to store for the pixel, the list may be shorter
+	// if the second pass has seen more fragments than the first, which the spawn pass has then dropped
+	uint pixel = uint(gl_FragCoord.y) * uint(textureSize(offsetTexture,0).x) + uint(gl_FragCoord.x);
+	uint firstEntry = listOffsets[pixel] + 1;
+	uint listLength = min(offset, listOffsets[pixel+1] - listOffsets[pixel]);
+
+	// entries of pixels that did not fit into the buffer have been dropped
+	uint lastEntry = min(firstEntry + min(listLength, maxEntries), uint(intersections.length()));
+
+	while (firstEntry + entryCount < lastEntry)
+	{
+		indices[entryCount] = firstEntry + entryCount;
+		entryCount++;
+	}
+#else
 	while (offset > 0)
 	{
 		indices[entryCount++] = offset;
 		offset = intersections[offset].previous;
 	}
+#endif
 
 	if (entryCount == 0)
 		discard;
 
+#ifdef STATISTICS
+	atomicAdd(totalPixelCount, 1);
+	atomicAdd(totalEntryCount, entryCount);
+	atomicMax(maximumEntryCount, entryCount);
+#endif
+
 	vec4 closestPosition = position;
 	vec3 closestNormal = normal.xyz;
 
@@ -255,7 +280,7 @@ void main()
 						uint elementId = bitfieldExtract(id,0,8);
 
 						vec3 aj = intersections[ij].center;
-						float rj = elements[elementId].radius;
+						float rj = atomRadius(id);
 
 						vec3 atomOffset = currentPosition.xyz-aj;
 						float atomDistance = length(atomOffset)/rj;
@@ -351,6 +376,10 @@ void main()
 	if (closestPosition.w >= 65535.0f)
 		discard;
 
+#ifdef STATISTICS
+	atomicAdd(intersectionCount, 1);
+#endif
+
 #ifdef NORMAL		
 	vec3 N = normalize(closestNormal);
 	
@@ -0,0 +1,696 @@
+#include "BinaryCif.h"
+
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+
+namespace
+{
+	// Minimal MessagePack document model, strings and binary data refer into the file buffer
+	struct Value
+	{
+		enum class Type
+		{
+			Nil,
+			Bool,
+			Int,
+			Float,
+			String,
+			Binary,
+			Array,
+			Map
+		};
+
+		Type type = Type::Nil;
+		int64_t integer = 0;
+		double number = 0.0;
+		std::string_view bytes;
+
+		// arrays store their elements, maps store alternating keys and values
+		std::vector<Value> items;
+
+		const Value* find(std::string_view key) const
+		{
+			if (type != Type::Map)
+				return nullptr;
+
+			for (size_t i = 0; i + 1 < items.size(); i += 2)
+			{
+				if (items[i].type == Type::String && items[i].bytes == key)
+					return &items[i + 1];
+			}
+
+			return nullptr;
+		}
+
+		double toDouble() const
+		{
+			return (type == Type::Float) ? number : double(integer);
+		}
+	};
+
+	class MessagePackReader
+	{
+	public:
+		MessagePackReader(const char* begin, const char* end) : m_position(begin), m_end(end)
+		{
+		}
+
+		bool read(Value& value, unsigned int depth = 0)
+		{
+			if (depth > 64 || m_position >= m_end)
+				return false;
+
+			const uint8_t c = uint8_t(*m_position++);
+
+			if (c <= 0x7f)
+				return integer(value, c);
+			else if (c >= 0xe0)
+				return integer(value, int8_t(c));
+			else if ((c & 0xf0) == 0x80)
+				return container(value, Value::Type::Map, c & 0x0f, depth);
+			else if ((c & 0xf0) == 0x90)
+				return container(value, Value::Type::Array, c & 0x0f, depth);
+			else if ((c & 0xe0) == 0xa0)
+				return bytes(value, Value::Type::String, c & 0x1f);
+
+			uint64_t length = 0;
+
+			switch (c)
+			{
+			case 0xc0: value.type = Value::Type::Nil; return true;
+			case 0xc2: value.type = Value::Type::Bool; value.integer = 0; return true;
+			case 0xc3: value.type = Value::Type::Bool; value.integer = 1; return true;
+			case 0xc4: return big(length, 1) && bytes(value, Value::Type::Binary, length);
+			case 0xc5: return big(length, 2) && bytes(value, Value::Type::Binary, length);
+			case 0xc6: return big(length, 4) && bytes(value, Value::Type::Binary, length);
+			case 0xca:
+			{
+				uint64_t bits = 0;
+				float f = 0.0f;
+				uint32_t bits32 = 0;
+
+				if (!big(bits, 4))
+					return false;
+
+				bits32 = uint32_t(bits);
+				std::memcpy(&f, &bits32, sizeof(f));
+				value.type = Value::Type::Float;
+				value.number = f;
+				return true;
+			}
+			case 0xcb:
+			{
+				uint64_t bits = 0;
+
+				if (!big(bits, 8))
+					return false;
+
+				value.type = Value::Type::Float;
+				std::memcpy(&value.number, &bits, sizeof(value.number));
+				return true;
+			}
+			case 0xcc: return big(length, 1) && integer(value, int64_t(length));
+			case 0xcd: return big(length, 2) && integer(value, int64_t(length));
+			case 0xce: return big(length, 4) && integer(value, int64_t(length));
+			case 0xcf: return big(length, 8) && integer(value, int64_t(length));
+			case 0xd0: return big(length, 1) && integer(value, int8_t(length));
+			case 0xd1: return big(length, 2) && integer(value, int16_t(length));
+			case 0xd2: return big(length, 4) && integer(value, int32_t(length));
+			case 0xd3: return big(length, 8) && integer(value, int64_t(length));
+			case 0xd4: return skip(2);
+			case 0xd5: return skip(3);
+			case 0xd6: return skip(5);
+			case 0xd7: return skip(9);
+			case 0xd8: return skip(17);
+			case 0xc7: return big(length, 1) && skip(length + 1);
+			case 0xc8: return big(length, 2) && skip(length + 1);
+			case 0xc9: return big(length, 4) && skip(length + 1);
+			case 0xd9: return big(length, 1) && bytes(value, Value::Type::String, length);
+			case 0xda: return big(length, 2) && bytes(value, Value::Type::String, length);
+			case 0xdb: return big(length, 4) && bytes(value, Value::Type::String, length);
+			case 0xdc: return big(length, 2) && container(value, Value::Type::Array, length, depth);
+			case 0xdd: return big(length, 4) && container(value, Value::Type::Array, length, depth);
+			case 0xde: return big(length, 2) && container(value, Value::Type::Map, length, depth);
+			case 0xdf: return big(length, 4) && container(value, Value::Type::Map, length, depth);
+			}
+
+			return false;
+		}
+
+	private:
+		// MessagePack stores all multi-byte numbers in big-endian order
+		bool big(uint64_t& result, uint64_t count)
+		{
+			if (uint64_t(m_end - m_position) < count)
+				return false;
+
+			result = 0;
+
+			for (uint64_t i = 0; i < count; i++)
+				result = (result << 8) | uint8_t(*m_position++);
+
+			return true;
+		}
+
+		bool skip(uint64_t count)
+		{
+			if (uint64_t(m_end - m_position) < count)
+				return false;
+
+			m_position += count;
+			return true;
+		}
+
+		bool integer(Value& value, int64_t i)
+		{
+			value.type = Value::Type::Int;
+			value.integer = i;
+			return true;
+		}
+
+		bool bytes(Value& value, Value::Type type, uint64_t length)
+		{
+			if (uint64_t(m_end - m_position) < length)
+				return false;
+
+			value.type = type;
+			value.bytes = std::string_view(m_position, size_t(length));
+			m_position += length;
+			return true;
+		}
+
+		bool container(Value& value, Value::Type type, uint64_t length, unsigned int depth)
+		{
+			const uint64_t count = (type == Value::Type::Map) ? length * 2 : length;
+
+			// every item takes at least one byte, which bounds the allocation for corrupt files
+			if (uint64_t(m_end - m_position) < count)
+				return false;
+
+			value.type = type;
+			value.items.resize(size_t(count));
+
+			for (auto& item : value.items)
+			{
+				if (!read(item, depth + 1))
+					return false;
+			}
+
+			return true;
+		}
+
+		const char* m_position;
+		const char* m_end;
+	};
+
+	enum DataType
+	{
+		Int8 = 1,
+		Int16 = 2,
+		Int32 = 3,
+		Uint8 = 4,
+		Uint16 = 5,
+		Uint32 = 6,
+		Float32 = 32,
+		Float64 = 33
+	};
+
+	int integerMember(const Value& map, std::string_view key, int defaultValue = 0)
+	{
+		const Value* value = map.find(key);
+		return (value && (value->type == Value::Type::Int || value->type == Value::Type::Float)) ? int(value->toDouble()) : defaultValue;
+	}
+
+	double numberMember(const Value& map, std::string_view key, double defaultValue = 0.0)
+	{
+		const Value* value = map.find(key);
+		return (value && (value->type == Value::Type::Int || value->type == Value::Type::Float)) ? value->toDouble() : defaultValue;
+	}
+
+	std::string_view bytesMember(const Value& map, std::string_view key)
+	{
+		const Value* value = map.find(key);
+		return (value && (value->type == Value::Type::Binary || value->type == Value::Type::String)) ? value->bytes : std::string_view();
+	}
+
+	bool readEncodings(const Value* list, std::vector<BinaryCif::Encoding>& encodings);
+
+	bool readEncoding(const Value& map, BinaryCif::Encoding& encoding)
+	{
+		using Kind = BinaryCif::Encoding::Kind;
+
+		static const std::pair<std::string_view, Kind> kinds[] = {
+			{ "ByteArray", Kind::ByteArray },
+			{ "FixedPoint", Kind::FixedPoint },
+			{ "IntervalQuantization", Kind::IntervalQuantization },
+			{ "RunLength", Kind::RunLength },
+			{ "Delta", Kind::Delta },
+			{ "IntegerPacking", Kind::IntegerPacking },
+			{ "StringArray", Kind::StringArray }
+		};
+
+		const std::string_view kind = bytesMember(map, "kind");
+		auto match = std::find_if(std::begin(kinds), std::end(kinds), [&](const auto& k) { return k.first == kind; });
+
+		if (match == std::end(kinds))
+		{
+			globjects::warning() << "Unsupported BinaryCIF encoding " << std::string(kind) << "!";
+			return false;
+		}
+
+		encoding.kind = match->second;
+		encoding.type = integerMember(map, "type");
+		encoding.srcType = integerMember(map, "srcType");
+		encoding.srcSize = integerMember(map, "srcSize");
+		encoding.byteCount = integerMember(map, "byteCount");
+		encoding.isUnsigned = integerMember(map, "isUnsigned") != 0;
+		encoding.origin = integerMember(map, "origin");
+		encoding.factor = numberMember(map, "factor", 1.0);
+		encoding.min = numberMember(map, "min");
+		encoding.max = numberMember(map, "max");
+		encoding.numSteps = integerMember(map, "numSteps");
+
+		if (encoding.kind == Kind::StringArray)
+		{
+			encoding.stringData = bytesMember(map, "stringData");
+			encoding.offsets = bytesMember(map, "offsets");
+
+			if (!readEncodings(map.find("dataEncoding"), encoding.dataEncoding) || !readEncodings(map.find("offsetEncoding"), encoding.offsetEncoding))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool readEncodings(const Value* list, std::vector<BinaryCif::Encoding>& encodings)
+	{
+		if (!list || list->type != Value::Type::Array)
+			return false;
+
+		encodings.resize(list->items.size());
+
+		for (size_t i = 0; i < encodings.size(); i++)
+		{
+			if (!readEncoding(list->items[i], encodings[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool readEncodedData(const Value* map, BinaryCif::EncodedData& data)
+	{
+		if (!map || map->type != Value::Type::Map)
+			return false;
+
+		data.data = bytesMember(*map, "data");
+		return readEncodings(map->find("encoding"), data.encoding);
+	}
+
+	// Intermediate result while walking an encoding chain, either integers or floats
+	struct TypedArray
+	{
+		bool isFloat = false;
+		std::vector<int32_t> integers;
+		std::vector<float> floats;
+
+		size_t size() const
+		{
+			return isFloat ? floats.size() : integers.size();
+		}
+	};
+
+	// Converts little-endian values of type T to the output type
+	// The loops have no dependencies between iterations and are vectorized by the compiler
+	template <typename T, typename Output> void convertBytes(std::string_view bytes, std::vector<Output>& output)
+	{
+		const size_t count = bytes.size() / sizeof(T);
+		std::vector<T> input(count);
+		std::memcpy(input.data(), bytes.data(), count * sizeof(T));
+
+		output.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+			output[i] = Output(input[i]);
+	}
+
+	bool decodeByteArray(std::string_view bytes, int type, TypedArray& output)
+	{
+		output.isFloat = (type == Float32 || type == Float64);
+
+		switch (type)
+		{
+		case Int8: convertBytes<int8_t>(bytes, output.integers); return true;
+		case Int16: convertBytes<int16_t>(bytes, output.integers); return true;
+		case Int32: convertBytes<int32_t>(bytes, output.integers); return true;
+		case Uint8: convertBytes<uint8_t>(bytes, output.integers); return true;
+		case Uint16: convertBytes<uint16_t>(bytes, output.integers); return true;
+		case Uint32: convertBytes<uint32_t>(bytes, output.integers); return true;
+		case Float32: convertBytes<float>(bytes, output.floats); return true;
+		case Float64: convertBytes<double>(bytes, output.floats); return true;
+		}
+
+		globjects::warning() << "Unsupported BinaryCIF data type " << type << "!";
+		return false;
+	}
+
+	void decodeFixedPoint(const std::vector<int32_t>& input, double factor, std::vector<float>& output)
+	{
+		// dividing in double precision gives the same result as parsing the decimal text representation
+		const size_t count = input.size();
+		output.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+			output[i] = float(double(input[i]) / factor);
+	}
+
+	void decodeIntervalQuantization(const std::vector<int32_t>& input, double min, double max, int numSteps, std::vector<float>& output)
+	{
+		const size_t count = input.size();
+		const float minimum = float(min);
+		const float delta = float((max - min) / double(std::max(numSteps - 1, 1)));
+		output.resize(count);
+
+		for (size_t i = 0; i < count; i++)
+			output[i] = minimum + delta * float(input[i]);
+	}
+
+	bool decodeRunLength(const std::vector<int32_t>& input, int size, std::vector<int32_t>& output)
+	{
+		output.clear();
+		output.reserve(size_t(std::max(size, 0)));
+
+		for (size_t i = 0; i + 1 < input.size(); i += 2)
+		{
+			if (input[i + 1] < 0 || output.size() + size_t(input[i + 1]) > size_t(std::max(size, 0)))
+				return false;
+
+			output.insert(output.end(), size_t(input[i + 1]), input[i]);
+		}
+
+		return output.size() == size_t(size);
+	}
+
+	void decodeDelta(std::vector<int32_t>& values, int origin)
+	{
+		int32_t sum = origin;
+
+		for (auto& v : values)
+		{
+			sum += v;
+			v = sum;
+		}
+	}
+
+	// Values that do not fit into the packed type are split into a sequence of limit values followed by the remainder
+	bool decodeIntegerPacking(const std::vector<int32_t>& input, int byteCount, bool isUnsigned, int size, std::vector<int32_t>& output)
+	{
+		const int32_t upperLimit = isUnsigned ? (byteCount == 1 ? 0xFF : 0xFFFF) : (byteCount == 1 ? 0x7F : 0x7FFF);
+		const int32_t lowerLimit = isUnsigned ? 0 : -upperLimit - 1;
+
+		// without any limit values the packing is a plain widening, which the byte array decoding already did
+		if (input.size() == size_t(size))
+		{
+			output = input;
+			return true;
+		}
+
+		output.resize(size_t(std::max(size, 0)));
+		size_t j = 0;
+
+		for (size_t i = 0; i < input.size(); i++)
+		{
+			int32_t value = 0;
+			int32_t t = input[i];
+
+			while (t == upperLimit || (!isUnsigned && t == lowerLimit))
+			{
+				value += t;
+
+				if (++i >= input.size())
+					break;
+
+				t = input[i];
+			}
+
+			if (j >= output.size())
+				return false;
+
+			output[j++] = value + ((i < input.size()) ? t : 0);
+		}
+
+		return j == output.size();
+	}
+
+	// Undoes an encoding chain, the encodings are listed in the order they were applied
+	bool decodeData(std::string_view data, const std::vector<BinaryCif::Encoding>& encodings, TypedArray& output)
+	{
+		using Kind = BinaryCif::Encoding::Kind;
+
+		if (encodings.empty() || encodings.back().kind != Kind::ByteArray)
+			return false;
+
+		if (!decodeByteArray(data, encodings.back().type, output))
+			return false;
+
+		for (auto e = encodings.rbegin() + 1; e != encodings.rend(); ++e)
+		{
+			if (e->kind != Kind::StringArray && output.isFloat)
+				return false;
+
+			std::vector<int32_t> decoded;
+
+			switch (e->kind)
+			{
+			case Kind::FixedPoint:
+				decodeFixedPoint(output.integers, e->factor, output.floats);
+				output.isFloat = true;
+				output.integers.clear();
+				break;
+
+			case Kind::IntervalQuantization:
+				decodeIntervalQuantization(output.integers, e->min, e->max, e->numSteps, output.floats);
+				output.isFloat = true;
+				output.integers.clear();
+				break;
+
+			case Kind::RunLength:
+				if (!decodeRunLength(output.integers, e->srcSize, decoded))
+					return false;
+
+				output.integers.swap(decoded);
+				break;
+
+			case Kind::Delta:
+				decodeDelta(output.integers, e->origin);
+				break;
+
+			case Kind::IntegerPacking:
+				if (!decodeIntegerPacking(output.integers, e->byteCount, e->isUnsigned, e->srcSize, decoded))
+					return false;
+
+				output.integers.swap(decoded);
+				break;
+
+			default:
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+bool BinaryCif::load(std::istream& file, const std::function<bool()>& continueReading)
+{
+	const size_t chunkSize = size_t(1) << 20;
+
+	m_data.clear();
+	m_categories.clear();
+
+	while (file.good())
+	{
+		const size_t size = m_data.size();
+		m_data.resize(size + chunkSize);
+		file.read(m_data.data() + size, std::streamsize(chunkSize));
+		m_data.resize(size + size_t(file.gcount()));
+
+		if (continueReading && !continueReading())
+			return false;
+	}
+
+	Value root;
+	MessagePackReader reader(m_data.data(), m_data.data() + m_data.size());
+
+	if (!reader.read(root))
+	{
+		globjects::critical() << "Could not decode BinaryCIF file!";
+		return false;
+	}
+
+	const Value* dataBlocks = root.find("dataBlocks");
+
+	if (!dataBlocks || dataBlocks->type != Value::Type::Array || dataBlocks->items.empty())
+	{
+		globjects::critical() << "BinaryCIF file contains no data blocks!";
+		return false;
+	}
+
+	if (dataBlocks->items.size() > 1)
+		globjects::warning() << "BinaryCIF file contains " << dataBlocks->items.size() << " data blocks, only the first one is used.";
+
+	const Value* categories = dataBlocks->items.front().find("categories");
+
+	if (!categories || categories->type != Value::Type::Array)
+		return false;
+
+	for (const auto& c : categories->items)
+	{
+		const Value* columns = c.find("columns");
+
+		if (!columns || columns->type != Value::Type::Array)
+			continue;
+
+		Category& category = m_categories[std::string(bytesMember(c, "name"))];
+		category.rowCount = size_t(std::max(integerMember(c, "rowCount"), 0));
+
+		for (const auto& col : columns->items)
+		{
+			Column column;
+
+			if (!readEncodedData(col.find("data"), column.data))
+				continue;
+
+			column.hasMask = readEncodedData(col.find("mask"), column.mask);
+			category.columns[std::string(bytesMember(col, "name"))] = std::move(column);
+		}
+	}
+
+	return true;
+}
+
+size_t BinaryCif::size() const
+{
+	return m_data.size();
+}
+
+const BinaryCif::Category* BinaryCif::category(const std::string& name) const
+{
+	auto i = m_categories.find(name);
+	return (i != m_categories.end()) ? &i->second : nullptr;
+}
+
+const BinaryCif::Column* BinaryCif::column(const std::string& categoryName, const std::string& columnName) const
+{
+	const Category* c = category(categoryName);
+
+	if (!c)
+		return nullptr;
+
+	auto i = c->columns.find(columnName);
+	return (i != c->columns.end()) ? &i->second : nullptr;
+}
+
+bool BinaryCif::decode(const Column& column, std::vector<int32_t>& values) const
+{
+	TypedArray array;
+
+	if (!decodeData(column.data.data, column.data.encoding, array))
+		return false;
+
+	if (array.isFloat)
+	{
+		values.resize(array.floats.size());
+
+		for (size_t i = 0; i < values.size(); i++)
+			values[i] = int32_t(array.floats[i]);
+	}
+	else
+	{
+		values.swap(array.integers);
+	}
+
+	return true;
+}
+
+bool BinaryCif::decode(const Column& column, std::vector<float>& values) const
+{
+	TypedArray array;
+
+	if (!decodeData(column.data.data, column.data.encoding, array))
+		return false;
+
+	if (array.isFloat)
+	{
+		values.swap(array.floats);
+	}
+	else
+	{
+		values.resize(array.integers.size());
+
+		for (size_t i = 0; i < values.size(); i++)
+			values[i] = float(array.integers[i]);
+	}
+
+	return true;
+}
+
+bool BinaryCif::decode(const Column& column, StringColumn& values) const
+{
+	const auto& encoding = column.data.encoding;
+
+	if (encoding.empty() || encoding.front().kind != Encoding::Kind::StringArray)
+		return false;
+
+	const Encoding& stringArray = encoding.front();
+	TypedArray indices;
+	TypedArray offsets;
+
+	if (!decodeData(column.data.data, stringArray.dataEncoding, indices) || indices.isFloat)
+		return false;
+
+	if (!decodeData(stringArray.offsets, stringArray.offsetEncoding, offsets) || offsets.isFloat)
+		return false;
+
+	values.strings.clear();
+
+	for (size_t i = 0; i + 1 < offsets.integers.size(); i++)
+	{
+		const int32_t begin = offsets.integers[i];
+		const int32_t end = offsets.integers[i + 1];
+
+		if (begin < 0 || end < begin || size_t(end) > stringArray.stringData.size())
+			return false;
+
+		values.strings.push_back(stringArray.stringData.substr(size_t(begin), size_t(end - begin)));
+	}
+
+	values.indices.swap(indices.integers);
+
+	for (auto& index : values.indices)
+	{
+		if (index >= int32_t(values.strings.size()))
+			return false;
+	}
+
+	// masked rows hold '.' or '?' in the text format
+	if (column.hasMask)
+	{
+		TypedArray mask;
+
+		if (decodeData(column.mask.data, column.mask.encoding, mask) && !mask.isFloat && mask.integers.size() == values.indices.size())
+		{
+			for (size_t i = 0; i < values.indices.size(); i++)
+			{
+				if (mask.integers[i] != 0)
+					values.indices[i] = -1;
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <istream>
+#include <cstdint>
+#include <functional>
+
+namespace dynamol
+{
+	// Reader for BinaryCIF files, the MessagePack based binary encoding of mmCIF
+	// Columns are kept in their encoded form and only decoded when they are requested
+	class BinaryCif
+	{
+	public:
+
+		// One step of the encoding chain of a column, see https://github.com/molstar/BinaryCIF
+		struct Encoding
+		{
+			enum class Kind
+			{
+				ByteArray,
+				FixedPoint,
+				IntervalQuantization,
+				RunLength,
+				Delta,
+				IntegerPacking,
+				StringArray
+			};
+
+			Kind kind = Kind::ByteArray;
+
+			int type = 0;
+			int srcType = 0;
+			int srcSize = 0;
+			int byteCount = 0;
+			bool isUnsigned = false;
+			int origin = 0;
+			double factor = 1.0;
+			double min = 0.0;
+			double max = 0.0;
+			int numSteps = 0;
+
+			// StringArray only
+			std::string_view stringData;
+			std::string_view offsets;
+			std::vector<Encoding> dataEncoding;
+			std::vector<Encoding> offsetEncoding;
+		};
+
+		struct EncodedData
+		{
+			std::string_view data;
+			std::vector<Encoding> encoding;
+		};
+
+		struct Column
+		{
+			EncodedData data;
+			EncodedData mask;
+			bool hasMask = false;
+		};
+
+		struct Category
+		{
+			size_t rowCount = 0;
+			std::unordered_map<std::string, Column> columns;
+		};
+
+		// Distinct strings of a column and the index of the string in every row, -1 for missing values
+		struct StringColumn
+		{
+			std::vector<std::string_view> strings;
+			std::vector<int32_t> indices;
+		};
+
+		// The file is read in chunks, continueReading is called after each one and stops loading when it returns false
+		bool load(std::istream& file, const std::function<bool()>& continueReading = nullptr);
+		size_t size() const;
+
+		const Category* category(const std::string& name) const;
+		const Column* column(const std::string& categoryName, const std::string& columnName) const;
+
+		bool decode(const Column& column, std::vector<int32_t>& values) const;
+		bool decode(const Column& column, std::vector<float>& values) const;
+		bool decode(const Column& column, StringColumn& values) const;
+
+	private:
+		std::vector<char> m_data;
+		std::unordered_map<std::string, Category> m_categories;
+	};
+}
@@ -4,6 +4,7 @@
 #include "Viewer.h"
 #include "Scene.h"
 #include "Protein.h"
+#include "Profiler.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -75,6 +76,11 @@ BoundingBoxRenderer::BoundingBoxRenderer(Viewer* viewer) : Renderer(viewer)
 
 void BoundingBoxRenderer::display()
 {
+	PROFILE_ZONE("BoundingBoxRenderer::display");
+
+	if (viewer()->scene()->protein()->atoms().size() == 0)
+		return;
+
 	auto currentState = State::currentState();
 	glViewport(viewer()->viewportOrigin().x, viewer()->viewportOrigin().y, viewer()->viewportSize().x, viewer()->viewportSize().y);
 
@@ -104,6 +110,8 @@ void BoundingBoxRenderer::display()
 	program->setUniform("modelView", modelViewTransform);
 	program->setUniform("lineColor", lineColor);
 
+	viewer()->gpuTimer()->begin("Bounding Box");
+
 	m_vao->bind();
 	glPatchParameteri(GL_PATCH_VERTICES, 4);
 
@@ -113,6 +121,8 @@ void BoundingBoxRenderer::display()
 
 	m_vao->unbind();
 
+	viewer()->gpuTimer()->end();
+
 	glDisable(GL_BLEND);
 	glDisable(GL_SAMPLE_ALPHA_TO_COVERAGE);
 
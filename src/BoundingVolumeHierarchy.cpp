@@ -0,0 +1,452 @@
+#include "BoundingVolumeHierarchy.h"
+#include "MortonOrder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <cstdint>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// The depth of the tree is bounded by the bits of the Morton codes plus the bits of the leaf indices used for equal codes
+	const uint maximumStackSize = 96;
+
+	int countLeadingZeros(uint value)
+	{
+		if (value == 0)
+			return 32;
+
+		int count = 0;
+
+		if (value <= 0x0000ffffu) { count += 16; value <<= 16; }
+		if (value <= 0x00ffffffu) { count += 8; value <<= 8; }
+		if (value <= 0x0fffffffu) { count += 4; value <<= 4; }
+		if (value <= 0x3fffffffu) { count += 2; value <<= 2; }
+		if (value <= 0x7fffffffu) { count += 1; }
+
+		return count;
+	}
+
+	// Distance along the ray where it enters the box, or a negative value if it misses the box or only hits it behind farthest
+	float intersectBox(const vec3& origin, const vec3& inverseDirection, const vec3& minimum, const vec3& maximum, float farthest)
+	{
+		const vec3 t0 = (minimum - origin) * inverseDirection;
+		const vec3 t1 = (maximum - origin) * inverseDirection;
+		const vec3 entries = min(t0, t1);
+		const vec3 exits = max(t0, t1);
+
+		const float entry = std::max(std::max(entries.x, entries.y), std::max(entries.z, 0.0f));
+		const float exit = std::min(std::min(exits.x, exits.y), std::min(exits.z, farthest));
+
+		return (entry <= exit) ? entry : -1.0f;
+	}
+
+	// Distance along the normalized ray to the first intersection with the sphere, negative if it is missed
+	// Rays starting inside of a sphere hit it where they leave it
+	float intersectSphere(const vec3& origin, const vec3& direction, const vec4& sphere, float radiusScale)
+	{
+		const vec3 offset = origin - vec3(sphere);
+		const float radius = sphere.w * radiusScale;
+		const float b = dot(offset, direction);
+		const float c = dot(offset, offset) - radius * radius;
+		const float discriminant = b * b - c;
+
+		if (discriminant < 0.0f)
+			return -1.0f;
+
+		const float root = std::sqrt(discriminant);
+		return (-b - root >= 0.0f) ? -b - root : -b + root;
+	}
+}
+
+void BoundingVolumeHierarchy::build(const std::vector<vec4>& atoms, const std::vector<float>& elementRadii)
+{
+	m_elementRadii = elementRadii;
+	m_threadCount = parallelThreadCount(atoms.size(), atomsPerThread);
+
+	std::vector<uint> codes;
+	MortonOrder::sort(atoms, codes, m_order);
+
+	m_leaves.resize(atoms.size());
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+		{
+			const vec4& atom = atoms[m_order[i]];
+			m_leaves[i] = vec4(vec3(atom), atomRadius(atom));
+		}
+	});
+
+	buildNodes(codes);
+	updateBounds();
+}
+
+void BoundingVolumeHierarchy::refit(const std::vector<vec4>& atoms)
+{
+	if (atoms.size() != m_leaves.size())
+	{
+		build(atoms, m_elementRadii);
+		return;
+	}
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+		{
+			const vec4& atom = atoms[m_order[i]];
+			m_leaves[i] = vec4(vec3(atom), atomRadius(atom));
+		}
+	});
+
+	updateBounds();
+}
+
+// Each internal node finds the range of leaves it covers and its split position directly from the sorted codes,
+// so all nodes are built independently of each other
+void BoundingVolumeHierarchy::buildNodes(const std::vector<uint>& codes)
+{
+	const int64_t leafCount = int64_t(codes.size());
+	const int64_t nodeCount = std::max(int64_t(0), leafCount - 1);
+
+	m_nodes.resize(size_t(nodeCount));
+	m_nodeParents.assign(size_t(nodeCount), ~0u);
+	m_leafParents.assign(size_t(leafCount), ~0u);
+	m_visitCounts = std::make_unique<std::atomic<uint>[]>(size_t(nodeCount));
+
+	// length of the common prefix of two codes, equal codes are told apart by the indices of their leaves
+	auto delta = [&](int64_t i, int64_t j) -> int {
+		if (j < 0 || j >= leafCount)
+			return -1;
+
+		if (codes[size_t(i)] == codes[size_t(j)])
+			return 32 + countLeadingZeros(uint(i) ^ uint(j));
+
+		return countLeadingZeros(codes[size_t(i)] ^ codes[size_t(j)]);
+	};
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (int64_t i = int64_t(rangeBegin(size_t(nodeCount), thread, m_threadCount)); i < int64_t(rangeBegin(size_t(nodeCount), thread + 1, m_threadCount)); i++)
+		{
+			// direction of the range and its other end
+			const int64_t d = (delta(i, i + 1) - delta(i, i - 1) >= 0) ? 1 : -1;
+			const int minimumDelta = delta(i, i - d);
+
+			int64_t maximumLength = 2;
+
+			while (delta(i, i + maximumLength * d) > minimumDelta)
+				maximumLength *= 2;
+
+			int64_t length = 0;
+
+			for (int64_t t = maximumLength / 2; t >= 1; t /= 2)
+			{
+				if (delta(i, i + (length + t) * d) > minimumDelta)
+					length += t;
+			}
+
+			const int64_t j = i + length * d;
+			const int nodeDelta = delta(i, j);
+
+			// the split is where the common prefix of the range ends
+			int64_t split = 0;
+
+			for (int64_t divider = 2, t = (length + 1) / 2; ; divider *= 2, t = (length + divider - 1) / divider)
+			{
+				if (delta(i, i + (split + t) * d) > nodeDelta)
+					split += t;
+
+				if (t <= 1)
+					break;
+			}
+
+			const int64_t gamma = i + split * d + std::min(d, int64_t(0));
+			Node& node = m_nodes[size_t(i)];
+
+			if (std::min(i, j) == gamma)
+			{
+				node.children[0] = uint(gamma) | leafFlag;
+				m_leafParents[size_t(gamma)] = uint(i);
+			}
+			else
+			{
+				node.children[0] = uint(gamma);
+				m_nodeParents[size_t(gamma)] = uint(i);
+			}
+
+			if (std::max(i, j) == gamma + 1)
+			{
+				node.children[1] = uint(gamma + 1) | leafFlag;
+				m_leafParents[size_t(gamma + 1)] = uint(i);
+			}
+			else
+			{
+				node.children[1] = uint(gamma + 1);
+				m_nodeParents[size_t(gamma + 1)] = uint(i);
+			}
+		}
+	});
+}
+
+// Bounds are propagated from the leaves to the root, the second thread arriving at a node computes its bounds
+void BoundingVolumeHierarchy::updateBounds()
+{
+	const size_t leafCount = m_leaves.size();
+
+	for (size_t i = 0; i < m_nodes.size(); i++)
+		m_visitCounts[i].store(0, std::memory_order_relaxed);
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(leafCount, thread, m_threadCount); i < rangeBegin(leafCount, thread + 1, m_threadCount); i++)
+		{
+			uint index = m_leafParents[i];
+
+			while (index != ~0u)
+			{
+				if (m_visitCounts[index].fetch_add(1, std::memory_order_acq_rel) == 0)
+					break;
+
+				Node& node = m_nodes[index];
+				node.minimum = vec3(std::numeric_limits<float>::max());
+				node.maximum = vec3(-std::numeric_limits<float>::max());
+				node.radius = 0.0f;
+
+				for (uint child : node.children)
+				{
+					if (child & leafFlag)
+					{
+						const vec4& leaf = m_leaves[child & ~leafFlag];
+						node.minimum = min(node.minimum, vec3(leaf));
+						node.maximum = max(node.maximum, vec3(leaf));
+						node.radius = std::max(node.radius, leaf.w);
+					}
+					else
+					{
+						const Node& childNode = m_nodes[child];
+						node.minimum = min(node.minimum, childNode.minimum);
+						node.maximum = max(node.maximum, childNode.maximum);
+						node.radius = std::max(node.radius, childNode.radius);
+					}
+				}
+
+				index = m_nodeParents[index];
+			}
+		}
+	});
+}
+
+float BoundingVolumeHierarchy::atomRadius(const vec4& atom) const
+{
+	const uint elementIndex = floatBitsToUint(atom.w) & 0xff;
+	return (elementIndex < m_elementRadii.size()) ? m_elementRadii[elementIndex] : 1.0f;
+}
+
+bool BoundingVolumeHierarchy::intersect(const Ray& ray, float radiusScale, Hit& hit) const
+{
+	hit = Hit();
+
+	if (m_leaves.empty())
+		return false;
+
+	const vec3 direction = normalize(ray.direction);
+	const vec3 inverseDirection = vec3(1.0f) / direction;
+
+	auto intersectLeaf = [&](uint leaf) {
+		const float distance = intersectSphere(ray.origin, direction, m_leaves[leaf], radiusScale);
+
+		if (distance >= 0.0f && distance < hit.distance)
+		{
+			hit.distance = distance;
+			hit.atom = m_order[leaf];
+		}
+	};
+
+	if (m_nodes.empty())
+	{
+		intersectLeaf(0);
+		return hit.atom != ~0u;
+	}
+
+	uint stack[maximumStackSize];
+	uint stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+		std::array<float, 2> entries = { { -1.0f, -1.0f } };
+
+		for (uint c = 0; c < 2; c++)
+		{
+			const uint child = node.children[c];
+
+			if (child & leafFlag)
+			{
+				intersectLeaf(child & ~leafFlag);
+			}
+			else
+			{
+				const Node& childNode = m_nodes[child];
+				const vec3 extent = vec3(childNode.radius * radiusScale);
+				entries[c] = intersectBox(ray.origin, inverseDirection, childNode.minimum - extent, childNode.maximum + extent, hit.distance);
+			}
+		}
+
+		// the nearer child is pushed last, so it is visited first and can cull the farther one
+		const uint first = (entries[0] <= entries[1]) ? 1 : 0;
+
+		for (uint c : { first, 1 - first })
+		{
+			if (entries[c] >= 0.0f)
+				stack[stackSize++] = node.children[c];
+		}
+	}
+
+	return hit.atom != ~0u;
+}
+
+void BoundingVolumeHierarchy::intersect(const std::array<Ray, packetSize>& rays, float radiusScale, std::array<Hit, packetSize>& hits) const
+{
+	hits.fill(Hit());
+
+	if (m_leaves.empty())
+		return;
+
+	std::array<vec3, packetSize> directions;
+	std::array<vec3, packetSize> inverseDirections;
+
+	for (uint r = 0; r < packetSize; r++)
+	{
+		directions[r] = normalize(rays[r].direction);
+		inverseDirections[r] = vec3(1.0f) / directions[r];
+	}
+
+	auto intersectLeaf = [&](uint leaf) {
+		for (uint r = 0; r < packetSize; r++)
+		{
+			const float distance = intersectSphere(rays[r].origin, directions[r], m_leaves[leaf], radiusScale);
+
+			if (distance >= 0.0f && distance < hits[r].distance)
+			{
+				hits[r].distance = distance;
+				hits[r].atom = m_order[leaf];
+			}
+		}
+	};
+
+	if (m_nodes.empty())
+	{
+		intersectLeaf(0);
+		return;
+	}
+
+	uint stack[maximumStackSize];
+	uint stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+		std::array<float, 2> entries = { { -1.0f, -1.0f } };
+
+		for (uint c = 0; c < 2; c++)
+		{
+			const uint child = node.children[c];
+
+			if (child & leafFlag)
+			{
+				intersectLeaf(child & ~leafFlag);
+				continue;
+			}
+
+			// a child is visited if any of the rays enters it, it is ordered by the nearest entry among them
+			const Node& childNode = m_nodes[child];
+			const vec3 extent = vec3(childNode.radius * radiusScale);
+			const vec3 minimum = childNode.minimum - extent;
+			const vec3 maximum = childNode.maximum + extent;
+
+			for (uint r = 0; r < packetSize; r++)
+			{
+				const float entry = intersectBox(rays[r].origin, inverseDirections[r], minimum, maximum, hits[r].distance);
+
+				if (entry >= 0.0f && (entries[c] < 0.0f || entry < entries[c]))
+					entries[c] = entry;
+			}
+		}
+
+		const uint first = (entries[0] <= entries[1]) ? 1 : 0;
+
+		for (uint c : { first, 1 - first })
+		{
+			if (entries[c] >= 0.0f)
+				stack[stackSize++] = node.children[c];
+		}
+	}
+}
+
+void BoundingVolumeHierarchy::intersectAll(const Ray& ray, float radiusScale, std::vector<Hit>& hits) const
+{
+	hits.clear();
+
+	if (m_leaves.empty())
+		return;
+
+	const vec3 direction = normalize(ray.direction);
+	const vec3 inverseDirection = vec3(1.0f) / direction;
+	const float farthest = std::numeric_limits<float>::max();
+
+	auto intersectLeaf = [&](uint leaf) {
+		const float distance = intersectSphere(ray.origin, direction, m_leaves[leaf], radiusScale);
+
+		if (distance >= 0.0f)
+		{
+			Hit hit;
+			hit.atom = m_order[leaf];
+			hit.distance = distance;
+			hits.push_back(hit);
+		}
+	};
+
+	if (m_nodes.empty())
+	{
+		intersectLeaf(0);
+		return;
+	}
+
+	uint stack[maximumStackSize];
+	uint stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const Node& node = m_nodes[stack[--stackSize]];
+
+		for (uint child : node.children)
+		{
+			if (child & leafFlag)
+			{
+				intersectLeaf(child & ~leafFlag);
+			}
+			else
+			{
+				const Node& childNode = m_nodes[child];
+				const vec3 extent = vec3(childNode.radius * radiusScale);
+
+				if (intersectBox(ray.origin, inverseDirection, childNode.minimum - extent, childNode.maximum + extent, farthest) >= 0.0f)
+					stack[stackSize++] = child;
+			}
+		}
+	}
+
+	std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) { return a.distance < b.distance; });
+}
+
+uint BoundingVolumeHierarchy::atomCount() const
+{
+	return uint(m_leaves.size());
+}
+
+uint BoundingVolumeHierarchy::nodeCount() const
+{
+	return uint(m_nodes.size());
+}
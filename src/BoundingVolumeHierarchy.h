@@ -0,0 +1,85 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <atomic>
+#include <limits>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Linear bounding volume hierarchy (Karras 2012) over the atom spheres of one timestep for ray queries
+	// Leaves are single atoms in Morton order, internal nodes are built in parallel from the sorted codes
+	// Node bounds enclose the atom centers together with the largest radius below the node, so queries can scale the radii freely,
+	// e.g. to the spheres of influence used for the surface
+	class BoundingVolumeHierarchy
+	{
+	public:
+		struct Ray
+		{
+			glm::vec3 origin = glm::vec3(0.0f);
+			glm::vec3 direction = glm::vec3(0.0f, 0.0f, -1.0f);
+		};
+
+		struct Hit
+		{
+			glm::uint atom = ~0u;
+			float distance = std::numeric_limits<float>::max();
+		};
+
+		// Number of rays traversed together by the packet query
+		static const glm::uint packetSize = 4;
+
+		// Radii are looked up by the element index stored in the w component of the atoms
+		void build(const std::vector<glm::vec4>& atoms, const std::vector<float>& elementRadii);
+
+		// Updates the bounds for new positions of the same atoms without changing the topology of the tree
+		// Refitting keeps queries correct but becomes less efficient the further atoms move from where they were during the build
+		void refit(const std::vector<glm::vec4>& atoms);
+
+		// Nearest atom sphere hit by the ray, radii are multiplied by radiusScale
+		bool intersect(const Ray& ray, float radiusScale, Hit& hit) const;
+
+		// Nearest hits of a packet of rays that traverse the tree together, which pays off for coherent rays like those of neighboring pixels
+		void intersect(const std::array<Ray, packetSize>& rays, float radiusScale, std::array<Hit, packetSize>& hits) const;
+
+		// All atoms whose scaled sphere is hit by the ray, e.g. the spheres of influence contributing to the surface along the ray
+		void intersectAll(const Ray& ray, float radiusScale, std::vector<Hit>& hits) const;
+
+		glm::uint atomCount() const;
+		glm::uint nodeCount() const;
+
+	private:
+		struct Node
+		{
+			glm::vec3 minimum = glm::vec3(0.0f);
+			float radius = 0.0f;
+			glm::vec3 maximum = glm::vec3(0.0f);
+
+			// children with the leaf flag set refer to a leaf
+			std::array<glm::uint, 2> children = { { 0, 0 } };
+		};
+
+		static const glm::uint leafFlag = 0x80000000u;
+
+		void buildNodes(const std::vector<glm::uint>& codes);
+		void updateBounds();
+
+		float atomRadius(const glm::vec4& atom) const;
+
+		std::vector<float> m_elementRadii;
+
+		// atom centers and radii in the order of the leaves
+		std::vector<glm::vec4> m_leaves;
+
+		// index of the atom of each leaf
+		std::vector<glm::uint> m_order;
+
+		std::vector<Node> m_nodes;
+		std::vector<glm::uint> m_nodeParents;
+		std::vector<glm::uint> m_leafParents;
+		std::unique_ptr<std::atomic<glm::uint>[]> m_visitCounts;
+		glm::uint m_threadCount = 1;
+	};
+}
@@ -0,0 +1,191 @@
+#include "DcdTrajectory.h"
+
+#include <cstring>
+#include <filesystem>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	uint32_t swapBytes(uint32_t value)
+	{
+		return (value >> 24) | ((value >> 8) & 0xff00) | ((value << 8) & 0xff0000) | (value << 24);
+	}
+}
+
+DcdTrajectory::DcdTrajectory(const std::string& filename) : Trajectory(filename)
+{
+}
+
+bool DcdTrajectory::readHeader()
+{
+	m_file.open(m_filename, std::ios::binary);
+
+	if (!m_file.is_open())
+		return false;
+
+	// the first record has a fixed size of 84 bytes, which also tells the byte order of the file
+	uint32_t marker = 0;
+	m_file.read(reinterpret_cast<char*>(&marker), sizeof(marker));
+
+	if (marker != 84)
+	{
+		if (swapBytes(marker) != 84)
+		{
+			globjects::critical() << "Not a DCD file or unsupported record markers!";
+			return false;
+		}
+
+		m_swapBytes = true;
+	}
+
+	m_file.seekg(0);
+
+	char magic[4];
+	int32_t control[20];
+	char header[84];
+
+	if (!readRecord(header, sizeof(header)))
+		return false;
+
+	std::memcpy(magic, header, sizeof(magic));
+	std::memcpy(control, header + sizeof(magic), sizeof(control));
+
+	if (m_swapBytes)
+	{
+		for (auto& c : control)
+			c = int32_t(swapBytes(uint32_t(c)));
+	}
+
+	if (std::memcmp(magic, "CORD", 4) != 0)
+	{
+		globjects::critical() << "DCD file does not contain coordinates!";
+		return false;
+	}
+
+	// the last control word holds the CHARMM version, X-PLOR files leave it at zero and have no extensions
+	const bool charmm = control[19] != 0;
+	const int32_t fixedAtomCount = control[8];
+	m_hasUnitCell = charmm && control[10] != 0;
+	m_hasFourthDimension = charmm && control[11] != 0;
+
+	if (fixedAtomCount > 0)
+	{
+		globjects::critical() << "DCD files with fixed atoms are not supported!";
+		return false;
+	}
+
+	uint64_t titleSize = 0;
+
+	if (!readRecordSize(titleSize))
+		return false;
+
+	m_file.seekg(std::streamoff(titleSize + sizeof(uint32_t)), std::ios::cur);
+
+	int32_t atomCount = 0;
+
+	if (!readRecord(&atomCount, sizeof(atomCount)))
+		return false;
+
+	if (m_swapBytes)
+		atomCount = int32_t(swapBytes(uint32_t(atomCount)));
+
+	if (atomCount <= 0)
+		return false;
+
+	m_atomCount = uint(atomCount);
+	m_headerSize = uint64_t(m_file.tellg());
+
+	const uint64_t coordinateRecordSize = 2 * sizeof(uint32_t) + uint64_t(m_atomCount) * sizeof(float);
+	m_frameSize = 3 * coordinateRecordSize;
+
+	if (m_hasUnitCell)
+		m_frameSize += 2 * sizeof(uint32_t) + 6 * sizeof(double);
+
+	if (m_hasFourthDimension)
+		m_frameSize += coordinateRecordSize;
+
+	// the frame count in the header is not updated by all writers, so it is derived from the file size instead
+	std::error_code error;
+	const uint64_t fileSize = std::filesystem::file_size(m_filename, error);
+
+	if (error || fileSize < m_headerSize)
+		return false;
+
+	m_frameCount = uint((fileSize - m_headerSize) / m_frameSize);
+
+	if (control[0] > 0 && uint(control[0]) != m_frameCount)
+		globjects::warning() << "DCD header announces " << control[0] << " frames, but the file contains " << m_frameCount << ".";
+
+	return m_frameCount > 0;
+}
+
+bool DcdTrajectory::readFrame(uint frame, std::vector<vec3>& positions)
+{
+	if (frame >= m_frameCount)
+		return false;
+
+	m_file.clear();
+	m_file.seekg(std::streamoff(m_headerSize + uint64_t(frame) * m_frameSize));
+
+	if (m_hasUnitCell)
+		m_file.seekg(std::streamoff(2 * sizeof(uint32_t) + 6 * sizeof(double)), std::ios::cur);
+
+	m_coordinates.resize(size_t(m_atomCount) * 3);
+	positions.resize(m_atomCount);
+
+	// coordinates are stored as separate records for x, y and z
+	for (uint c = 0; c < 3; c++)
+	{
+		float* coordinates = m_coordinates.data() + size_t(c) * m_atomCount;
+
+		if (!readRecord(coordinates, uint64_t(m_atomCount) * sizeof(float)))
+			return false;
+
+		if (m_swapBytes)
+		{
+			for (uint i = 0; i < m_atomCount; i++)
+			{
+				uint32_t bits;
+				std::memcpy(&bits, &coordinates[i], sizeof(bits));
+				bits = swapBytes(bits);
+				std::memcpy(&coordinates[i], &bits, sizeof(bits));
+			}
+		}
+
+		for (uint i = 0; i < m_atomCount; i++)
+			positions[i][c] = coordinates[i];
+	}
+
+	return true;
+}
+
+// Fortran unformatted records are enclosed by two markers containing their size
+bool DcdTrajectory::readRecordSize(uint64_t& size)
+{
+	uint32_t marker = 0;
+	m_file.read(reinterpret_cast<char*>(&marker), sizeof(marker));
+
+	if (m_swapBytes)
+		marker = swapBytes(marker);
+
+	size = marker;
+	return bool(m_file);
+}
+
+bool DcdTrajectory::readRecord(void* data, uint64_t size)
+{
+	uint64_t recordSize = 0;
+
+	if (!readRecordSize(recordSize) || recordSize != size)
+		return false;
+
+	m_file.read(static_cast<char*>(data), std::streamsize(size));
+
+	if (!readRecordSize(recordSize) || recordSize != size)
+		return false;
+
+	return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <fstream>
+#include <cstdint>
+
+namespace dynamol
+{
+	// CHARMM/NAMD DCD trajectories
+	// All frames have the same size, so they are located by computing their offset
+	class DcdTrajectory : public Trajectory
+	{
+	public:
+		DcdTrajectory(const std::string& filename);
+		virtual bool readFrame(glm::uint frame, std::vector<glm::vec3>& positions) override;
+
+	protected:
+		virtual bool readHeader() override;
+
+	private:
+		bool readRecord(void* data, uint64_t size);
+		bool readRecordSize(uint64_t& size);
+
+		std::ifstream m_file;
+		bool m_swapBytes = false;
+		bool m_hasUnitCell = false;
+		bool m_hasFourthDimension = false;
+		uint64_t m_headerSize = 0;
+		uint64_t m_frameSize = 0;
+		std::vector<float> m_coordinates;
+	};
+}
@@ -0,0 +1,277 @@
+#include "DecompressingStreamBuffer.h"
+
+#include <zlib.h>
+#include <zstd.h>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+
+namespace
+{
+	// Size of the decompressed blocks handed to the reader
+	const size_t outputBlockSize = size_t(4) << 20;
+
+	// Size of the compressed chunks read from the source
+	const size_t inputChunkSize = size_t(1) << 20;
+
+	// Blocks decompressed ahead of the reader, bounds the memory use for arbitrarily large files
+	const size_t maximumQueuedBlocks = 2;
+}
+
+DecompressingStreamBuffer::Format DecompressingStreamBuffer::detectFormat(std::istream& source)
+{
+	unsigned char magic[4] = {};
+	const std::streampos position = source.tellg();
+
+	source.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	const std::streamsize count = source.gcount();
+
+	source.clear();
+	source.seekg(position);
+
+	if (count >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+		return Format::Gzip;
+
+	if (count >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd)
+		return Format::Zstd;
+
+	return Format::None;
+}
+
+DecompressingStreamBuffer::DecompressingStreamBuffer(std::istream& source, Format format) : m_source(source), m_format(format)
+{
+	setg(nullptr, nullptr, nullptr);
+	m_thread = std::thread(&DecompressingStreamBuffer::decompress, this);
+}
+
+DecompressingStreamBuffer::~DecompressingStreamBuffer()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+bool DecompressingStreamBuffer::failed() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_failed;
+}
+
+size_t DecompressingStreamBuffer::compressedBytesRead() const
+{
+	return m_compressedBytesRead;
+}
+
+DecompressingStreamBuffer::int_type DecompressingStreamBuffer::underflow()
+{
+	if (gptr() < egptr())
+		return traits_type::to_int_type(*gptr());
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	// the block that was just read is reused by the decompressor
+	if (m_currentBlock.capacity() > 0)
+		m_freeBlocks.push_back(std::move(m_currentBlock));
+
+	m_currentBlock = std::vector<char>();
+	m_condition.notify_all();
+	m_condition.wait(lock, [this]() { return !m_blocks.empty() || m_finished; });
+
+	if (m_blocks.empty())
+	{
+		setg(nullptr, nullptr, nullptr);
+		return traits_type::eof();
+	}
+
+	m_currentBlock = std::move(m_blocks.front());
+	m_blocks.pop_front();
+	m_condition.notify_all();
+
+	setg(m_currentBlock.data(), m_currentBlock.data(), m_currentBlock.data() + m_currentBlock.size());
+	return traits_type::to_int_type(*gptr());
+}
+
+bool DecompressingStreamBuffer::pushBlock(std::vector<char>& block)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_condition.wait(lock, [this]() { return m_blocks.size() < maximumQueuedBlocks || m_stop; });
+
+	if (m_stop)
+		return false;
+
+	m_blocks.push_back(std::move(block));
+	m_condition.notify_all();
+
+	if (!m_freeBlocks.empty())
+	{
+		block = std::move(m_freeBlocks.back());
+		m_freeBlocks.pop_back();
+	}
+	else
+	{
+		block = std::vector<char>();
+	}
+
+	block.resize(outputBlockSize);
+	return true;
+}
+
+void DecompressingStreamBuffer::decompress()
+{
+	const bool success = (m_format == Format::Zstd) ? decompressZstd() : decompressGzip();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (!success && !m_stop)
+	{
+		globjects::critical() << "Compressed data is corrupt or truncated!";
+		m_failed = true;
+	}
+
+	m_finished = true;
+	m_condition.notify_all();
+}
+
+bool DecompressingStreamBuffer::decompressGzip()
+{
+	z_stream stream = {};
+
+	// a window size of 15 plus 32 enables automatic detection of gzip and zlib headers
+	if (inflateInit2(&stream, 15 + 32) != Z_OK)
+		return false;
+
+	std::vector<char> input(inputChunkSize);
+	std::vector<char> output(outputBlockSize);
+	size_t outputSize = 0;
+	bool outputFull = false;
+	bool complete = true;
+	bool success = true;
+
+	while (true)
+	{
+		// keep inflating without new input as long as the previous call filled the whole output block
+		if (stream.avail_in == 0 && !outputFull)
+		{
+			m_source.read(input.data(), std::streamsize(input.size()));
+			stream.next_in = reinterpret_cast<Bytef*>(input.data());
+			stream.avail_in = uInt(m_source.gcount());
+			m_compressedBytesRead += size_t(stream.avail_in);
+
+			if (stream.avail_in == 0)
+				break;
+		}
+
+		stream.next_out = reinterpret_cast<Bytef*>(output.data() + outputSize);
+		stream.avail_out = uInt(output.size() - outputSize);
+
+		const int result = inflate(&stream, Z_NO_FLUSH);
+		outputSize = output.size() - stream.avail_out;
+		outputFull = (stream.avail_out == 0);
+
+		if (result == Z_STREAM_END)
+		{
+			// files may consist of several concatenated gzip members
+			complete = true;
+			inflateReset(&stream);
+		}
+		else if (result == Z_OK)
+		{
+			complete = false;
+		}
+		else if (result != Z_BUF_ERROR)
+		{
+			success = false;
+			break;
+		}
+
+		if (outputFull)
+		{
+			if (!pushBlock(output))
+			{
+				success = false;
+				break;
+			}
+
+			outputSize = 0;
+		}
+	}
+
+	inflateEnd(&stream);
+
+	if (success && outputSize > 0)
+	{
+		output.resize(outputSize);
+		success = pushBlock(output);
+	}
+
+	return success && complete;
+}
+
+bool DecompressingStreamBuffer::decompressZstd()
+{
+	ZSTD_DStream* stream = ZSTD_createDStream();
+
+	if (!stream)
+		return false;
+
+	std::vector<char> input(inputChunkSize);
+	std::vector<char> output(outputBlockSize);
+	ZSTD_inBuffer in = { input.data(), 0, 0 };
+	size_t outputSize = 0;
+	bool outputFull = false;
+	bool success = true;
+
+	// zero once a frame has been completely decoded and flushed
+	size_t remaining = 0;
+
+	while (true)
+	{
+		if (in.pos == in.size && !outputFull)
+		{
+			m_source.read(input.data(), std::streamsize(input.size()));
+			in.size = size_t(m_source.gcount());
+			in.pos = 0;
+			m_compressedBytesRead += in.size;
+
+			if (in.size == 0)
+				break;
+		}
+
+		ZSTD_outBuffer out = { output.data(), output.size(), outputSize };
+		remaining = ZSTD_decompressStream(stream, &out, &in);
+
+		if (ZSTD_isError(remaining))
+		{
+			success = false;
+			break;
+		}
+
+		outputSize = out.pos;
+		outputFull = (outputSize == output.size());
+
+		if (outputFull)
+		{
+			if (!pushBlock(output))
+			{
+				success = false;
+				break;
+			}
+
+			outputSize = 0;
+		}
+	}
+
+	ZSTD_freeDStream(stream);
+
+	if (success && outputSize > 0)
+	{
+		output.resize(outputSize);
+		success = pushBlock(output);
+	}
+
+	return success && remaining == 0;
+}
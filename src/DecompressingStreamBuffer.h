@@ -0,0 +1,64 @@
+#pragma once
+
+#include <istream>
+#include <streambuf>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace dynamol
+{
+	// Stream buffer that decompresses gzip or zstd data from another stream on a background thread
+	// The next block is decompressed while the current one is being read, and only a few blocks are kept at a time
+	class DecompressingStreamBuffer : public std::streambuf
+	{
+	public:
+		enum class Format
+		{
+			None,
+			Gzip,
+			Zstd
+		};
+
+		// Detects the compression format from the first bytes of a stream without consuming them
+		static Format detectFormat(std::istream& source);
+
+		DecompressingStreamBuffer(std::istream& source, Format format);
+		~DecompressingStreamBuffer();
+
+		// True if the compressed data was corrupt or truncated
+		bool failed() const;
+
+		// Number of compressed bytes consumed from the source so far
+		size_t compressedBytesRead() const;
+
+	protected:
+		virtual int_type underflow() override;
+
+	private:
+		void decompress();
+		bool decompressGzip();
+		bool decompressZstd();
+
+		// Hands a filled block over to the reader, waits while the reader is behind
+		bool pushBlock(std::vector<char>& block);
+
+		std::istream& m_source;
+		Format m_format;
+
+		std::deque< std::vector<char> > m_blocks;
+		std::vector< std::vector<char> > m_freeBlocks;
+		std::vector<char> m_currentBlock;
+		bool m_finished = false;
+		bool m_failed = false;
+		bool m_stop = false;
+		std::atomic<size_t> m_compressedBytesRead = { 0 };
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::thread m_thread;
+	};
+}
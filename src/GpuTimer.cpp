@@ -0,0 +1,291 @@
+#include "GpuTimer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+#include <globjects/globjects.h>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+
+namespace
+{
+	// about ten minutes at 60 frames per second
+	const size_t maximumRecordedFrames = 36000;
+
+	std::string escapeJson(const std::string& string)
+	{
+		std::string escaped;
+
+		for (char c : string)
+		{
+			if (c == '"' || c == '\\')
+				escaped += '\\';
+
+			escaped += c;
+		}
+
+		return escaped;
+	}
+}
+
+GpuTimer::GpuTimer(uint ringSize)
+{
+	m_slots.resize(std::max(ringSize, 1u));
+}
+
+GpuTimer::~GpuTimer()
+{
+	for (auto& slot : m_slots)
+	{
+		if (!slot.queries.empty())
+			glDeleteQueries(GLsizei(slot.queries.size()), slot.queries.data());
+	}
+}
+
+void GpuTimer::setEnabled(bool enabled)
+{
+	m_enabled = enabled;
+}
+
+bool GpuTimer::isEnabled() const
+{
+	return m_enabled;
+}
+
+void GpuTimer::beginFrame()
+{
+	if (!m_enabled)
+		return;
+
+	collect();
+
+	// the queries of the next slot cannot be issued again before their results have been read, the frame is then skipped instead of waiting
+	Slot& slot = m_slots[m_next];
+
+	if (slot.pending)
+		return;
+
+	m_current = m_next;
+	m_stack.clear();
+	slot.queryCount = 0;
+	slot.zones.clear();
+
+	begin("Frame");
+}
+
+void GpuTimer::endFrame()
+{
+	if (m_current >= m_slots.size())
+		return;
+
+	while (!m_stack.empty())
+		end();
+
+	Slot& slot = m_slots[m_current];
+	slot.pending = true;
+	slot.frame = ++m_frame;
+
+	m_next = (m_current + 1) % uint(m_slots.size());
+	m_current = ~0u;
+}
+
+void GpuTimer::begin(const std::string& name)
+{
+	if (m_current >= m_slots.size())
+		return;
+
+	Slot& slot = m_slots[m_current];
+
+	PendingZone zone;
+	zone.name = name;
+	zone.depth = uint(m_stack.size());
+	zone.beginQuery = issueQuery();
+
+	m_stack.push_back(uint(slot.zones.size()));
+	slot.zones.push_back(zone);
+}
+
+void GpuTimer::end()
+{
+	if (m_current >= m_slots.size() || m_stack.empty())
+		return;
+
+	Slot& slot = m_slots[m_current];
+	slot.zones[m_stack.back()].endQuery = issueQuery();
+	m_stack.pop_back();
+}
+
+const std::vector<GpuTimer::Zone>& GpuTimer::zones() const
+{
+	return m_zones;
+}
+
+double GpuTimer::averageDuration(const std::string& name) const
+{
+	auto it = m_averageDurations.find(name);
+	return it != m_averageDurations.end() ? it->second : 0.0;
+}
+
+void GpuTimer::setRecording(bool recording)
+{
+	if (recording && !m_recording)
+		m_recordedFrames.clear();
+
+	m_recording = recording;
+}
+
+bool GpuTimer::isRecording() const
+{
+	return m_recording;
+}
+
+size_t GpuTimer::recordedFrameCount() const
+{
+	return m_recordedFrames.size();
+}
+
+bool GpuTimer::saveTrace(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::trunc);
+
+	if (!file.good())
+	{
+		globjects::warning() << "Could not write GPU trace " << filename;
+		return false;
+	}
+
+	// complete events in microseconds relative to the first recorded frame, all on a single track
+	const double origin = m_recordedFrames.empty() ? 0.0 : m_recordedFrames.front().time;
+
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+	file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"GPU\"}}";
+
+	for (const auto& frame : m_recordedFrames)
+	{
+		for (const auto& zone : frame.zones)
+		{
+			const double start = (frame.time - origin + zone.start) * 1000.0;
+
+			file << "," << std::endl;
+			file << "{\"name\":\"" << escapeJson(zone.name) << "\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":1,\"tid\":1,";
+			file << "\"ts\":" << start << ",\"dur\":" << zone.duration * 1000.0 << ",\"args\":{\"frame\":" << frame.frame << "}}";
+		}
+	}
+
+	file << std::endl << "]}" << std::endl;
+	return file.good();
+}
+
+bool GpuTimer::saveCsv(const std::string& filename) const
+{
+	std::ofstream file(filename, std::ios::trunc);
+
+	if (!file.good())
+	{
+		globjects::warning() << "Could not write GPU timings " << filename;
+		return false;
+	}
+
+	file << std::fixed << std::setprecision(4);
+	file << "frame,zone,depth,start,duration" << std::endl;
+
+	for (const auto& frame : m_recordedFrames)
+	{
+		for (const auto& zone : frame.zones)
+			file << frame.frame << "," << zone.name << "," << zone.depth << "," << zone.start << "," << zone.duration << "\n";
+	}
+
+	return file.good();
+}
+
+void GpuTimer::collect()
+{
+	// the slots complete in the order of their frames, the results of a frame are available once its last query has passed
+	while (true)
+	{
+		Slot* oldest = nullptr;
+
+		for (auto& slot : m_slots)
+		{
+			if (slot.pending && (!oldest || slot.frame < oldest->frame))
+				oldest = &slot;
+		}
+
+		if (!oldest)
+			break;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(oldest->queries[oldest->queryCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+		if (available == 0)
+			break;
+
+		std::vector<GLuint64> timestamps(oldest->queryCount);
+
+		for (uint i = 0; i < oldest->queryCount; i++)
+			glGetQueryObjectui64v(oldest->queries[i], GL_QUERY_RESULT, &timestamps[i]);
+
+		Frame frame;
+		frame.frame = oldest->frame;
+		frame.time = double(timestamps[oldest->zones.front().beginQuery]) * 1.0e-6;
+
+		for (const auto& pendingZone : oldest->zones)
+		{
+			Zone zone;
+			zone.name = pendingZone.name;
+			zone.depth = pendingZone.depth;
+			zone.start = double(timestamps[pendingZone.beginQuery]) * 1.0e-6 - frame.time;
+			zone.duration = double(timestamps[pendingZone.endQuery] - timestamps[pendingZone.beginQuery]) * 1.0e-6;
+			frame.zones.push_back(zone);
+		}
+
+		oldest->pending = false;
+
+		// zones that appear more than once per frame, e.g. with stereo rendering, are summed up before averaging
+		std::unordered_map<std::string, double> durations;
+
+		for (const auto& zone : frame.zones)
+			durations[zone.name] += zone.duration;
+
+		for (auto& duration : durations)
+		{
+			auto it = m_averageDurations.find(duration.first);
+
+			if (it != m_averageDurations.end())
+				duration.second = it->second + 0.1 * (duration.second - it->second);
+		}
+
+		m_averageDurations = std::move(durations);
+		m_zones = frame.zones;
+
+		if (m_recording)
+		{
+			if (m_recordedFrames.size() < maximumRecordedFrames)
+				m_recordedFrames.push_back(std::move(frame));
+			else
+				m_recording = false;
+		}
+	}
+}
+
+uint GpuTimer::issueQuery()
+{
+	Slot& slot = m_slots[m_current];
+
+	if (slot.queryCount == slot.queries.size())
+	{
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		slot.queries.push_back(query);
+	}
+
+	const uint index = slot.queryCount++;
+	glQueryCounter(slot.queries[index], GL_TIMESTAMP);
+	return index;
+}
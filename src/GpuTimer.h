@@ -0,0 +1,97 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glbinding/gl/gl.h>
+
+namespace dynamol
+{
+	// GPU times of the passes of a frame, measured with timestamp queries that are read back a few frames later so that the pipeline never stalls
+	// Every frame issues its queries into the next slot of a ring, a frame is not measured if its slot is still waiting for results
+	// Zones are opened and closed around the commands of a pass and can be nested, the whole frame is always the first zone
+	class GpuTimer
+	{
+	public:
+		// Times in milliseconds relative to the start of the frame
+		struct Zone
+		{
+			std::string name;
+			glm::uint depth = 0;
+			double start = 0.0;
+			double duration = 0.0;
+		};
+
+		GpuTimer(glm::uint ringSize = 4);
+		~GpuTimer();
+
+		// Queries are only issued while enabled, otherwise all calls return immediately
+		void setEnabled(bool enabled);
+		bool isEnabled() const;
+
+		// Collects the results of earlier frames that have become available and starts the zone of the current frame
+		void beginFrame();
+		void endFrame();
+
+		void begin(const std::string& name);
+		void end();
+
+		// Zones of the most recent frame whose results are available, and their durations averaged by name over recent frames
+		const std::vector<Zone>& zones() const;
+		double averageDuration(const std::string& name) const;
+
+		// Completed frames are kept while recording and can then be written as a trace in the Chrome trace event format or as CSV
+		void setRecording(bool recording);
+		bool isRecording() const;
+		size_t recordedFrameCount() const;
+
+		bool saveTrace(const std::string& filename) const;
+		bool saveCsv(const std::string& filename) const;
+
+	private:
+		struct PendingZone
+		{
+			std::string name;
+			glm::uint depth = 0;
+			glm::uint beginQuery = 0;
+			glm::uint endQuery = 0;
+		};
+
+		struct Slot
+		{
+			std::vector<gl::GLuint> queries;
+			glm::uint queryCount = 0;
+			std::vector<PendingZone> zones;
+			bool pending = false;
+			std::uint64_t frame = 0;
+		};
+
+		struct Frame
+		{
+			std::uint64_t frame = 0;
+
+			// start of the frame in milliseconds on the GPU clock
+			double time = 0.0;
+			std::vector<Zone> zones;
+		};
+
+		void collect();
+		glm::uint issueQuery();
+
+		bool m_enabled = false;
+		bool m_recording = false;
+
+		std::vector<Slot> m_slots;
+		glm::uint m_next = 0;
+		glm::uint m_current = ~0u;
+		std::uint64_t m_frame = 0;
+		std::vector<glm::uint> m_stack;
+
+		std::vector<Zone> m_zones;
+		std::unordered_map<std::string, double> m_averageDurations;
+		std::vector<Frame> m_recordedFrames;
+	};
+}
@@ -0,0 +1,476 @@
+#include "LevelOfDetail.h"
+
+#include <algorithm>
+#include <limits>
+#include <cstdint>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// Residues are not stored with the atoms, they are recovered as runs of consecutive atoms in the file
+	// with the same residue type and chain, split where the run grows larger than a single residue
+	const uint residueSize = 16;
+	const float residueExtent = 8.0f;
+
+	// Chain segments are runs of consecutive residues of the same chain within a limited extent,
+	// chain identifiers repeat in very large structures and would otherwise join unrelated parts
+	const uint segmentSize = 256;
+	const float segmentExtent = 32.0f;
+
+	// Chunks are small enough to be hidden behind the surface of a protein, but large enough for a few draw commands to cover a whole segment
+	const uint chunkSize = 32;
+
+	// Radius of a sphere with a uniform density and the same radius of gyration, extended by the average radius of the atoms
+	float fittedRadius(float squaredGyrationRadius, float atomRadius)
+	{
+		return sqrt(5.0f / 3.0f * squaredGyrationRadius) + atomRadius;
+	}
+
+	uint radiusCode(float radius)
+	{
+		return uint(clamp(round(16.0f * sqrt(radius)), 1.0f, 255.0f));
+	}
+
+	float codeRadius(uint code)
+	{
+		return float(code * code) / 256.0f;
+	}
+
+	// Normalized plane equations of the view frustum of a model view projection matrix
+	std::array<vec4, 6> frustumPlanes(const mat4& matrix)
+	{
+		const mat4 rows = transpose(matrix);
+		std::array<vec4, 6> planes = { { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] } };
+
+		for (auto& plane : planes)
+			plane /= max(length(vec3(plane)), std::numeric_limits<float>::min());
+
+		return planes;
+	}
+}
+
+void LevelOfDetail::build(const std::vector<vec4>& atoms, const std::vector<uint>& atomOrder, const std::vector<float>& elementRadii)
+{
+	m_atomCount = uint(atoms.size());
+	m_residues.clear();
+	m_segments.clear();
+	m_chunks.clear();
+	m_segmentAtoms.clear();
+	m_chunkAtoms.clear();
+	m_primitiveAttributes.clear();
+	m_indices.resize(m_atomCount);
+
+	// the atom order maps each atom to its index in the file
+	if (atomOrder.size() == atoms.size())
+	{
+		for (uint i = 0; i < m_atomCount; i++)
+			m_indices[atomOrder[i]] = i;
+	}
+	else
+	{
+		for (uint i = 0; i < m_atomCount; i++)
+			m_indices[i] = i;
+	}
+
+	auto atomRadius = [&](const vec4& atom) {
+		const uint element = floatBitsToUint(atom.w) & 0xff;
+		return element < elementRadii.size() ? elementRadii[element] : 1.0f;
+	};
+
+	// Residues
+	uint residueKey = ~0u;
+	vec3 residueStart = vec3(0.0f);
+
+	for (uint i = 0; i < m_atomCount; i++)
+	{
+		const vec4& atom = atoms[m_indices[i]];
+		const uint key = floatBitsToUint(atom.w) & 0xffff00;
+
+		if (m_residues.empty() || key != residueKey || m_residues.back().count >= residueSize || distance(vec3(atom), residueStart) > residueExtent)
+		{
+			Group residue;
+			residue.first = i;
+			m_residues.push_back(residue);
+
+			residueKey = key;
+			residueStart = vec3(atom);
+		}
+
+		m_residues.back().count++;
+	}
+
+	std::vector<vec3> residueCenters;
+	groupCenters(atoms, residueCenters);
+
+	// Segments
+	uint segmentChain = ~0u;
+
+	for (uint r = 0; r < uint(m_residues.size()); r++)
+	{
+		const uint chain = (floatBitsToUint(atoms[m_indices[m_residues[r].first]].w) >> 16) & 0xff;
+
+		if (m_segments.empty() || chain != segmentChain || m_segments.back().residues.count >= segmentSize || distance(residueCenters[r], residueCenters[m_segments.back().residues.first]) > segmentExtent)
+		{
+			Segment segment;
+			segment.residues.first = r;
+			m_segments.push_back(segment);
+
+			segmentChain = chain;
+		}
+
+		m_segments.back().residues.count++;
+	}
+
+	// Fitted radii and attributes of the residues, taking the most common element for coloring by element
+	const uint residueCount = uint(m_residues.size());
+	const uint segmentCount = uint(m_segments.size());
+	std::vector<uint> elementCounts(256);
+
+	// the largest radius of the atoms or the primitive of a group is kept for the bounds of the segments
+	auto groupAttributes = [&](uint firstAtom, uint atomCount, const vec3& center, float& boundingRadius, float& maximumRadius) {
+		float squaredGyrationRadius = 0.0f;
+		float averageRadius = 0.0f;
+		boundingRadius = 0.0f;
+		maximumRadius = 0.0f;
+		std::fill(elementCounts.begin(), elementCounts.end(), 0);
+
+		for (uint i = firstAtom; i < firstAtom + atomCount; i++)
+		{
+			const vec4& atom = atoms[m_indices[i]];
+			const float radius = atomRadius(atom);
+			const float centerDistance = distance(vec3(atom), center);
+
+			squaredGyrationRadius += centerDistance * centerDistance;
+			averageRadius += radius;
+			boundingRadius = max(boundingRadius, centerDistance + radius);
+			maximumRadius = max(maximumRadius, radius);
+			elementCounts[floatBitsToUint(atom.w) & 0xff]++;
+		}
+
+		squaredGyrationRadius /= float(atomCount);
+		averageRadius /= float(atomCount);
+
+		const uint element = uint(std::max_element(elementCounts.begin(), elementCounts.end()) - elementCounts.begin());
+		const uint first = floatBitsToUint(atoms[m_indices[firstAtom]].w);
+		const uint code = radiusCode(fittedRadius(squaredGyrationRadius, averageRadius));
+		maximumRadius = max(maximumRadius, codeRadius(code));
+
+		return element | (first & 0xffff00) | (code << 24);
+	};
+
+	m_primitiveAttributes.resize(residueCount + segmentCount);
+	std::vector<float> residueRadii(residueCount);
+	std::vector<float> residueMaximumRadii(residueCount);
+
+	for (uint r = 0; r < residueCount; r++)
+		m_primitiveAttributes[r] = groupAttributes(m_residues[r].first, m_residues[r].count, residueCenters[r], residueRadii[r], residueMaximumRadii[r]);
+
+	for (uint s = 0; s < segmentCount; s++)
+	{
+		Segment& segment = m_segments[s];
+		const Group& firstResidue = m_residues[segment.residues.first];
+		const Group& lastResidue = m_residues[segment.residues.first + segment.residues.count - 1];
+		const uint firstAtom = firstResidue.first;
+		const uint atomCount = lastResidue.first + lastResidue.count - firstAtom;
+
+		vec3 center = vec3(0.0f);
+		float maximumRadius = 0.0f;
+
+		for (uint r = segment.residues.first; r < segment.residues.first + segment.residues.count; r++)
+		{
+			center += residueCenters[r] * float(m_residues[r].count);
+			segment.residueRadius = max(segment.residueRadius, residueRadii[r]);
+			maximumRadius = max(maximumRadius, residueMaximumRadii[r]);
+		}
+
+		center /= float(atomCount);
+		m_primitiveAttributes[residueCount + s] = groupAttributes(firstAtom, atomCount, center, segment.radius, segment.maximumRadius);
+		segment.maximumRadius = max(segment.maximumRadius, maximumRadius);
+
+		segment.ranges[0].first = firstAtom;
+		segment.ranges[0].count = atomCount;
+		segment.ranges[1].first = m_atomCount + segment.residues.first;
+		segment.ranges[1].count = segment.residues.count;
+		segment.ranges[2].first = m_atomCount + residueCount + s;
+		segment.ranges[2].count = 1;
+
+		m_segmentAtoms.push_back(Group());
+		m_segmentAtoms.back().first = firstAtom;
+		m_segmentAtoms.back().count = atomCount;
+	}
+
+	// Chunks, bounded by the atoms of their residues for level 1 and by all atoms of the segment for level 2
+	for (uint s = 0; s < segmentCount; s++)
+	{
+		const Segment& segment = m_segments[s];
+
+		for (uint level = 0; level < levelCount; level++)
+		{
+			const Range& range = segment.ranges[level];
+
+			for (uint offset = 0; offset < range.count; offset += chunkSize)
+			{
+				Chunk chunk;
+				chunk.first = range.first + offset;
+				chunk.count = std::min(chunkSize, range.count - offset);
+				chunk.segment = s;
+				chunk.level = level;
+
+				Group chunkAtoms;
+
+				if (level == 0)
+				{
+					chunkAtoms.first = chunk.first;
+					chunkAtoms.count = chunk.count;
+
+					for (uint i = chunk.first; i < chunk.first + chunk.count; i++)
+						chunk.radius = max(chunk.radius, atomRadius(atoms[m_indices[i]]));
+				}
+				else if (level == 1)
+				{
+					const Group& firstResidue = m_residues[segment.residues.first + offset];
+					const Group& lastResidue = m_residues[segment.residues.first + offset + chunk.count - 1];
+					chunkAtoms.first = firstResidue.first;
+					chunkAtoms.count = lastResidue.first + lastResidue.count - firstResidue.first;
+
+					for (uint r = segment.residues.first + offset; r < segment.residues.first + offset + chunk.count; r++)
+						chunk.radius = max(chunk.radius, residueMaximumRadii[r]);
+				}
+				else
+				{
+					chunkAtoms.first = segment.ranges[0].first;
+					chunkAtoms.count = segment.ranges[0].count;
+					chunk.radius = segment.maximumRadius;
+				}
+
+				m_chunks.push_back(chunk);
+				m_chunkAtoms.push_back(chunkAtoms);
+			}
+		}
+	}
+
+	// the primitives are stored after the atoms, so their indices are also their positions in the index buffer
+	m_indices.resize(m_atomCount + residueCount + segmentCount);
+
+	for (uint i = m_atomCount; i < uint(m_indices.size()); i++)
+		m_indices[i] = i;
+}
+
+template <typename Position> void LevelOfDetail::groupCenters(const std::vector<Position>& positions, std::vector<vec3>& centers) const
+{
+	centers.resize(m_residues.size() + m_segments.size());
+
+	for (size_t r = 0; r < m_residues.size(); r++)
+	{
+		vec3 center = vec3(0.0f);
+
+		for (uint i = m_residues[r].first; i < m_residues[r].first + m_residues[r].count; i++)
+			center += vec3(positions[m_indices[i]]);
+
+		centers[r] = center / float(m_residues[r].count);
+	}
+
+	for (size_t s = 0; s < m_segments.size(); s++)
+	{
+		const Group& residues = m_segments[s].residues;
+		vec3 center = vec3(0.0f);
+		uint count = 0;
+
+		for (uint r = residues.first; r < residues.first + residues.count; r++)
+		{
+			center += centers[r] * float(m_residues[r].count);
+			count += m_residues[r].count;
+		}
+
+		centers[m_residues.size() + s] = center / float(count);
+	}
+}
+
+// Spheres around the centroid of the atoms of each group that reach the farthest of them, without their radii
+template <typename Position> void LevelOfDetail::groupBounds(const std::vector<Position>& positions, const vec3& offset, const vec3& scale, const std::vector<Group>& groups, std::vector<vec4>& bounds) const
+{
+	bounds.resize(groups.size());
+
+	for (size_t g = 0; g < groups.size(); g++)
+	{
+		const uint firstAtom = groups[g].first;
+		const uint lastAtom = firstAtom + groups[g].count;
+		vec3 center = vec3(0.0f);
+
+		for (uint i = firstAtom; i < lastAtom; i++)
+			center += vec3(positions[m_indices[i]]);
+
+		center = offset + center / float(groups[g].count) * scale;
+
+		float squaredRadius = 0.0f;
+
+		for (uint i = firstAtom; i < lastAtom; i++)
+		{
+			const vec3 offsetToCenter = offset + vec3(positions[m_indices[i]]) * scale - center;
+			squaredRadius = max(squaredRadius, dot(offsetToCenter, offsetToCenter));
+		}
+
+		bounds[g] = vec4(center, sqrt(squaredRadius));
+	}
+}
+
+// The primitives lie within the convex hull of their atoms, so the distance to the farthest atom covers them as well
+// The radii of the segments and chunks are added to reach the surfaces of their atoms and primitives
+void LevelOfDetail::bounds(const std::vector<vec4>& atoms, std::vector<vec4>& bounds) const
+{
+	groupBounds(atoms, vec3(0.0f), vec3(1.0f), m_segmentAtoms, bounds);
+
+	for (size_t s = 0; s < m_segments.size(); s++)
+		bounds[s].w += m_segments[s].maximumRadius;
+}
+
+void LevelOfDetail::bounds(const std::vector<u16vec3>& positions, const vec3& offset, const vec3& extent, std::vector<vec4>& bounds) const
+{
+	groupBounds(positions, offset, extent / float(std::numeric_limits<uint16_t>::max()), m_segmentAtoms, bounds);
+
+	for (size_t s = 0; s < m_segments.size(); s++)
+		bounds[s].w += m_segments[s].maximumRadius;
+}
+
+void LevelOfDetail::chunkBounds(const std::vector<vec4>& atoms, std::vector<vec4>& bounds) const
+{
+	groupBounds(atoms, vec3(0.0f), vec3(1.0f), m_chunkAtoms, bounds);
+
+	for (size_t c = 0; c < m_chunks.size(); c++)
+		bounds[c].w += m_chunks[c].radius;
+}
+
+void LevelOfDetail::chunkBounds(const std::vector<u16vec3>& positions, const vec3& offset, const vec3& extent, std::vector<vec4>& bounds) const
+{
+	groupBounds(positions, offset, extent / float(std::numeric_limits<uint16_t>::max()), m_chunkAtoms, bounds);
+
+	for (size_t c = 0; c < m_chunks.size(); c++)
+		bounds[c].w += m_chunks[c].radius;
+}
+
+void LevelOfDetail::primitives(const std::vector<vec4>& atoms, std::vector<vec4>& primitives) const
+{
+	std::vector<vec3> centers;
+	groupCenters(atoms, centers);
+
+	primitives.resize(centers.size());
+
+	for (size_t i = 0; i < centers.size(); i++)
+		primitives[i] = vec4(centers[i], uintBitsToFloat(m_primitiveAttributes[i]));
+}
+
+void LevelOfDetail::primitives(const std::vector<u16vec3>& positions, std::vector<u16vec3>& primitives) const
+{
+	std::vector<vec3> centers;
+	groupCenters(positions, centers);
+
+	primitives.resize(centers.size());
+
+	for (size_t i = 0; i < centers.size(); i++)
+		primitives[i] = u16vec3(clamp(round(centers[i]), vec3(0.0f), vec3(float(std::numeric_limits<uint16_t>::max()))));
+}
+
+const std::vector<uint>& LevelOfDetail::primitiveAttributes() const
+{
+	return m_primitiveAttributes;
+}
+
+const std::vector<uint>& LevelOfDetail::indices() const
+{
+	return m_indices;
+}
+
+void LevelOfDetail::select(const View& view, const std::vector<vec4>& bounds, const std::vector<mat4>& instanceTransforms, std::vector<Range>& ranges) const
+{
+	ranges.clear();
+
+	if (bounds.size() != m_segments.size())
+		return;
+
+	const bool perspective = (view.projectionMatrix[3][3] == 0.0f);
+	const float pixelsPerUnit = 0.5f * view.viewportHeight * abs(view.projectionMatrix[1][1]);
+	const uint instanceCount = std::max(uint(instanceTransforms.size()), 1u);
+
+	for (uint instance = 0; instance < instanceCount; instance++)
+	{
+		const mat4 modelViewMatrix = instanceTransforms.empty() ? view.modelViewMatrix : view.modelViewMatrix * instanceTransforms[instance];
+		const std::array<vec4, 6> planes = frustumPlanes(view.projectionMatrix * modelViewMatrix);
+
+		// radii are in Angstrom like the bounds, depths are in view space, which the model view matrix scales uniformly
+		const float viewScale = length(vec3(modelViewMatrix[0]));
+
+		// range of this copy that the next segment of each level can be appended to
+		std::array<size_t, levelCount> openRanges;
+		openRanges.fill(~size_t(0));
+
+		for (size_t s = 0; s < m_segments.size(); s++)
+		{
+			const Segment& segment = m_segments[s];
+			const vec3 center = vec3(bounds[s]);
+
+			if (view.culling)
+			{
+				const float cullingRadius = bounds[s].w * view.radiusScale + view.margin;
+				bool outside = false;
+
+				for (const auto& plane : planes)
+					outside = outside || (dot(vec3(plane), center) + plane.w < -cullingRadius);
+
+				if (outside)
+					continue;
+			}
+
+			uint level = 0;
+			const float depth = -(modelViewMatrix * vec4(center, 1.0f)).z;
+
+			// segments the camera is close to or inside of are always drawn with all atoms
+			if (!perspective || depth > bounds[s].w * viewScale)
+			{
+				const float scale = (perspective ? pixelsPerUnit / depth : pixelsPerUnit) * viewScale;
+
+				if (segment.radius * scale < view.pixelThreshold)
+					level = 2;
+				else if (segment.residueRadius * scale < view.pixelThreshold)
+					level = 1;
+			}
+
+			const Range& range = segment.ranges[level];
+			const size_t open = openRanges[level];
+
+			if (view.merging && open < ranges.size() && ranges[open].first + ranges[open].count == range.first)
+			{
+				ranges[open].count += range.count;
+			}
+			else
+			{
+				openRanges[level] = ranges.size();
+				ranges.push_back(range);
+				ranges.back().instance = instance;
+				ranges.back().segment = uint(s);
+				ranges.back().level = level;
+			}
+		}
+	}
+}
+
+uint LevelOfDetail::atomCount() const
+{
+	return m_atomCount;
+}
+
+uint LevelOfDetail::primitiveCount() const
+{
+	return uint(m_primitiveAttributes.size());
+}
+
+uint LevelOfDetail::segmentCount() const
+{
+	return uint(m_segments.size());
+}
+
+const std::vector<LevelOfDetail::Chunk>& LevelOfDetail::chunks() const
+{
+	return m_chunks;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+namespace dynamol
+{
+	// Coarse-grained levels of detail for very large structures
+	// Level 0 are the atoms, level 1 one Gaussian per residue and level 2 one Gaussian per chain segment
+	// Every group is drawn as a single sphere at the centroid of its atoms with a radius fitted to their extent, so far away parts
+	// go through the regular surface pipeline with far fewer primitives. The radius is stored in the upper 8 bits of the attributes,
+	// which are zero for atoms, as a code c with radius = c*c/256 that the shaders decode with atomRadius() in atom.glsl
+	// The chain segments are compact enough to double as the chunks for frustum culling, occlusion culling tests the smaller chunks of their ranges
+	class LevelOfDetail
+	{
+	public:
+		static const glm::uint levelCount = 3;
+
+		// Range of indices within indices() that makes up one draw of a copy of the biological assembly
+		struct Range
+		{
+			glm::uint first = 0;
+			glm::uint count = 0;
+			glm::uint instance = 0;
+
+			// chain segment and level of the range, the first segment if segments have been merged
+			glm::uint segment = 0;
+			glm::uint level = 0;
+		};
+
+		// Run of at most a few dozen consecutive indices within the range of a segment at one level, the unit of occlusion culling
+		struct Chunk
+		{
+			glm::uint first = 0;
+			glm::uint count = 0;
+			glm::uint segment = 0;
+			glm::uint level = 0;
+
+			// largest radius of an atom or primitive of the chunk
+			float radius = 0.0f;
+		};
+
+		// View that the levels are selected for
+		struct View
+		{
+			// may scale uniformly, as the model transform of the viewer does to fit the structure into the view
+			glm::mat4 modelViewMatrix = glm::mat4(1.0f);
+			glm::mat4 projectionMatrix = glm::mat4(1.0f);
+			float viewportHeight = 1.0f;
+
+			// levels are used if their groups are smaller than this on screen, zero always selects the atoms
+			float pixelThreshold = 0.0f;
+
+			// segments outside of the view frustum are skipped, their bounds are scaled by radiusScale and extended by margin
+			// to enclose the spheres of influence and any displacement in the shaders
+			bool culling = false;
+			float radiusScale = 1.0f;
+			float margin = 0.0f;
+
+			// adjacent segments are merged into one range, otherwise every range holds a single segment
+			bool merging = true;
+		};
+
+		// Groups the atoms in the order of the file, which is given by the atom order of the protein (empty if the atoms are in file order)
+		// Radii are looked up by the element index stored in the w component of the atoms
+		void build(const std::vector<glm::vec4>& atoms, const std::vector<glm::uint>& atomOrder, const std::vector<float>& elementRadii);
+
+		// Centers of the primitives of levels 1 and 2 for positions of the same atoms, e.g. another timestep
+		// Quantized positions are averaged directly, as they are linear within the bounds of their timestep
+		void primitives(const std::vector<glm::vec4>& atoms, std::vector<glm::vec4>& primitives) const;
+		void primitives(const std::vector<glm::u16vec3>& positions, std::vector<glm::u16vec3>& primitives) const;
+
+		// Bounding spheres of the segments for positions of the same atoms, enclosing the atoms as well as the primitives
+		void bounds(const std::vector<glm::vec4>& atoms, std::vector<glm::vec4>& bounds) const;
+		void bounds(const std::vector<glm::u16vec3>& positions, const glm::vec3& offset, const glm::vec3& extent, std::vector<glm::vec4>& bounds) const;
+
+		// Bounding spheres of the chunks for positions of the same atoms, enclosing their atoms or primitives
+		void chunkBounds(const std::vector<glm::vec4>& atoms, std::vector<glm::vec4>& bounds) const;
+		void chunkBounds(const std::vector<glm::u16vec3>& positions, const glm::vec3& offset, const glm::vec3& extent, std::vector<glm::vec4>& bounds) const;
+
+		// Attributes of the primitives of levels 1 and 2, for quantized positions that store them separately
+		const std::vector<glm::uint>& primitiveAttributes() const;
+
+		// Vertex indices of all levels, primitives follow the atoms with their vertices starting at atomCount()
+		const std::vector<glm::uint>& indices() const;
+
+		// Selects a level for each chain segment and copy of the assembly by the size its groups would have on screen
+		// and skips the copies of segments outside of the view frustum, the bounds are those of the current timestep
+		// Adjacent segments of the same copy with the same level are merged into one range unless merging is disabled
+		void select(const View& view, const std::vector<glm::vec4>& bounds, const std::vector<glm::mat4>& instanceTransforms, std::vector<Range>& ranges) const;
+
+		glm::uint atomCount() const;
+		glm::uint primitiveCount() const;
+		glm::uint segmentCount() const;
+
+		// Chunks of the ranges of all segments and levels, in the order of the segments
+		const std::vector<Chunk>& chunks() const;
+
+	private:
+		// Residues are ranges of atoms in file order, segments are ranges of residues
+		struct Group
+		{
+			glm::uint first = 0;
+			glm::uint count = 0;
+		};
+
+		struct Segment
+		{
+			Group residues;
+
+			// bounding radius of the segment and largest bounding radius of its residues, taken from the atoms the levels were built from
+			float radius = 0.0f;
+			float residueRadius = 0.0f;
+
+			// largest radius of an atom or primitive of the segment
+			float maximumRadius = 0.0f;
+
+			// indices of the segment for each level
+			std::array<Range, levelCount> ranges;
+		};
+
+		template <typename Position> void groupCenters(const std::vector<Position>& positions, std::vector<glm::vec3>& centers) const;
+		template <typename Position> void groupBounds(const std::vector<Position>& positions, const glm::vec3& offset, const glm::vec3& scale, const std::vector<Group>& groups, std::vector<glm::vec4>& bounds) const;
+
+		glm::uint m_atomCount = 0;
+
+		std::vector<Group> m_residues;
+		std::vector<Segment> m_segments;
+		std::vector<Chunk> m_chunks;
+
+		// atoms of each segment and chunk in file order, their primitives lie within the convex hull of these atoms
+		std::vector<Group> m_segmentAtoms;
+		std::vector<Group> m_chunkAtoms;
+
+		std::vector<glm::uint> m_primitiveAttributes;
+
+		// atoms in file order, followed by the primitives of the residues and the segments
+		std::vector<glm::uint> m_indices;
+	};
+}
@@ -0,0 +1,230 @@
+#include "LoaderCheck.h"
+#include "Protein.h"
+#include "Trajectory.h"
+
+#include <fstream>
+#include <filesystem>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	const std::string atomLines =
+		"ATOM      1  N   PRO A  26     310.667 269.533 214.714  1.00 60.00           N  \n"
+		"ATOM      2  CA  PRO A  26     309.939 268.752 213.709  1.00 60.00           C  \n";
+
+	const std::string atomRecords = atomLines + "END\n";
+
+	std::string temporaryFilename(const std::string& name)
+	{
+		return (std::filesystem::temp_directory_path() / ("dynamol-check-" + name)).string();
+	}
+
+	// Writes a file and removes a cache left over from an earlier run
+	std::string writeFile(const std::string& name, const std::string& content)
+	{
+		const std::string filename = temporaryFilename(name);
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		file << content;
+		file.close();
+
+		std::error_code error;
+		std::filesystem::remove(Protein::cacheFilename(filename), error);
+
+		return filename;
+	}
+
+	void removeFile(const std::string& filename)
+	{
+		std::error_code error;
+		std::filesystem::remove(filename, error);
+		std::filesystem::remove(Protein::cacheFilename(filename), error);
+	}
+
+	size_t atomCount(const Protein& protein)
+	{
+		return protein.atoms().empty() ? 0 : protein.atoms().front().size();
+	}
+
+	// Names of the chains the atoms of the first timestep belong to
+	std::multiset<std::string> atomChainNames(const Protein& protein)
+	{
+		std::multiset<std::string> names;
+
+		if (protein.atoms().empty())
+			return names;
+
+		const auto& chainIds = protein.activeChainIds();
+
+		for (const auto& atom : protein.atoms().front())
+		{
+			const uint chainIndex = (floatBitsToUint(atom.w) >> 16) & 0xff;
+			names.insert(chainIndex < chainIds.size() ? protein.chainName(chainIds[chainIndex]) : "?");
+		}
+
+		return names;
+	}
+}
+
+bool LoaderCheck::run()
+{
+	bool passed = checkEmptyStructure();
+	passed = checkChainIdentifiers() && passed;
+	passed = checkTimesteps() && passed;
+
+	if (passed)
+		globjects::debug() << "All loader checks passed";
+
+	return passed;
+}
+
+bool LoaderCheck::checkEmptyStructure()
+{
+	const std::string emptyFilename = writeFile("empty.pdb", "REMARK   1 NO ATOMS\nEND\n");
+
+	Protein empty;
+	empty.load(emptyFilename);
+
+	const bool emptyCached = std::filesystem::exists(Protein::cacheFilename(emptyFilename));
+	removeFile(emptyFilename);
+
+	if (atomCount(empty) != 0 || emptyCached)
+	{
+		globjects::critical() << "A structure without atoms was loaded with " << atomCount(empty) << " atoms" << (emptyCached ? " and cached!" : "!");
+		return false;
+	}
+
+	// a cache whose header claims no elements has to be ignored instead of being decoded
+	const std::string filename = writeFile("elements.pdb", atomRecords);
+
+	Protein protein;
+	protein.load(filename);
+
+	const std::string cacheName = Protein::cacheFilename(filename);
+	std::fstream cache(cacheName, std::ios::binary | std::ios::in | std::ios::out);
+
+	if (atomCount(protein) != 2 || !cache.is_open())
+	{
+		globjects::critical() << "A structure with two atoms was loaded with " << atomCount(protein) << " atoms" << (cache.is_open() ? "!" : " and not cached!");
+		removeFile(filename);
+		return false;
+	}
+
+	// offset of the element count in the header of the cache file, after the magic, version, timestep count and source stamp
+	const uint32_t elementCount = 0;
+	cache.seekp(40);
+	cache.write(reinterpret_cast<const char*>(&elementCount), sizeof(elementCount));
+	cache.close();
+
+	Protein reloaded;
+	reloaded.load(filename);
+	removeFile(filename);
+
+	if (atomCount(reloaded) != 2 || reloaded.activeElementRadii().empty())
+	{
+		globjects::critical() << "A cache without elements was loaded with " << atomCount(reloaded) << " atoms and " << reloaded.activeElementRadii().size() << " elements!";
+		return false;
+	}
+
+	globjects::debug() << "Empty structures and caches without elements are loaded correctly";
+	return true;
+}
+
+bool LoaderCheck::checkChainIdentifiers()
+{
+	// more chains than the single character identifiers can name, with one atom per chain
+	std::multiset<std::string> chainNames = { "A" };
+
+	for (char first = 'A'; first <= 'G'; first++)
+	{
+		for (char second = '0'; second <= '9'; second++)
+			chainNames.insert(std::string{ first, second });
+	}
+
+	std::ostringstream content;
+	content << "data_check\nloop_\n_atom_site.group_PDB\n_atom_site.id\n_atom_site.type_symbol\n_atom_site.label_comp_id\n_atom_site.auth_asym_id\n";
+	content << "_atom_site.Cartn_x\n_atom_site.Cartn_y\n_atom_site.Cartn_z\n_atom_site.pdbx_PDB_model_num\n";
+
+	uint id = 1;
+
+	for (const auto& name : chainNames)
+	{
+		content << "ATOM " << id << " C ALA " << name << " " << float(id) << " 0.0 0.0 1\n";
+		id++;
+	}
+
+	content << "#\n";
+
+	const std::string filename = writeFile("chains.cif", content.str());
+
+	Protein protein;
+	protein.load(filename);
+
+	Protein cached;
+	cached.load(filename);
+	removeFile(filename);
+
+	// every chain is active once, in addition to the unknown chain
+	for (const Protein* loaded : { &protein, &cached })
+	{
+		const auto names = atomChainNames(*loaded);
+
+		if (names != chainNames || loaded->activeChainIds().size() != chainNames.size() + 1)
+		{
+			globjects::critical() << "A structure with " << uint(chainNames.size()) << " chains was loaded " << (loaded == &cached ? "from the cache " : "") << "with " << uint(loaded->activeChainIds().size() - 1) << " chains!";
+			return false;
+		}
+	}
+
+	globjects::debug() << "Multi-character chain identifiers are loaded correctly";
+	return true;
+}
+
+bool LoaderCheck::checkTimesteps()
+{
+	const std::string ensemble = "MODEL        1\n" + atomLines + "ENDMDL\nMODEL        2\n" + atomLines + "ENDMDL\nMODEL        3\n" + atomLines + "ENDMDL\nEND\n";
+
+	// the last frame of a file without MODEL records does not need an END record
+	const std::string frames = atomRecords + atomRecords + atomLines;
+
+	for (const auto& content : { ensemble, frames })
+	{
+		const std::string filename = writeFile("timesteps.pdb", content);
+
+		Protein protein;
+		protein.load(filename);
+
+		// the trajectory indexes the frames in the background, so wait for it to find all of them
+		std::unique_ptr<Trajectory> trajectory = Trajectory::open(filename);
+		std::vector<vec3> positions;
+
+		for (uint i = 0; i < 100 && trajectory && trajectory->frameCount() < 3; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		const bool streamed = trajectory && trajectory->frameCount() == 3 && trajectory->atomCount() == 2 && trajectory->readFrame(2, positions) && positions.size() == 2;
+		trajectory.reset();
+		removeFile(filename);
+
+		const uint expectedAtomCount = 2;
+		bool loaded = (protein.timestepCount() == 3);
+
+		for (const auto& atoms : protein.atoms())
+			loaded = loaded && atoms.size() == expectedAtomCount;
+
+		if (!loaded || !streamed)
+		{
+			globjects::critical() << "A PDB file with three frames of two atoms was " << (loaded ? "streamed" : "loaded") << " with different frames!";
+			return false;
+		}
+	}
+
+	globjects::debug() << "Models and frames of PDB files are split into timesteps correctly";
+	return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+
+namespace dynamol
+{
+	// Loads small structures written to the temporary directory and compares the result with what the files describe
+	// The checks need no OpenGL context and are run with the --check option together with the spatial checks
+	class LoaderCheck
+	{
+	public:
+		// Runs all checks, returns false if any structure is not loaded as expected
+		static bool run();
+
+		// Files without atoms and caches without elements or timesteps are loaded as empty structures or parsed from the source
+		static bool checkEmptyStructure();
+
+		// Multi-character chain identifiers of mmCIF files get their own chains, also when the structure is read from the cache
+		static bool checkChainIdentifiers();
+
+		// Models of NMR ensembles and frames separated by END records become timesteps, also when streamed as a trajectory
+		static bool checkTimesteps();
+	};
+}
@@ -0,0 +1,105 @@
+#include "MortonOrder.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
+
+using namespace dynamol;
+using namespace glm;
+
+void MortonOrder::sort(const std::vector<vec4>& points, std::vector<uint>& codes, std::vector<uint>& order)
+{
+	const size_t count = points.size();
+	const uint threads = parallelThreadCount(count, atomsPerThread);
+
+	vec3 minimum = vec3(std::numeric_limits<float>::max());
+	vec3 maximum = vec3(-std::numeric_limits<float>::max());
+
+	for (const auto& point : points)
+	{
+		minimum = min(minimum, vec3(point));
+		maximum = max(maximum, vec3(point));
+	}
+
+	const vec3 scale = vec3(1023.0f) / max(maximum - minimum, vec3(std::numeric_limits<float>::min()));
+	codes.resize(count);
+	order.resize(count);
+
+	runParallel(threads, [&](uint thread) {
+		for (size_t i = rangeBegin(count, thread, threads); i < rangeBegin(count, thread + 1, threads); i++)
+		{
+			codes[i] = code(uvec3(clamp((vec3(points[i]) - minimum) * scale, vec3(0.0f), vec3(1023.0f))));
+			order[i] = uint(i);
+		}
+	});
+
+	radixSort(codes, order);
+}
+
+uint MortonOrder::code(const uvec3& coordinates)
+{
+	uint code = 0;
+
+	for (uint axis = 0; axis < 3; axis++)
+	{
+		uint bits = coordinates[axis] & 0x3ff;
+		bits = (bits | (bits << 16)) & 0x030000ff;
+		bits = (bits | (bits << 8)) & 0x0300f00f;
+		bits = (bits | (bits << 4)) & 0x030c30c3;
+		bits = (bits | (bits << 2)) & 0x09249249;
+		code |= bits << (2 - axis);
+	}
+
+	return code;
+}
+
+// Least significant digit radix sort with 8 bits per pass
+// Each thread counts the digits of a contiguous range, the prefix sum over digits and threads then lets all ranges scatter in parallel
+void MortonOrder::radixSort(std::vector<uint>& keys, std::vector<uint>& values)
+{
+	const size_t count = keys.size();
+	const uint threads = parallelThreadCount(count, atomsPerThread);
+
+	std::vector<uint> sortedKeys(count);
+	std::vector<uint> sortedValues(count);
+	std::vector< std::array<size_t, 256> > offsets(threads);
+
+	for (uint shift = 0; shift < 30; shift += 8)
+	{
+		runParallel(threads, [&](uint thread) {
+			auto& histogram = offsets[thread];
+			histogram.fill(0);
+
+			for (size_t i = rangeBegin(count, thread, threads); i < rangeBegin(count, thread + 1, threads); i++)
+				histogram[(keys[i] >> shift) & 0xff]++;
+		});
+
+		// ranges of lower threads come first within each digit, which keeps the sort stable
+		size_t offset = 0;
+
+		for (uint digit = 0; digit < 256; digit++)
+		{
+			for (auto& histogram : offsets)
+			{
+				const size_t digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+		}
+
+		runParallel(threads, [&](uint thread) {
+			auto& destinations = offsets[thread];
+
+			for (size_t i = rangeBegin(count, thread, threads); i < rangeBegin(count, thread + 1, threads); i++)
+			{
+				const size_t destination = destinations[(keys[i] >> shift) & 0xff]++;
+				sortedKeys[destination] = keys[i];
+				sortedValues[destination] = values[i];
+			}
+		});
+
+		keys.swap(sortedKeys);
+		values.swap(sortedValues);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Order of points along a Morton (Z-order) curve through their bounding box, so points close in space end up close in the order
+	// Codes have 10 bits per axis and are sorted with a parallel radix sort
+	class MortonOrder
+	{
+	public:
+		// Sorts the points by their Morton codes, order receives the index of each point in the sorted sequence and codes the sorted codes
+		// Points with equal codes keep their relative order, the w component of the points is ignored
+		static void sort(const std::vector<glm::vec4>& points, std::vector<glm::uint>& codes, std::vector<glm::uint>& order);
+
+		// Interleaves the bits of three 10 bit coordinates into a 30 bit Morton code
+		static glm::uint code(const glm::uvec3& coordinates);
+
+		// Stable radix sort of 30 bit keys together with their values
+		static void radixSort(std::vector<glm::uint>& keys, std::vector<glm::uint>& values);
+	};
+}
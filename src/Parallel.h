@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <algorithm>
+#include <cstddef>
+
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Atoms per thread below which no additional threads are started
+	const size_t atomsPerThread = 16384;
+
+	// Runs task(i) for every i in [0, count), one thread per index with the calling thread taking the first one
+	template <typename Task> void runParallel(glm::uint count, const Task& task)
+	{
+		std::vector<std::thread> threads;
+
+		for (glm::uint i = 1; i < count; i++)
+			threads.emplace_back(task, i);
+
+		if (count > 0)
+			task(0);
+
+		for (auto& t : threads)
+			t.join();
+	}
+
+	// Number of threads for count items, at most one per hardware thread and none with fewer than itemsPerThread items
+	inline glm::uint parallelThreadCount(size_t count, size_t itemsPerThread = 1)
+	{
+		return glm::uint(std::max(size_t(1), std::min(size_t(std::thread::hardware_concurrency()), count / itemsPerThread)));
+	}
+
+	// Beginning of the range of a thread when count items are split evenly among all threads
+	inline size_t rangeBegin(size_t count, glm::uint thread, glm::uint threadCount)
+	{
+		return count * thread / threadCount;
+	}
+}
@@ -0,0 +1,182 @@
+#include "PdbTrajectory.h"
+#include "Protein.h"
+
+#include <algorithm>
+#include <chrono>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// The index is built from blocks of this size, new frames become available after each block
+	const size_t indexBlockSize = size_t(4) << 20;
+}
+
+PdbTrajectory::PdbTrajectory(const std::string& filename) : Trajectory(filename)
+{
+}
+
+PdbTrajectory::~PdbTrajectory()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+uint PdbTrajectory::frameCount() const
+{
+	return m_indexedFrameCount;
+}
+
+bool PdbTrajectory::readHeader()
+{
+	m_file.open(m_filename, std::ios::binary);
+
+	if (!m_file.is_open())
+		return false;
+
+	m_thread = std::thread(&PdbTrajectory::index, this);
+
+	// the first frame defines the number of atoms, everything else is indexed in the background
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_condition.wait(lock, [this]() { return !m_frameEnds.empty() || m_indexed; });
+
+		if (m_frameEnds.empty())
+		{
+			globjects::critical() << "No atoms found in " << m_filename << "!";
+			return false;
+		}
+	}
+
+	std::vector<vec3> positions;
+
+	if (!readFrame(0, positions) || positions.empty())
+		return false;
+
+	m_atomCount = uint(positions.size());
+	return true;
+}
+
+bool PdbTrajectory::readFrame(uint frame, std::vector<vec3>& positions)
+{
+	uint64_t begin = 0;
+	uint64_t end = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (frame >= m_frameEnds.size())
+			return false;
+
+		begin = (frame > 0) ? m_frameEnds[frame - 1] : 0;
+		end = m_frameEnds[frame];
+	}
+
+	m_buffer.resize(size_t(end - begin));
+	m_file.clear();
+	m_file.seekg(std::streamoff(begin));
+	m_file.read(m_buffer.data(), std::streamsize(m_buffer.size()));
+
+	if (size_t(m_file.gcount()) != m_buffer.size())
+		return false;
+
+	Protein::parsePdbPositions(m_buffer.data(), m_buffer.data() + m_buffer.size(), positions);
+
+	// the frame could not be used with the topology of the first one
+	if (m_atomCount > 0 && positions.size() != m_atomCount)
+	{
+		globjects::warning() << "Frame " << frame << " of " << m_filename << " has " << uint(positions.size()) << " atoms instead of " << m_atomCount << "!";
+		return false;
+	}
+
+	return true;
+}
+
+// Scans the file for frame boundaries on a background thread, publishing the frames found after every block
+void PdbTrajectory::index()
+{
+	const auto startTime = std::chrono::steady_clock::now();
+
+	std::ifstream file(m_filename, std::ios::binary);
+	std::vector<char> buffer;
+	std::vector<uint64_t> frameEnds;
+	size_t carry = 0;
+	uint64_t bufferOffset = 0;
+
+	// boundaries directly following each other do not end a frame, like in Protein::load()
+	bool frameHasAtoms = false;
+
+	while (file.good())
+	{
+		buffer.resize(carry + indexBlockSize);
+		file.read(buffer.data() + carry, std::streamsize(indexBlockSize));
+
+		const char* bufferEnd = buffer.data() + carry + size_t(file.gcount());
+		const char* lineBegin = buffer.data();
+
+		while (lineBegin < bufferEnd)
+		{
+			const char* lineEnd = std::find(lineBegin, bufferEnd, '\n');
+
+			// the incomplete last line is carried over into the next block
+			if (lineEnd == bufferEnd && file.good())
+				break;
+
+			const char* nextLine = std::min(lineEnd + 1, bufferEnd);
+
+			if (Protein::isPdbAtomRecord(lineBegin, lineEnd))
+			{
+				frameHasAtoms = true;
+			}
+			else if (frameHasAtoms && Protein::isPdbFrameBoundary(lineBegin, lineEnd))
+			{
+				frameEnds.push_back(bufferOffset + uint64_t(nextLine - buffer.data()));
+				frameHasAtoms = false;
+			}
+
+			lineBegin = nextLine;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+
+			if (m_stop)
+				return;
+
+			if (!frameEnds.empty())
+			{
+				m_frameEnds.insert(m_frameEnds.end(), frameEnds.begin(), frameEnds.end());
+				m_indexedFrameCount = uint(m_frameEnds.size());
+				frameEnds.clear();
+				m_condition.notify_all();
+			}
+		}
+
+		carry = size_t(bufferEnd - lineBegin);
+		bufferOffset += uint64_t(lineBegin - buffer.data());
+		std::copy(lineBegin, bufferEnd, buffer.data());
+	}
+
+	const double indexTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	// the last frame ends with the file
+	if (frameHasAtoms)
+	{
+		m_frameEnds.push_back(bufferOffset + uint64_t(carry));
+		m_indexedFrameCount = uint(m_frameEnds.size());
+	}
+
+	m_indexed = true;
+	m_condition.notify_all();
+
+	globjects::debug() << "Indexed " << uint(m_frameEnds.size()) << " frames of " << m_filename << " in " << indexTime << " s";
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <fstream>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace dynamol
+{
+	// Timesteps of a multi-model PDB file, split at MODEL, ENDMDL and END records like in Protein::load()
+	// A background thread indexes the byte offsets at which the frames end, so any indexed frame is read with a single seek
+	// Opening only waits for the first frame, the frame count grows while the rest of the file is being indexed
+	class PdbTrajectory : public Trajectory
+	{
+	public:
+		PdbTrajectory(const std::string& filename);
+		~PdbTrajectory();
+
+		virtual glm::uint frameCount() const override;
+		virtual bool readFrame(glm::uint frame, std::vector<glm::vec3>& positions) override;
+
+	protected:
+		virtual bool readHeader() override;
+
+	private:
+		void index();
+
+		std::ifstream m_file;
+		std::vector<char> m_buffer;
+
+		// offset behind the last line of each frame, a frame starts where the previous one ends
+		std::vector<uint64_t> m_frameEnds;
+		std::atomic<glm::uint> m_indexedFrameCount = { 0 };
+		bool m_indexed = false;
+		bool m_stop = false;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,313 @@
+#include "Profiler.h"
+
+#include <array>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#include <globjects/globjects.h>
+
+using namespace dynamol;
+
+std::atomic<bool> Profiler::s_enabled{ false };
+
+namespace
+{
+	struct Event
+	{
+		const char* name = nullptr;
+		std::int64_t start = 0;
+		std::int64_t end = 0;
+	};
+
+	// about 25 MB of zones per thread and capture
+	const size_t blockSize = 4096;
+	const size_t maximumBlockCount = 256;
+
+	// The owning thread writes an event before publishing the new count, readers only look at the events below the count
+	struct Block
+	{
+		std::array<Event, blockSize> events;
+		std::atomic<size_t> count{ 0 };
+		std::atomic<Block*> next{ nullptr };
+	};
+
+	// Blocks are kept from one capture to the next and reset by the owning thread once it notices a new capture
+	// Buffers of threads that have exited are handed to new threads, so short-lived worker threads do not accumulate buffers
+	struct ThreadBuffer
+	{
+		~ThreadBuffer()
+		{
+			Block* block = first.next.load();
+
+			while (block)
+			{
+				Block* next = block->next.load();
+				delete block;
+				block = next;
+			}
+		}
+
+		size_t id = 0;
+		std::string name;
+		bool active = false;
+
+		Block first;
+		Block* last = &first;
+		size_t blockCount = 1;
+
+		std::atomic<std::uint64_t> capture{ 0 };
+		std::atomic<size_t> droppedCount{ 0 };
+	};
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector< std::unique_ptr<ThreadBuffer> > buffers;
+		std::atomic<std::uint64_t> capture{ 0 };
+		std::atomic<std::int64_t> captureStart{ 0 };
+	};
+
+	// never destroyed, threads may still record while static objects are destroyed at exit
+	Registry& registry()
+	{
+		static Registry* registry = new Registry();
+		return *registry;
+	}
+
+	thread_local const char* threadName = nullptr;
+
+	// Returns the buffer to the registry when its thread exits
+	struct ThreadBufferHandle
+	{
+		~ThreadBufferHandle()
+		{
+			if (buffer)
+			{
+				std::lock_guard<std::mutex> lock(registry().mutex);
+				buffer->active = false;
+			}
+		}
+
+		ThreadBuffer* buffer = nullptr;
+	};
+
+	thread_local ThreadBufferHandle threadHandle;
+
+	ThreadBuffer& threadBuffer()
+	{
+		ThreadBufferHandle& handle = threadHandle;
+
+		if (!handle.buffer)
+		{
+			Registry& r = registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+
+			for (auto& buffer : r.buffers)
+			{
+				if (!buffer->active)
+				{
+					handle.buffer = buffer.get();
+					break;
+				}
+			}
+
+			if (!handle.buffer)
+			{
+				r.buffers.push_back(std::make_unique<ThreadBuffer>());
+				handle.buffer = r.buffers.back().get();
+				handle.buffer->id = r.buffers.size();
+			}
+
+			handle.buffer->active = true;
+			handle.buffer->name = threadName ? threadName : "Thread " + std::to_string(handle.buffer->id);
+		}
+
+		return *handle.buffer;
+	}
+
+	std::string escapeJson(const char* string)
+	{
+		std::string escaped;
+
+		for (const char* c = string; *c; c++)
+		{
+			if (*c == '"' || *c == '\\')
+				escaped += '\\';
+
+			escaped += *c;
+		}
+
+		return escaped;
+	}
+}
+
+void Profiler::setEnabled(bool enabled)
+{
+	Registry& r = registry();
+
+	if (enabled && !s_enabled.load())
+	{
+		r.captureStart.store(now());
+		r.capture.fetch_add(1);
+	}
+
+	s_enabled.store(enabled);
+}
+
+void Profiler::setThreadName(const char* name)
+{
+	threadName = name;
+
+	if (threadHandle.buffer)
+	{
+		std::lock_guard<std::mutex> lock(registry().mutex);
+		threadHandle.buffer->name = name;
+	}
+}
+
+size_t Profiler::zoneCount()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	const std::uint64_t capture = r.capture.load(std::memory_order_acquire);
+	size_t count = 0;
+
+	for (auto& buffer : r.buffers)
+	{
+		if (buffer->capture.load(std::memory_order_acquire) != capture)
+			continue;
+
+		for (Block* block = &buffer->first; block; block = block->next.load(std::memory_order_acquire))
+		{
+			const size_t blockCount = block->count.load(std::memory_order_acquire);
+			count += blockCount;
+
+			if (blockCount < blockSize)
+				break;
+		}
+	}
+
+	return count;
+}
+
+size_t Profiler::droppedZoneCount()
+{
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	const std::uint64_t capture = r.capture.load(std::memory_order_acquire);
+	size_t count = 0;
+
+	for (auto& buffer : r.buffers)
+	{
+		if (buffer->capture.load(std::memory_order_acquire) == capture)
+			count += buffer->droppedCount.load(std::memory_order_relaxed);
+	}
+
+	return count;
+}
+
+bool Profiler::saveTrace(const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::trunc);
+
+	if (!file.good())
+	{
+		globjects::warning() << "Could not write CPU trace " << filename;
+		return false;
+	}
+
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+
+	const std::uint64_t capture = r.capture.load(std::memory_order_acquire);
+	const std::int64_t captureStart = r.captureStart.load();
+
+	// complete events in microseconds relative to the start of the capture, one track per thread
+	file << std::fixed << std::setprecision(3);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << std::endl;
+	file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"dynamol\"}}";
+
+	for (auto& buffer : r.buffers)
+	{
+		if (buffer->capture.load(std::memory_order_acquire) != capture)
+			continue;
+
+		file << "," << std::endl;
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"" << escapeJson(buffer->name.c_str()) << "\"}}";
+
+		for (Block* block = &buffer->first; block; block = block->next.load(std::memory_order_acquire))
+		{
+			const size_t blockCount = block->count.load(std::memory_order_acquire);
+
+			for (size_t i = 0; i < blockCount; i++)
+			{
+				const Event& event = block->events[i];
+
+				file << "," << std::endl;
+				file << "{\"name\":\"" << escapeJson(event.name) << "\",\"cat\":\"cpu\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->id << ",";
+				file << "\"ts\":" << double(event.start - captureStart) * 1.0e-3 << ",\"dur\":" << double(event.end - event.start) * 1.0e-3 << "}";
+			}
+
+			if (blockCount < blockSize)
+				break;
+		}
+	}
+
+	file << std::endl << "]}" << std::endl;
+	return file.good();
+}
+
+std::int64_t Profiler::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::record(const char* name, std::int64_t start, std::int64_t end)
+{
+	ThreadBuffer& buffer = threadBuffer();
+	const std::uint64_t capture = registry().capture.load(std::memory_order_acquire);
+
+	// readers skip the buffer until it has been reset for the new capture
+	if (buffer.capture.load(std::memory_order_relaxed) != capture)
+	{
+		for (Block* block = &buffer.first; block; block = block->next.load(std::memory_order_relaxed))
+			block->count.store(0, std::memory_order_relaxed);
+
+		buffer.last = &buffer.first;
+		buffer.droppedCount.store(0, std::memory_order_relaxed);
+		buffer.capture.store(capture, std::memory_order_release);
+	}
+
+	Block* block = buffer.last;
+	size_t count = block->count.load(std::memory_order_relaxed);
+
+	if (count == blockSize)
+	{
+		Block* next = block->next.load(std::memory_order_relaxed);
+
+		if (!next)
+		{
+			if (buffer.blockCount >= maximumBlockCount)
+			{
+				buffer.droppedCount.fetch_add(1, std::memory_order_relaxed);
+				return;
+			}
+
+			next = new Block();
+			block->next.store(next, std::memory_order_release);
+			buffer.blockCount++;
+		}
+
+		buffer.last = block = next;
+		count = 0;
+	}
+
+	block->events[count] = Event{ name, start, end };
+	block->count.store(count + 1, std::memory_order_release);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <cstdint>
+
+namespace dynamol
+{
+	// Profiler for zones of code on the CPU, whose captures are written in the Chrome trace event format
+	// Every thread appends the zones it completes to a buffer of its own that is only ever appended to, so recording takes no locks
+	// and only allocates when a block of the buffer is full. While the profiler is off, a zone costs a single relaxed load
+	// Zone names are not copied and have to be string literals
+	class Profiler
+	{
+	public:
+		// Records the time from its construction to its destruction if the profiler was on when it was constructed
+		class Zone
+		{
+		public:
+			Zone(const char* name) : m_name(name), m_start(Profiler::isEnabled() ? Profiler::now() : -1)
+			{
+			}
+
+			~Zone()
+			{
+				if (m_start >= 0)
+					Profiler::record(m_name, m_start, Profiler::now());
+			}
+
+			Zone(const Zone&) = delete;
+			Zone& operator=(const Zone&) = delete;
+
+		private:
+			const char* m_name;
+			std::int64_t m_start;
+		};
+
+		// Turning the profiler on starts a new capture and discards the zones of the previous one
+		static void setEnabled(bool enabled);
+
+		static bool isEnabled()
+		{
+			return s_enabled.load(std::memory_order_relaxed);
+		}
+
+		// Name of the calling thread in the trace
+		static void setThreadName(const char* name);
+
+		// Zones recorded in the current capture, and the ones dropped because the buffer of their thread was full
+		static size_t zoneCount();
+		static size_t droppedZoneCount();
+
+		// Zones that are completed while the trace is written may be missing from it
+		static bool saveTrace(const std::string& filename);
+
+		// Nanoseconds on a steady clock
+		static std::int64_t now();
+		static void record(const char* name, std::int64_t start, std::int64_t end);
+
+	private:
+		static std::atomic<bool> s_enabled;
+	};
+}
+
+#define DYNAMOL_PROFILE_CONCATENATE_INNER(a, b) a##b
+#define DYNAMOL_PROFILE_CONCATENATE(a, b) DYNAMOL_PROFILE_CONCATENATE_INNER(a, b)
+
+// Profiles the rest of the enclosing scope as a zone with the given name
+#define PROFILE_ZONE(name) dynamol::Profiler::Zone DYNAMOL_PROFILE_CONCATENATE(profileZone, __LINE__)(name)
@@ -1,17 +1,26 @@
 #include "Protein.h"
+#include "BinaryCif.h"
+#include "DecompressingStreamBuffer.h"
+#include "MortonOrder.h"
+#include "Parallel.h"
+#include "Profiler.h"
 
 #include <fstream>
 #include <string>
-#include <sstream>
 #include <cstdlib>
-#include <iterator>
 #include <iostream>
 #include <limits>
 #include <unordered_map>
 #include <array>
 #include <algorithm> 
+#include <string_view>
+#include <cstdint>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
 #include <cctype>
-#include <locale>
+#include <memory>
 #include <globjects/globjects.h>
 #include <globjects/logging.h>
 
@@ -21,204 +30,2259 @@
 using namespace dynamol;
 using namespace glm;
 
-// trim from start (in place)
-static inline void ltrim(std::string &s)
+namespace
 {
-	s.erase(s.begin(), std::find_if(s.begin(), s.end(), [](int ch) {
-		return !std::isspace(ch);
-	}));
+	// Name and id of an element, residue or chain code
+	struct Code
+	{
+		const char* name;
+		uint id;
+	};
+
+	// Element symbols as they appear in columns 77-78 of ATOM/HETATM records
+	constexpr Code elementCodes[] = {
+		{"H", 1},
+		{"He", 2},
+		{"Li", 3},
+		{"Be", 4},
+		{"B", 5},
+		{"C", 6},
+		{"N", 7},
+		{"O", 8},
+		{"F", 9},
+		{"Ne", 10},
+		{"Na", 11},
+		{"Mg", 12},
+		{"Al", 13},
+		{"Si", 14},
+		{"P", 15},
+		{"S", 16},
+		{"Cl", 17},
+		{"Ar", 18},
+		{"K", 19},
+		{"Ca", 20},
+		{"Sc", 21},
+		{"Ti", 22},
+		{"V", 23},
+		{"Cr", 24},
+		{"Mn", 25},
+		{"Fe", 26},
+		{"Co", 27},
+		{"Ni", 28},
+		{"Cu", 29},
+		{"Zn", 30},
+		{"Ga", 31},
+		{"Ge", 32},
+		{"As", 33},
+		{"Se", 34},
+		{"Br", 35},
+		{"Kr", 36},
+		{"Rb", 37},
+		{"Sr", 38},
+		{"Y", 39},
+		{"Zr", 40},
+		{"Nb", 41},
+		{"Mo", 42},
+		{"Tc", 43},
+		{"Ru", 44},
+		{"Rh", 45},
+		{"Pd", 46},
+		{"Ag", 47},
+		{"Cd", 48},
+		{"In", 49},
+		{"Sn", 50},
+		{"Sb", 51},
+		{"Te", 52},
+		{"I", 53},
+		{"Xe", 54},
+		{"Cs", 55},
+		{"Ba", 56},
+		{"La", 57},
+		{"Ce", 58},
+		{"Pr", 59},
+		{"Nd", 60},
+		{"Pm", 61},
+		{"Sm", 62},
+		{"Eu", 63},
+		{"Gd", 64},
+		{"Tb", 65},
+		{"Dy", 66},
+		{"Ho", 67},
+		{"Er", 68},
+		{"Tm", 69},
+		{"Yb", 70},
+		{"Lu", 71},
+		{"Hf", 72},
+		{"Ta", 73},
+		{"W", 74},
+		{"Re", 75},
+		{"Os", 76},
+		{"Ir", 77},
+		{"Pt", 78},
+		{"Au", 79},
+		{"Hg", 80},
+		{"Tl", 81},
+		{"Pb", 82},
+		{"Bi", 83},
+		{"Po", 84},
+		{"At", 85},
+		{"Rn", 86},
+		{"Fr", 87},
+		{"Ra", 88},
+		{"Ac", 89},
+		{"Th", 90},
+		{"Pa", 91},
+		{"U", 92},
+		{"Np", 93},
+		{"Pu", 94},
+		{"Am", 95},
+		{"Cm", 96},
+		{"Bk", 97},
+		{"Cf", 98},
+		{"Es", 99},
+		{"Fm", 100},
+		{"Md", 101},
+		{"No", 102},
+		{"Lr", 103},
+		{"Rf", 104},
+		{"Db", 105},
+		{"Sg", 106},
+		{"Bh", 107},
+		{"Hs", 108},
+		{"Mt", 109},
+		{"Ds", 110},
+		{"Rg", 111},
+		{"Cn", 112},
+		{"H (WAT)", 113},
+		{"O (WAT)", 114},
+		{"D", 115}
+	};
+
+	// Residue names as they appear in columns 18-20
+	constexpr Code residueCodes[] = {
+		{"ALA", 1},
+		{"ARG", 2},
+		{"ASN", 3},
+		{"ASP", 4},
+		{"CYS", 5},
+		{"GLN", 6},
+		{"GLU", 7},
+		{"GLY", 8},
+		{"HIS", 9},
+		{"ILE", 10},
+		{"LEU", 11},
+		{"LYS", 12},
+		{"MET", 13},
+		{"PHE", 14},
+		{"PRO", 15},
+		{"SER", 16},
+		{"THR", 17},
+		{"TRP", 18},
+		{"TYR", 19},
+		{"VAL", 20},
+		{"ASX", 21},
+		{"GLX", 22},
+		{"other", 23}
+	};
+
+	// Chain identifiers as they appear in column 22
+	constexpr Code chainCodes[] = {
+		{"A", 1},
+		{"a", 2},
+		{"B", 3},
+		{"b", 4},
+		{"C", 5},
+		{"c", 6},
+		{"D", 7},
+		{"d", 8},
+		{"E", 9},
+		{"e", 10},
+		{"F", 11},
+		{"f", 12},
+		{"G", 13},
+		{"g", 14},
+		{"H", 15},
+		{"h", 16},
+		{"I", 17},
+		{"i", 18},
+		{"J", 19},
+		{"j", 20},
+		{"K", 21},
+		{"k", 22},
+		{"L", 23},
+		{"l", 24},
+		{"M", 25},
+		{"m", 26},
+		{"N", 27},
+		{"n", 28},
+		{"O", 29},
+		{"o", 30},
+		{"P", 31},
+		{"p", 32},
+		{"0", 33},
+		{"Q", 34},
+		{"q", 35},
+		{"1", 36},
+		{"R", 37},
+		{"r", 38},
+		{"2", 39},
+		{"S", 40},
+		{"s", 41},
+		{"3", 42},
+		{"T", 43},
+		{"t", 44},
+		{"4", 45},
+		{"U", 46},
+		{"u", 47},
+		{"5", 48},
+		{"V", 49},
+		{"v", 50},
+		{"6", 51},
+		{"W", 52},
+		{"w", 53},
+		{"7", 54},
+		{"X", 55},
+		{"x", 56},
+		{"8", 57},
+		{"Y", 58},
+		{"y", 59},
+		{"9", 60},
+		{"Z", 61},
+		{"z", 62},
+		{"none", 63}
+	};
+
+	template <size_t N> std::unordered_map<std::string, uint> makeIdMap(const Code (&codes)[N])
+	{
+		std::unordered_map<std::string, uint> ids;
+
+		for (const auto& c : codes)
+			ids[c.name] = c.id;
+
+		return ids;
+	}
+
+	// Packs a code of up to four characters and its length into a single key
+	constexpr uint64_t packCode(const char* code, size_t length)
+	{
+		uint64_t key = uint64_t(length) << 32;
+
+		for (size_t i = 0; i < length && i < 4; i++)
+			key |= uint64_t((unsigned char)code[i]) << (8 * i);
+
+		return key;
+	}
+
+	constexpr size_t codeLength(const char* code)
+	{
+		size_t length = 0;
+
+		while (code[length] != '\0')
+			length++;
+
+		return length;
+	}
+
+	// Open-addressing hash table from packed codes to ids, built at compile time
+	// Codes longer than four characters cannot occur in the fixed PDB columns and are left out
+	template <size_t N> struct CodeTable
+	{
+		static_assert((N & (N - 1)) == 0, "Table size must be a power of two.");
+
+		std::array<uint64_t, N> keys{};
+		std::array<uint, N> ids{};
+
+		static constexpr size_t slot(uint64_t key)
+		{
+			return size_t((key * 0x9E3779B97F4A7C15ull) >> 40) & (N - 1);
+		}
+
+		template <size_t M> constexpr CodeTable(const Code (&codes)[M])
+		{
+			for (const auto& c : codes)
+			{
+				const size_t length = codeLength(c.name);
+
+				if (length > 4)
+					continue;
+
+				const uint64_t key = packCode(c.name, length);
+				size_t i = slot(key);
+
+				while (keys[i] != 0)
+					i = (i + 1) & (N - 1);
+
+				keys[i] = key;
+				ids[i] = c.id;
+			}
+		}
+
+		// Returns the id for a code, or 0 if the code is unknown
+		uint find(std::string_view code) const
+		{
+			if (code.size() > 4)
+				return 0;
+
+			const uint64_t key = packCode(code.data(), code.size());
+
+			for (size_t i = slot(key); keys[i] != 0; i = (i + 1) & (N - 1))
+			{
+				if (keys[i] == key)
+					return ids[i];
+			}
+
+			return 0;
+		}
+	};
+
+	constexpr CodeTable<256> elementTable(elementCodes);
+	constexpr CodeTable<64> residueTable(residueCodes);
+	constexpr CodeTable<128> chainTable(chainCodes);
+
+	// Same character set as std::isspace in the "C" locale
+	inline bool isBlank(char c)
+	{
+		return c == ' ' || (c >= '\t' && c <= '\r');
+	}
+
+	inline std::string_view trimmed(std::string_view s)
+	{
+		while (!s.empty() && isBlank(s.front()))
+			s.remove_prefix(1);
+
+		while (!s.empty() && isBlank(s.back()))
+			s.remove_suffix(1);
+
+		return s;
+	}
+
+	// Trimmed view of a fixed-width column range of a line, missing trailing columns read as blanks
+	inline std::string_view column(std::string_view line, size_t start, size_t width)
+	{
+		if (start >= line.size())
+			return std::string_view();
+
+		return trimmed(line.substr(start, width));
+	}
+
+	// Parses a fixed-point decimal number such as "-12.345" without going through strtod
+	// The mantissa and the power of ten are both exact in double precision, so the single division rounds exactly like strtod would
+	// Anything else (exponents, stray characters) falls back to strtod on a stack copy, matching the results of std::atof
+	inline float parseCoordinate(std::string_view s)
+	{
+		static const double powersOfTen[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15 };
+
+		size_t i = 0;
+		bool negative = false;
+
+		if (i < s.size() && (s[i] == '-' || s[i] == '+'))
+			negative = (s[i++] == '-');
+
+		uint64_t mantissa = 0;
+		size_t digitCount = 0;
+		size_t fractionCount = 0;
+		bool fraction = false;
+
+		for (; i < s.size(); i++)
+		{
+			const char c = s[i];
+
+			if (c >= '0' && c <= '9')
+			{
+				mantissa = mantissa * 10 + uint64_t(c - '0');
+				digitCount++;
+
+				if (fraction)
+					fractionCount++;
+			}
+			else if (c == '.' && !fraction)
+			{
+				fraction = true;
+			}
+			else
+			{
+				break;
+			}
+		}
+
+		if (i == s.size() && digitCount > 0 && digitCount <= 15)
+		{
+			const double value = double(mantissa) / powersOfTen[fractionCount];
+			return float(negative ? -value : value);
+		}
+
+		char buffer[32];
+		const size_t length = std::min(s.size(), sizeof(buffer) - 1);
+		std::copy(s.begin(), s.begin() + length, buffer);
+		buffer[length] = '\0';
+
+		return float(std::strtod(buffer, nullptr));
+	}
+
+	// Files are read in blocks of this size, each block is then split into per-thread chunks at line boundaries
+	const size_t blockSize = size_t(64) << 20;
+
+	// Chunks smaller than this are not worth a thread of their own
+	const size_t minimumChunkSize = size_t(1) << 20;
+
+	// Rows of a BinaryCIF file that are converted to atoms between checks for cancellation
+	const size_t binaryCifRowBlockSize = size_t(1) << 20;
+
+	// Lazily loaded files are read in smaller blocks, so that only little more than the first timestep is parsed
+	const size_t lazyBlockSize = size_t(1) << 20;
+
+	// Result of parsing one chunk of a PDB file on a worker thread
+	struct PdbChunk
+	{
+		const char* begin = nullptr;
+		const char* end = nullptr;
+
+		// The first timestep continues the one left open by the previous chunk, every frame boundary starts a new one
+		// Consecutive boundaries, such as ENDMDL followed by MODEL or END, leave empty timesteps that are skipped when merging
+		std::vector< std::vector<vec4> > timesteps;
+
+		// Element, residue and chain ids in order of their first appearance within the chunk
+		// Atom attributes refer to positions in these tables until the chunk is merged
+		std::vector<uint> elementIds;
+		std::vector<uint> residueIds;
+		std::vector<uint> chainIds;
+
+		// Global indices for the chunk-local ones, filled in when the chunk is merged
+		std::vector<uint> elementIndices;
+		std::vector<uint> residueIndices;
+		std::vector<uint> chainIndices;
+
+		vec3 minimumBounds = vec3(std::numeric_limits<float>::max());
+		vec3 maximumBounds = vec3(-std::numeric_limits<float>::max());
+
+		// REMARK 350 records describing biological assemblies, in file order
+		std::vector<std::string> assemblyRecords;
+	};
+
+	// Returns the chunk-local index of an id, appending the id on its first appearance
+	uint localIndex(uint id, uint* map, std::vector<uint>& ids)
+	{
+		uint index = map[id];
+
+		if (index == 0)
+		{
+			ids.push_back(id);
+			index = uint(ids.size());
+			map[id] = index;
+		}
+
+		return index;
+	}
+
+	// MODEL and ENDMDL delimit the models of NMR ensembles, END separates the frames of files without them
+	bool isFrameBoundary(std::string_view recordName)
+	{
+		return recordName == "MODEL" || recordName == "ENDMDL" || recordName == "END";
+	}
+
+	void parsePdbChunk(PdbChunk& chunk)
+	{
+		std::array<uint, 116> elementIdMap;
+		std::array<uint, 24> residueIdMap;
+		std::array<uint, 64> chainIdMap;
+		elementIdMap.fill(0);
+		residueIdMap.fill(0);
+		chainIdMap.fill(0);
+
+		chunk.timesteps.emplace_back();
+		chunk.timesteps.back().reserve((chunk.end - chunk.begin) / 81);
+
+		const char* lineBegin = chunk.begin;
+
+		while (lineBegin < chunk.end)
+		{
+			const char* lineEnd = std::find(lineBegin, chunk.end, '\n');
+			const std::string_view line(lineBegin, size_t(lineEnd - lineBegin));
+			lineBegin = lineEnd + 1;
+
+			const std::string_view recordName = column(line, 0, 6);
+
+			if (isFrameBoundary(recordName))
+			{
+				chunk.timesteps.emplace_back();
+			}
+			else if (recordName == "ATOM" || recordName == "HETATM")
+			{
+				float x = parseCoordinate(column(line, 30, 8));
+				float y = parseCoordinate(column(line, 38, 8));
+				float z = parseCoordinate(column(line, 46, 8));
+
+				uint elementId = elementTable.find(column(line, 76, 2));
+				uint residueId = residueTable.find(column(line, 17, 3));
+				uint chainId = chainTable.find(column(line, 21, 1));
+
+				uint elementIndex = localIndex(elementId, elementIdMap.data(), chunk.elementIds);
+				uint residueIndex = localIndex(residueId, residueIdMap.data(), chunk.residueIds);
+				uint chainIndex = localIndex(chainId, chainIdMap.data(), chunk.chainIds);
+
+				uint atomAttributes = elementIndex | (residueIndex << 8) | (chainIndex << 16);
+				vec4 atom(x, y, z, uintBitsToFloat(atomAttributes));
+				chunk.timesteps.back().push_back(atom);
+
+				chunk.minimumBounds = min(chunk.minimumBounds, vec3(atom));
+				chunk.maximumBounds = max(chunk.maximumBounds, vec3(atom));
+			}
+			else if (recordName == "REMARK" && column(line, 6, 4) == "350")
+			{
+				chunk.assemblyRecords.emplace_back(line);
+			}
+		}
+	}
+
+	// Rewrites the chunk-local attributes of all atoms in a chunk to global indices
+	void remapPdbChunk(PdbChunk& chunk)
+	{
+		for (auto& timestep : chunk.timesteps)
+		{
+			for (auto& atom : timestep)
+			{
+				uint localAttributes = floatBitsToUint(atom.w);
+				uint elementIndex = chunk.elementIndices[bitfieldExtract(localAttributes, 0, 8)];
+				uint residueIndex = chunk.residueIndices[bitfieldExtract(localAttributes, 8, 8)];
+				uint chainIndex = chunk.chainIndices[bitfieldExtract(localAttributes, 16, 8)];
+
+				uint atomAttributes = elementIndex | (residueIndex << 8) | (chainIndex << 16);
+				atom.w = uintBitsToFloat(atomAttributes);
+			}
+		}
+	}
+
+	// Reads a stream in blocks and calls parseBlock(begin, end) on each one until it returns false
+	// Blocks always end behind a line break, the incomplete last line is carried over into the next block
+	// Returns the number of bytes read
+	template <typename BlockParser> size_t readLineBlocks(std::istream& file, const BlockParser& parseBlock, size_t size = blockSize)
+	{
+		std::vector<char> buffer;
+		size_t carry = 0;
+		size_t fileSize = 0;
+
+		while (file.good())
+		{
+			buffer.resize(carry + size);
+			file.read(buffer.data() + carry, std::streamsize(size));
+			fileSize += size_t(file.gcount());
+
+			const size_t bufferSize = carry + size_t(file.gcount());
+			size_t parseSize = bufferSize;
+
+			// unless this is the last block, only parse up to the last complete line
+			if (file.good())
+			{
+				while (parseSize > 0 && buffer[parseSize - 1] != '\n')
+					parseSize--;
+			}
+
+			if (!parseBlock(buffer.data(), buffer.data() + parseSize))
+				break;
+
+			carry = bufferSize - parseSize;
+			std::copy(buffer.begin() + parseSize, buffer.begin() + bufferSize, buffer.begin());
+		}
+
+		return fileSize;
+	}
+
+	bool equalsIgnoreCase(std::string_view a, std::string_view b)
+	{
+		if (a.size() != b.size())
+			return false;
+
+		for (size_t i = 0; i < a.size(); i++)
+		{
+			if (std::tolower((unsigned char)a[i]) != std::tolower((unsigned char)b[i]))
+				return false;
+		}
+
+		return true;
+	}
+
+	bool startsWithIgnoreCase(std::string_view s, std::string_view prefix)
+	{
+		return s.size() >= prefix.size() && equalsIgnoreCase(s.substr(0, prefix.size()), prefix);
+	}
+
+	// Extension of a file name, ignoring the suffix of compressed files (e.g. .cif for 1abc.cif.gz)
+	std::string_view fileExtension(const std::string& filename)
+	{
+		std::string_view name(filename);
+		size_t dot = name.find_last_of('.');
+
+		if (dot != std::string_view::npos)
+		{
+			const std::string_view suffix = name.substr(dot);
+
+			if (equalsIgnoreCase(suffix, ".gz") || equalsIgnoreCase(suffix, ".zst") || equalsIgnoreCase(suffix, ".zstd"))
+			{
+				name = name.substr(0, dot);
+				dot = name.find_last_of('.');
+			}
+		}
+
+		return (dot == std::string_view::npos) ? std::string_view() : name.substr(dot);
+	}
+
+	bool isCifFile(const std::string& filename)
+	{
+		const std::string_view extension = fileExtension(filename);
+		return equalsIgnoreCase(extension, ".cif") || equalsIgnoreCase(extension, ".mmcif");
+	}
+
+	bool isBinaryCifFile(const std::string& filename)
+	{
+		return equalsIgnoreCase(fileExtension(filename), ".bcif");
+	}
+
+	// Element symbols are usually upper case in mmCIF files, while the tables use the PDB spelling
+	uint cifElementId(std::string_view symbol)
+	{
+		char name[4];
+
+		if (symbol.empty() || symbol.size() > sizeof(name))
+			return 0;
+
+		for (size_t c = 0; c < symbol.size(); c++)
+			name[c] = char(c == 0 ? std::toupper((unsigned char)symbol[c]) : std::tolower((unsigned char)symbol[c]));
+
+		return elementTable.find(std::string_view(name, symbol.size()));
+	}
+
+	// Chain identifiers that are not in the table, e.g. the two or more characters used by large mmCIF assemblies, get ids from here on
+	const uint firstChainNameId = 64;
+
+	// The chain index is stored in 8 bits of the atom attributes
+	const size_t maximumChainCount = 256;
+
+	// Identifiers longer than this are treated as unknown, like the values a CifValue cannot hold
+	const size_t maximumChainNameLength = 8;
+
+	// Packs a chain identifier into a key, identifiers never contain zero bytes so shorter ones cannot collide with longer ones
+	uint64_t chainNameKey(std::string_view name)
+	{
+		uint64_t key = 0;
+
+		for (size_t i = 0; i < name.size(); i++)
+			key |= uint64_t((unsigned char)name[i]) << (8 * i);
+
+		return key;
+	}
+
+	std::string chainNameFromKey(uint64_t key)
+	{
+		std::string name;
+
+		for (; key != 0; key >>= 8)
+			name.push_back(char(key & 0xFF));
+
+		return name;
+	}
+
+	// Identifiers beyond the table cycle through the colors of the named chains, leaving out unknown and none
+	vec3 chainColor(uint chainId)
+	{
+		const auto& colors = Protein::chainColors();
+
+		if (chainId < firstChainNameId)
+			return colors[chainId];
+
+		return colors[1 + (chainId - firstChainNameId) % (colors.size() - 2)];
+	}
+
+	// Splits a line at blanks
+	std::vector<std::string_view> tokens(std::string_view line)
+	{
+		std::vector<std::string_view> result;
+		size_t i = 0;
+
+		while (i < line.size())
+		{
+			while (i < line.size() && isBlank(line[i]))
+				i++;
+
+			const size_t begin = i;
+
+			while (i < line.size() && !isBlank(line[i]))
+				i++;
+
+			if (i > begin)
+				result.push_back(line.substr(begin, i - begin));
+		}
+
+		return result;
+	}
+
+	// Transforms of the first biological assembly described by REMARK 350 BIOMT records
+	// The chains an assembly applies to are not taken into account, every transform applies to all atoms
+	std::vector<mat4> pdbAssemblyTransforms(const std::vector<std::string>& records)
+	{
+		std::vector<mat4> transforms;
+		uint biomoleculeCount = 0;
+		uint rowCount = 0;
+
+		for (const auto& record : records)
+		{
+			const std::vector<std::string_view> t = tokens(record);
+
+			if (t.size() >= 3 && t[2] == "BIOMOLECULE:" && ++biomoleculeCount > 1)
+				break;
+
+			// REMARK 350 BIOMTn serial m1 m2 m3 t
+			if (t.size() < 8 || t[2].size() != 6 || t[2].substr(0, 5) != "BIOMT" || t[2][5] < '1' || t[2][5] > '3')
+				continue;
+
+			const int row = t[2][5] - '1';
+
+			if (row == 0)
+			{
+				transforms.push_back(mat4(1.0f));
+				rowCount = 0;
+			}
+			else if (transforms.empty() || row != int(rowCount))
+			{
+				continue;
+			}
+
+			for (int c = 0; c < 3; c++)
+				transforms.back()[c][row] = parseCoordinate(t[4 + c]);
+
+			transforms.back()[3][row] = parseCoordinate(t[7]);
+			rowCount++;
+		}
+
+		// an incomplete last matrix is dropped
+		if (!transforms.empty() && rowCount < 3)
+			transforms.pop_back();
+
+		return transforms;
+	}
+
+	// Rows of a small mmCIF category such as _pdbx_struct_oper_list, kept as strings
+	struct CifTable
+	{
+		std::vector<std::string> columns;
+		std::vector<std::string> values;
+
+		size_t rowCount() const
+		{
+			return columns.empty() ? 0 : values.size() / columns.size();
+		}
+
+		// Empty for missing columns or rows
+		std::string_view value(size_t row, std::string_view column) const
+		{
+			for (size_t c = 0; c < columns.size(); c++)
+			{
+				if (equalsIgnoreCase(columns[c], column) && row * columns.size() + c < values.size())
+					return values[row * columns.size() + c];
+			}
+
+			return std::string_view();
+		}
+	};
+
+	// Expands an operator expression of _pdbx_struct_assembly_gen into one list of operator ids per parenthesized group
+	// Groups contain ids and ranges of numeric ids separated by commas, e.g. "(1-60)" or "1,2,3" or "(1-5)(6-10)"
+	std::vector< std::vector<std::string> > cifOperatorGroups(std::string_view expression)
+	{
+		std::vector<std::string_view> groupExpressions;
+
+		if (expression.find('(') == std::string_view::npos)
+		{
+			groupExpressions.push_back(expression);
+		}
+		else
+		{
+			size_t begin = expression.find('(');
+
+			while (begin != std::string_view::npos)
+			{
+				const size_t end = expression.find(')', begin);
+
+				if (end == std::string_view::npos)
+					break;
+
+				groupExpressions.push_back(expression.substr(begin + 1, end - begin - 1));
+				begin = expression.find('(', end);
+			}
+		}
+
+		std::vector< std::vector<std::string> > groups;
+
+		for (auto groupExpression : groupExpressions)
+		{
+			std::vector<std::string> group;
+
+			while (!groupExpression.empty())
+			{
+				const size_t comma = std::min(groupExpression.find(','), groupExpression.size());
+				const std::string_view item = trimmed(groupExpression.substr(0, comma));
+				groupExpression.remove_prefix(std::min(comma + 1, groupExpression.size()));
+
+				const size_t dash = item.find('-');
+				const bool isRange = dash != std::string_view::npos && dash > 0 && std::all_of(item.begin(), item.end(), [](char c) { return c == '-' || std::isdigit((unsigned char)c); });
+
+				if (isRange)
+				{
+					const int first = std::atoi(std::string(item.substr(0, dash)).c_str());
+					const int last = std::atoi(std::string(item.substr(dash + 1)).c_str());
+
+					for (int i = first; i <= last; i++)
+						group.push_back(std::to_string(i));
+				}
+				else if (!item.empty())
+				{
+					group.emplace_back(item);
+				}
+			}
+
+			if (!group.empty())
+				groups.push_back(std::move(group));
+		}
+
+		return groups;
+	}
+
+	// Transforms of the first assembly listed in _pdbx_struct_assembly_gen
+	// Like for PDB files, the asym_id_list of the assembly is not taken into account
+	std::vector<mat4> cifAssemblyTransforms(const CifTable& operators, const CifTable& assemblies)
+	{
+		std::unordered_map<std::string, mat4> operatorTransforms;
+
+		for (size_t row = 0; row < operators.rowCount(); row++)
+		{
+			mat4 transform(1.0f);
+
+			for (int i = 0; i < 3; i++)
+			{
+				for (int j = 0; j < 3; j++)
+					transform[j][i] = parseCoordinate(operators.value(row, "matrix[" + std::to_string(i + 1) + "][" + std::to_string(j + 1) + "]"));
+
+				transform[3][i] = parseCoordinate(operators.value(row, "vector[" + std::to_string(i + 1) + "]"));
+			}
+
+			operatorTransforms[std::string(operators.value(row, "id"))] = transform;
+		}
+
+		std::vector<mat4> transforms;
+
+		if (assemblies.rowCount() == 0)
+			return transforms;
+
+		const std::string_view assembly = assemblies.value(0, "assembly_id");
+
+		for (size_t row = 0; row < assemblies.rowCount(); row++)
+		{
+			if (assemblies.value(row, "assembly_id") != assembly)
+				continue;
+
+			// the product of the groups applies the rightmost operator first
+			std::vector<mat4> products = { mat4(1.0f) };
+
+			for (const auto& group : cifOperatorGroups(assemblies.value(row, "oper_expression")))
+			{
+				std::vector<mat4> groupProducts;
+
+				for (const auto& product : products)
+				{
+					for (const auto& id : group)
+					{
+						auto match = operatorTransforms.find(id);
+
+						if (match == operatorTransforms.end())
+						{
+							globjects::warning() << "Unknown assembly operator " << id << "!";
+							return std::vector<mat4>();
+						}
+
+						groupProducts.push_back(product * match->second);
+					}
+				}
+
+				products.swap(groupProducts);
+			}
+
+			transforms.insert(transforms.end(), products.begin(), products.end());
+		}
+
+		return transforms;
+	}
+
+	// Copies a small BinaryCIF category into a table of strings
+	// Numeric columns are formatted with enough digits to parse back to the same single precision values
+	bool binaryCifTable(const BinaryCif& cif, const std::string& name, CifTable& table)
+	{
+		const BinaryCif::Category* category = cif.category(name);
+
+		if (!category || category->rowCount == 0)
+			return false;
+
+		table = CifTable();
+		table.values.resize(category->rowCount * category->columns.size());
+
+		for (const auto& column : category->columns)
+		{
+			const size_t c = table.columns.size();
+			table.columns.push_back(column.first);
+
+			BinaryCif::StringColumn strings;
+			std::vector<float> numbers;
+
+			if (cif.decode(column.second, strings) && strings.indices.size() == category->rowCount)
+			{
+				for (size_t row = 0; row < category->rowCount; row++)
+				{
+					if (strings.indices[row] >= 0)
+						table.values[row * category->columns.size() + c] = std::string(strings.strings[strings.indices[row]]);
+				}
+			}
+			else if (cif.decode(column.second, numbers) && numbers.size() == category->rowCount)
+			{
+				for (size_t row = 0; row < category->rowCount; row++)
+				{
+					char number[32];
+					std::snprintf(number, sizeof(number), "%.9g", numbers[row]);
+					table.values[row * category->columns.size() + c] = number;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// A short string value of the current _atom_site row
+	// Values that do not fit are marked as too long, they would not match any of the code tables or chain identifiers anyway
+	struct CifValue
+	{
+		std::array<char, 8> chars = {};
+		size_t length = 0;
+
+		void assign(std::string_view s)
+		{
+			length = s.size();
+			std::copy(s.begin(), s.begin() + std::min(s.size(), chars.size()), chars.begin());
+		}
+
+		std::string_view view() const
+		{
+			if (length > chars.size())
+				return std::string_view();
+
+			return std::string_view(chars.data(), length);
+		}
+	};
+
+	// Streaming reader for the _atom_site category of mmCIF (PDBx) files
+	// Lines are tokenized one at a time and only the columns needed for rendering are kept,
+	// so memory use is independent of the number of rows and columns in the file
+	// The small categories describing the biological assembly are kept as tables of strings
+	class CifAtomSiteReader
+	{
+	public:
+		struct Atom
+		{
+			vec3 position = vec3(0.0f);
+			uint elementId = 0;
+			uint residueId = 0;
+
+			// only valid during the callback, chains are numbered per structure by Protein::chainId
+			std::string_view chain;
+			int model = 0;
+		};
+
+		// Calls atomCallback(const Atom&) for every complete _atom_site row ending on this line
+		template <typename AtomCallback> void parseLine(std::string_view line, const AtomCallback& atomCallback)
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.remove_suffix(1);
+
+			size_t i = 0;
+
+			// text fields span whole lines between a pair of lines starting with a semicolon
+			if (!line.empty() && line[0] == ';')
+			{
+				m_inTextField = !m_inTextField;
+
+				if (m_inTextField)
+					return;
+
+				value(std::string_view(), atomCallback);
+				i = 1;
+			}
+			else if (m_inTextField)
+			{
+				return;
+			}
+
+			while (i < line.size())
+			{
+				while (i < line.size() && isBlank(line[i]))
+					i++;
+
+				if (i >= line.size() || line[i] == '#')
+					break;
+
+				if (line[i] == '\'' || line[i] == '"')
+				{
+					// a quoted value ends at a matching quote followed by whitespace or the end of the line
+					const char quote = line[i];
+					const size_t begin = ++i;
+
+					while (i < line.size() && !(line[i] == quote && (i + 1 == line.size() || isBlank(line[i + 1]))))
+						i++;
+
+					value(line.substr(begin, i - begin), atomCallback);
+					i++;
+				}
+				else
+				{
+					const size_t begin = i;
+
+					while (i < line.size() && !isBlank(line[i]))
+						i++;
+
+					token(line.substr(begin, i - begin), atomCallback);
+				}
+			}
+		}
+
+		// Number of _atom_site columns the last loop header declared, zero if none was found
+		size_t columnCount() const
+		{
+			return m_atomSiteColumnCount;
+		}
+
+		const CifTable& operators() const
+		{
+			return m_operators;
+		}
+
+		const CifTable& assemblies() const
+		{
+			return m_assemblies;
+		}
+
+	private:
+		enum Column
+		{
+			TypeSymbol,
+			AuthCompId,
+			LabelCompId,
+			AuthAsymId,
+			LabelAsymId,
+			CartnX,
+			CartnY,
+			CartnZ,
+			ModelNumber,
+			ColumnCount
+		};
+
+		template <typename AtomCallback> void token(std::string_view t, const AtomCallback& atomCallback)
+		{
+			if (startsWithIgnoreCase(t, "loop_"))
+			{
+				m_state = State::LoopHeader;
+				m_isAtomSiteLoop = false;
+				m_loopTable = nullptr;
+				m_loopColumnCount = 0;
+				m_columns.fill(-1);
+			}
+			else if (t[0] == '_')
+			{
+				std::string_view column;
+				CifTable* table = recordedTable(t, column);
+
+				if (m_state == State::LoopHeader)
+				{
+					if (table)
+					{
+						if (m_loopColumnCount == 0)
+						{
+							*table = CifTable();
+							m_loopTable = table;
+						}
+
+						if (m_loopTable == table)
+							table->columns.emplace_back(column);
+					}
+
+					if (startsWithIgnoreCase(t, "_atom_site."))
+					{
+						m_isAtomSiteLoop = true;
+						const std::string_view name = t.substr(11);
+
+						static const char* const columnNames[ColumnCount] = {
+							"type_symbol", "auth_comp_id", "label_comp_id", "auth_asym_id", "label_asym_id", "Cartn_x", "Cartn_y", "Cartn_z", "pdbx_PDB_model_num"
+						};
+
+						for (int c = 0; c < ColumnCount; c++)
+						{
+							if (equalsIgnoreCase(name, columnNames[c]))
+								m_columns[c] = int(m_loopColumnCount);
+						}
+					}
+
+					m_loopColumnCount++;
+				}
+				else
+				{
+					// a single tag with its value, which is skipped unless it belongs to a recorded category
+					m_state = State::TagValue;
+					m_tagTable = table;
+
+					if (table)
+						table->columns.emplace_back(column);
+				}
+			}
+			else if (startsWithIgnoreCase(t, "data_") || startsWithIgnoreCase(t, "save_") || startsWithIgnoreCase(t, "global_") || startsWithIgnoreCase(t, "stop_"))
+			{
+				m_state = State::None;
+			}
+			else
+			{
+				value(t, atomCallback);
+			}
+		}
+
+		template <typename AtomCallback> void value(std::string_view v, const AtomCallback& atomCallback)
+		{
+			if (m_state == State::LoopHeader)
+			{
+				m_state = State::LoopData;
+				m_columnIndex = 0;
+
+				if (m_isAtomSiteLoop)
+				{
+					m_atomSiteColumnCount = m_loopColumnCount;
+					std::copy(m_columns.begin(), m_columns.end(), m_columnOfRole.begin());
+					m_roleOfColumn.assign(m_loopColumnCount, -1);
+
+					// prefer author-assigned residue and chain names, they are the ones PDB files use
+					if (m_columnOfRole[AuthCompId] >= 0)
+						m_columnOfRole[LabelCompId] = -1;
+
+					if (m_columnOfRole[AuthAsymId] >= 0)
+						m_columnOfRole[LabelAsymId] = -1;
+
+					for (int c = 0; c < ColumnCount; c++)
+					{
+						if (m_columnOfRole[c] >= 0)
+							m_roleOfColumn[m_columnOfRole[c]] = c;
+					}
+				}
+			}
+			else if (m_state == State::TagValue)
+			{
+				if (m_tagTable)
+					m_tagTable->values.emplace_back(v);
+
+				m_state = State::None;
+				return;
+			}
+
+			if (m_state == State::LoopData && m_loopTable)
+				m_loopTable->values.emplace_back(v);
+
+			if (m_state != State::LoopData || !m_isAtomSiteLoop)
+				return;
+
+			switch (m_roleOfColumn[m_columnIndex])
+			{
+			case TypeSymbol: m_element.assign(v); break;
+			case AuthCompId: case LabelCompId: m_residue.assign(v); break;
+			case AuthAsymId: case LabelAsymId: m_chain.assign(v); break;
+			case CartnX: m_atom.position.x = parseCoordinate(v); break;
+			case CartnY: m_atom.position.y = parseCoordinate(v); break;
+			case CartnZ: m_atom.position.z = parseCoordinate(v); break;
+			case ModelNumber: m_atom.model = std::atoi(std::string(v.substr(0, 15)).c_str()); break;
+			}
+
+			if (++m_columnIndex == m_loopColumnCount)
+			{
+				m_columnIndex = 0;
+
+				m_atom.elementId = cifElementId(m_element.view());
+				m_atom.residueId = residueTable.find(m_residue.view());
+				m_atom.chain = m_chain.view();
+
+				atomCallback(m_atom);
+			}
+		}
+
+		// Table for tags of the assembly categories, the name of the column is returned as well
+		CifTable* recordedTable(std::string_view tag, std::string_view& column)
+		{
+			const size_t dot = tag.find('.');
+
+			if (dot == std::string_view::npos)
+				return nullptr;
+
+			const std::string_view category = tag.substr(0, dot);
+			column = tag.substr(dot + 1);
+
+			if (equalsIgnoreCase(category, "_pdbx_struct_oper_list"))
+				return &m_operators;
+
+			if (equalsIgnoreCase(category, "_pdbx_struct_assembly_gen"))
+				return &m_assemblies;
+
+			return nullptr;
+		}
+
+		enum class State
+		{
+			None,
+			TagValue,
+			LoopHeader,
+			LoopData
+		};
+
+		State m_state = State::None;
+		bool m_inTextField = false;
+
+		bool m_isAtomSiteLoop = false;
+		size_t m_loopColumnCount = 0;
+		size_t m_columnIndex = 0;
+		std::array<int, ColumnCount> m_columns;
+
+		size_t m_atomSiteColumnCount = 0;
+		std::array<int, ColumnCount> m_columnOfRole;
+		std::vector<int> m_roleOfColumn;
+
+		CifValue m_element;
+		CifValue m_residue;
+		CifValue m_chain;
+		Atom m_atom;
+
+		CifTable m_operators;
+		CifTable m_assemblies;
+		CifTable* m_loopTable = nullptr;
+		CifTable* m_tagTable = nullptr;
+	};
+
+	// Binary cache files store parsed atoms next to the source file, see Protein::saveCache for the layout
+	const char cacheMagic[8] = { 'D', 'Y', 'N', 'A', 'M', 'O', 'L', '\0' };
+	const uint32_t cacheVersion = 3;
+
+	// Atom arrays start at multiples of this so they can be mapped or read without copying
+	const uint64_t cacheAlignment = 4096;
+
+	struct CacheHeader
+	{
+		char magic[8] = {};
+		uint32_t version = 0;
+		uint32_t timestepCount = 0;
+
+		// size, modification time and sampled content hash of the source file the cache was written for
+		uint64_t sourceSize = 0;
+		int64_t sourceTime = 0;
+		uint64_t sourceHash = 0;
+
+		uint32_t elementCount = 0;
+		uint32_t residueCount = 0;
+		uint32_t chainCount = 0;
+		uint32_t instanceCount = 0;
+
+		vec3 minimumBounds = vec3(0.0f);
+		vec3 maximumBounds = vec3(0.0f);
+	};
+
+	static_assert(sizeof(CacheHeader) == 80, "Unexpected cache header layout.");
+
+	struct CacheTimestep
+	{
+		uint64_t offset;
+		uint64_t atomCount;
+	};
+
+	// Fills in the source fields of a cache header
+	// Hashing the whole file would cost as much as parsing it, so only its first and last megabyte are hashed
+	bool cacheSourceStamp(const std::string& filename, CacheHeader& header)
+	{
+		std::error_code error;
+		const uint64_t size = std::filesystem::file_size(filename, error);
+
+		if (error)
+			return false;
+
+		const auto time = std::filesystem::last_write_time(filename, error);
+
+		if (error)
+			return false;
+
+		std::ifstream file(filename, std::ios::binary);
+
+		if (!file.is_open())
+			return false;
+
+		const uint64_t sampleSize = uint64_t(1) << 20;
+		std::vector<char> sample(size_t(std::min(size, sampleSize)));
+		uint64_t hash = 14695981039346656037ull;
+
+		auto hashSample = [&]() {
+			file.read(sample.data(), sample.size());
+
+			for (char c : sample)
+			{
+				hash ^= uint64_t((unsigned char)c);
+				hash *= 1099511628211ull;
+			}
+		};
+
+		hashSample();
+
+		if (size > sampleSize)
+		{
+			file.seekg(std::streamoff(size - sample.size()));
+			hashSample();
+		}
+
+		if (!file)
+			return false;
+
+		header.sourceSize = size;
+		header.sourceTime = int64_t(time.time_since_epoch().count());
+		header.sourceHash = hash;
+
+		return true;
+	}
+}
+
+Protein::Protein()
+{
+
+}
+
+Protein::Protein(const std::string& filename)
+{
+	load(filename);
+}
+
+void Protein::load(const std::string& filename)
+{
+	PROFILE_ZONE("Protein::load");
+
+	globjects::debug() << "Loading file " << filename << " ...";
+	m_filename = filename;
+
+	m_atoms.clear();
+	m_minimumBounds = vec3(std::numeric_limits<float>::max());
+	m_maximumBounds = vec3(-std::numeric_limits<float>::max());
+
+	m_elementIdMap.fill(0);
+	m_residueIdMap.fill(0);
+	m_chainIdMap.assign(firstChainNameId, 0);
+	m_chainNameIds.clear();
+	m_chainNames.clear();
+
+	m_activeElementIds.clear();
+	m_activeElementIds.push_back(0);
+
+	m_activeResidueIds.clear();
+	m_activeResidueIds.push_back(0);
+
+	m_activeChainIds.clear();
+	m_activeChainIds.push_back(0);
+
+	m_activeElementRadii.clear();
+	m_activeElementColors.clear();
+	m_activeResidueColors.clear();
+	m_activeChainColors.clear();
+
+	m_activeElementColorsRadiiPacked.clear();
+	m_activeResidueColorsPacked.clear();
+	m_activeChainColorsPacked.clear();
+
+	m_quantizedTimesteps.clear();
+	m_atomAttributes.clear();
+	m_atomOrder.clear();
+
+	m_instanceTransforms.assign(1, mat4(1.0f));
+	m_pendingTimesteps = false;
+	m_loadProgress = 0.0f;
+
+	std::ifstream file(filename, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		globjects::critical() << "Could not open file " << filename << "!";
+	}
+
+	const DecompressingStreamBuffer::Format format = DecompressingStreamBuffer::detectFormat(file);
+
+	// lazily loaded timesteps are read back from byte offsets by a PdbTrajectory, which needs an uncompressed PDB file
+	const bool lazy = m_lazyLoadingEnabled && format == DecompressingStreamBuffer::Format::None && !isCifFile(filename) && !isBinaryCifFile(filename);
+
+	if (m_lazyLoadingEnabled && !lazy)
+		globjects::warning() << "Lazy loading is only supported for uncompressed PDB files, loading all timesteps of " << filename << ".";
+
+	// the cache holds all timesteps, which is exactly what lazy loading avoids
+	if (m_cacheEnabled && !lazy && loadCache(filename))
+	{
+		if (m_spatialOrderingEnabled)
+			reorder();
+
+		if (m_quantizationEnabled)
+			quantize();
+
+		computeAssemblyBounds();
+
+		m_loadProgress = 1.0f;
+		return;
+	}
+
+	if (m_loadCancelled)
+	{
+		globjects::debug() << "Loading of " << filename << " cancelled.";
+		return;
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+	size_t fileSize = 0;
+
+	// compressed files are decompressed on a separate thread while the parser reads the previous block
+	std::istream input(file.rdbuf());
+	std::unique_ptr<DecompressingStreamBuffer> decompressor;
+
+	if (format != DecompressingStreamBuffer::Format::None)
+	{
+		decompressor = std::make_unique<DecompressingStreamBuffer>(file, format);
+		input.rdbuf(decompressor.get());
+	}
+
+	// progress is measured in bytes of the file on disk, which for compressed files is only known to the decompressor
+	std::error_code error;
+	const auto loadSize = std::filesystem::file_size(filename, error);
+	m_loadSize = error ? 0 : size_t(loadSize);
+	m_loadPosition = [&]() { return decompressor ? decompressor->compressedBytesRead() : size_t(std::max(std::streamoff(0), std::streamoff(file.tellg()))); };
+
+	if (isBinaryCifFile(filename))
+		fileSize = loadBinaryCif(input);
+	else if (isCifFile(filename))
+		fileSize = loadCif(input);
+	else
+		fileSize = loadPdb(input, lazy);
+
+	const bool complete = input.eof() && !(decompressor && decompressor->failed());
+	m_pendingTimesteps = lazy && !input.eof();
+	m_loadPosition = nullptr;
+	decompressor.reset();
+
+	if (m_loadCancelled)
+	{
+		globjects::debug() << "Loading of " << filename << " cancelled.";
+		return;
+	}
+
+	const double loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+	for (auto id : m_activeElementIds)
+	{
+		m_activeElementColors.push_back(elementColors()[id]);
+		m_activeElementRadii.push_back(elementRadii()[id]);
+		m_activeElementColorsRadiiPacked.push_back(vec4(elementColors()[id],elementRadii()[id]));
+	}
+
+	for (auto id : m_activeResidueIds)
+	{
+		m_activeResidueColors.push_back(residueColors()[id]);
+		m_activeResidueColorsPacked.push_back(vec4(residueColors()[id],1.0f));
+	}
+
+	for (auto id : m_activeChainIds)
+	{
+		m_activeChainColors.push_back(chainColor(id));
+		m_activeChainColorsPacked.push_back(vec4(chainColor(id), 1.0f));
+	}
+
+
+	for (uint i = 0; i < m_atoms.size(); i++)
+	{
+		globjects::debug() << "  Timestep " << i << ": " << uint(m_atoms[i].size()) << " atoms";
+	}
+
+	const double megabytes = double(fileSize) / double(1 << 20);
+	globjects::debug() << "Parsed " << megabytes << " MB in " << loadTime << " s (" << megabytes / std::max(loadTime, 1e-6) << " MB/s)";
+	globjects::debug() << uint(m_atoms.size()) << " timesteps loaded." << std::endl;
+
+	if (m_cacheEnabled && complete)
+		saveCache(filename);
+
+	// the cache keeps the atoms in file order, so it does not depend on this setting
+	if (m_spatialOrderingEnabled)
+		reorder();
+
+	if (m_quantizationEnabled)
+		quantize();
+
+	computeAssemblyBounds();
+	m_loadProgress = 1.0f;
+}
+
+size_t Protein::loadPdb(std::istream& file, bool firstTimestepOnly)
+{
+	PROFILE_ZONE("Protein::loadPdb");
+
+	std::vector<vec4> atoms;
+	std::vector<std::string> assemblyRecords;
+
+	const size_t fileSize = readLineBlocks(file, [&](const char* blockBegin, const char* blockEnd) {
+		const size_t parseSize = size_t(blockEnd - blockBegin);
+		const uint chunkCount = parallelThreadCount(parseSize, minimumChunkSize);
+		std::vector<PdbChunk> chunks(chunkCount);
+
+		for (uint i = 0; i < chunkCount; i++)
+		{
+			chunks[i].begin = (i == 0) ? blockBegin : chunks[i - 1].end;
+			chunks[i].end = (i == chunkCount - 1) ? blockEnd : std::max(chunks[i].begin, blockBegin + rangeBegin(parseSize, i + 1, chunkCount));
+
+			// move the split point behind the next line break
+			while (chunks[i].end < blockEnd && *(chunks[i].end - 1) != '\n')
+				chunks[i].end++;
+		}
+
+		runParallel(chunkCount, [&chunks](uint i) {
+			parsePdbChunk(chunks[i]);
+		});
+
+		// assign global indices in order of first appearance across chunks, exactly like a sequential pass would
+		for (auto& chunk : chunks)
+		{
+			chunk.elementIndices.push_back(0);
+			chunk.residueIndices.push_back(0);
+			chunk.chainIndices.push_back(0);
+
+			for (auto id : chunk.elementIds)
+				chunk.elementIndices.push_back(elementIndex(id));
+
+			for (auto id : chunk.residueIds)
+				chunk.residueIndices.push_back(residueIndex(id));
+
+			for (auto id : chunk.chainIds)
+				chunk.chainIndices.push_back(chainIndex(id));
+
+			m_minimumBounds = min(m_minimumBounds, chunk.minimumBounds);
+			m_maximumBounds = max(m_maximumBounds, chunk.maximumBounds);
+		}
+
+		runParallel(chunkCount, [&chunks](uint i) {
+			remapPdbChunk(chunks[i]);
+		});
+
+		for (auto& chunk : chunks)
+		{
+			assemblyRecords.insert(assemblyRecords.end(), chunk.assemblyRecords.begin(), chunk.assemblyRecords.end());
+
+			for (size_t i = 0; i < chunk.timesteps.size(); i++)
+			{
+				if (i > 0 && !atoms.empty())
+				{
+					m_atoms.push_back(std::move(atoms));
+					atoms.clear();
+				}
+
+				if (atoms.empty())
+					atoms = std::move(chunk.timesteps[i]);
+				else
+					atoms.insert(atoms.end(), chunk.timesteps[i].begin(), chunk.timesteps[i].end());
+			}
+		}
+
+		// with lazy loading, the remaining timesteps are left to a PdbTrajectory
+		return continueLoading() && !(firstTimestepOnly && !m_atoms.empty());
+	}, firstTimestepOnly ? lazyBlockSize : blockSize);
+
+	// the last frame does not need to be terminated, unless parsing stopped early and it is still incomplete
+	if (!atoms.empty() && file.eof() && !m_loadCancelled)
+		m_atoms.push_back(std::move(atoms));
+
+	std::vector<mat4> instanceTransforms = pdbAssemblyTransforms(assemblyRecords);
+
+	if (!instanceTransforms.empty())
+		m_instanceTransforms = std::move(instanceTransforms);
+
+	return fileSize;
+}
+
+size_t Protein::loadCif(std::istream& file)
+{
+	PROFILE_ZONE("Protein::loadCif");
+
+	CifAtomSiteReader reader;
+	std::vector<vec4> atoms;
+	int model = 0;
+
+	auto addAtom = [&](const CifAtomSiteReader::Atom& atom) {
+		// every model of a multi-model entry becomes a timestep
+		if (atom.model != model && !atoms.empty())
+		{
+			m_atoms.push_back(std::move(atoms));
+			atoms.clear();
+		}
+
+		model = atom.model;
+
+		uint atomAttributes = elementIndex(atom.elementId) | (residueIndex(atom.residueId) << 8) | (chainIndex(chainId(atom.chain)) << 16);
+		atoms.push_back(vec4(atom.position, uintBitsToFloat(atomAttributes)));
+
+		m_minimumBounds = min(m_minimumBounds, atom.position);
+		m_maximumBounds = max(m_maximumBounds, atom.position);
+	};
+
+	const size_t fileSize = readLineBlocks(file, [&](const char* blockBegin, const char* blockEnd) {
+		const char* lineBegin = blockBegin;
+
+		while (lineBegin < blockEnd)
+		{
+			const char* lineEnd = std::find(lineBegin, blockEnd, '\n');
+			reader.parseLine(std::string_view(lineBegin, size_t(lineEnd - lineBegin)), addAtom);
+			lineBegin = lineEnd + 1;
+		}
+
+		return continueLoading();
+	});
+
+	if (!atoms.empty())
+		m_atoms.push_back(std::move(atoms));
+
+	if (reader.columnCount() == 0)
+		globjects::warning() << "No _atom_site loop found in file!";
+
+	std::vector<mat4> instanceTransforms = cifAssemblyTransforms(reader.operators(), reader.assemblies());
+
+	if (!instanceTransforms.empty())
+		m_instanceTransforms = std::move(instanceTransforms);
+
+	return fileSize;
+}
+
+size_t Protein::loadBinaryCif(std::istream& file)
+{
+	PROFILE_ZONE("Protein::loadBinaryCif");
+
+	BinaryCif cif;
+
+	const bool loaded = cif.load(file, [this]() { return continueLoading(); });
+	const size_t fileSize = cif.size();
+
+	if (!loaded || !continueLoading())
+		return fileSize;
+
+	const BinaryCif::Category* atomSite = cif.category("_atom_site");
+
+	if (!atomSite)
+	{
+		globjects::warning() << "No _atom_site category found in file!";
+		return fileSize;
+	}
+
+	auto findColumn = [&](const char* name, const char* fallback) {
+		const BinaryCif::Column* column = cif.column("_atom_site", name);
+		return (column || !fallback) ? column : cif.column("_atom_site", fallback);
+	};
+
+	const size_t rowCount = atomSite->rowCount;
+	std::vector<float> x, y, z;
+	std::vector<int32_t> models;
+
+	const BinaryCif::Column* xColumn = findColumn("Cartn_x", nullptr);
+	const BinaryCif::Column* yColumn = findColumn("Cartn_y", nullptr);
+	const BinaryCif::Column* zColumn = findColumn("Cartn_z", nullptr);
+
+	if (!xColumn || !yColumn || !zColumn || !cif.decode(*xColumn, x) || !cif.decode(*yColumn, y) || !cif.decode(*zColumn, z) || x.size() != rowCount || y.size() != rowCount || z.size() != rowCount)
+	{
+		globjects::critical() << "Could not decode atom coordinates!";
+		return fileSize;
+	}
+
+	const BinaryCif::Column* modelColumn = findColumn("pdbx_PDB_model_num", nullptr);
+
+	if (!modelColumn || !cif.decode(*modelColumn, models) || models.size() != rowCount)
+		models.assign(rowCount, 1);
+
+	// strings are only looked up once per distinct value, rows just refer to them
+	auto decodeIds = [&](const BinaryCif::Column* column, const std::function<uint(std::string_view)>& lookup, std::vector<uint>& rowIds) {
+		BinaryCif::StringColumn strings;
+		rowIds.assign(rowCount, 0);
+
+		if (!column || !cif.decode(*column, strings) || strings.indices.size() != rowCount)
+			return;
+
+		std::vector<uint> stringIds(strings.strings.size());
+
+		for (size_t i = 0; i < stringIds.size(); i++)
+			stringIds[i] = lookup(strings.strings[i]);
+
+		for (size_t i = 0; i < rowCount; i++)
+			rowIds[i] = (strings.indices[i] >= 0) ? stringIds[strings.indices[i]] : 0;
+	};
+
+	std::vector<uint> elementIds, residueIds, chainIds;
+	decodeIds(findColumn("type_symbol", nullptr), cifElementId, elementIds);
+	decodeIds(findColumn("auth_comp_id", "label_comp_id"), [](std::string_view s) { return residueTable.find(s); }, residueIds);
+	decodeIds(findColumn("auth_asym_id", "label_asym_id"), [this](std::string_view s) { return chainId(s); }, chainIds);
+
+	std::vector<vec4> atoms;
+
+	for (size_t i = 0; i < rowCount; i++)
+	{
+		if (i % binaryCifRowBlockSize == 0 && !continueLoading())
+			return fileSize;
+
+		// every model of a multi-model entry becomes a timestep
+		if (i > 0 && models[i] != models[i - 1])
+		{
+			m_atoms.push_back(std::move(atoms));
+			atoms.clear();
+		}
+
+		const vec3 position(x[i], y[i], z[i]);
+		uint atomAttributes = elementIndex(elementIds[i]) | (residueIndex(residueIds[i]) << 8) | (chainIndex(chainIds[i]) << 16);
+		atoms.push_back(vec4(position, uintBitsToFloat(atomAttributes)));
+
+		m_minimumBounds = min(m_minimumBounds, position);
+		m_maximumBounds = max(m_maximumBounds, position);
+	}
+
+	if (!atoms.empty())
+		m_atoms.push_back(std::move(atoms));
+
+	CifTable operators, assemblies;
+
+	if (binaryCifTable(cif, "_pdbx_struct_oper_list", operators) && binaryCifTable(cif, "_pdbx_struct_assembly_gen", assemblies))
+	{
+		std::vector<mat4> instanceTransforms = cifAssemblyTransforms(operators, assemblies);
+
+		if (!instanceTransforms.empty())
+			m_instanceTransforms = std::move(instanceTransforms);
+	}
+
+	return fileSize;
 }
 
-// trim from end (in place)
-static inline void rtrim(std::string &s)
+void Protein::setCacheEnabled(bool enabled)
 {
-	s.erase(std::find_if(s.rbegin(), s.rend(), [](int ch) {
-		return !std::isspace(ch);
-	}).base(), s.end());
+	m_cacheEnabled = enabled;
 }
 
-// trim from both ends (in place)
-static inline void trim(std::string &s)
+bool Protein::isCacheEnabled() const
 {
-	ltrim(s);
-	rtrim(s);
+	return m_cacheEnabled;
 }
 
-// trim from start (copying)
-static inline std::string ltrim_copy(std::string s)
+void Protein::setQuantizationEnabled(bool enabled)
 {
-	ltrim(s);
-	return s;
+	m_quantizationEnabled = enabled;
 }
 
-// trim from end (copying)
-static inline std::string rtrim_copy(std::string s)
+bool Protein::isQuantizationEnabled() const
 {
-	rtrim(s);
-	return s;
+	return m_quantizationEnabled;
 }
 
-// trim from both ends (copying)
-static inline std::string trim_copy(std::string s)
+void Protein::setLazyLoadingEnabled(bool enabled)
 {
-	trim(s);
-	return s;
+	m_lazyLoadingEnabled = enabled;
 }
 
-Protein::Protein()
+bool Protein::isLazyLoadingEnabled() const
 {
+	return m_lazyLoadingEnabled;
+}
 
+const std::vector<mat4> & Protein::instanceTransforms() const
+{
+	return m_instanceTransforms;
 }
 
-Protein::Protein(const std::string& filename)
+void Protein::setAssemblyEnabled(bool enabled)
 {
-	load(filename);
+	m_assemblyEnabled = enabled;
 }
 
-void Protein::load(const std::string& filename)
+bool Protein::isAssemblyEnabled() const
 {
-	globjects::debug() << "Loading file " << filename << " ...";
-	std::ifstream file(filename);
+	return m_assemblyEnabled;
+}
 
-	if (!file.is_open())
+// Extends the bounds of the atoms to enclose all copies of the biological assembly
+void Protein::computeAssemblyBounds()
+{
+	m_minimumAssemblyBounds = m_minimumBounds;
+	m_maximumAssemblyBounds = m_maximumBounds;
+
+	if (m_instanceTransforms.size() <= 1 || m_atoms.empty())
+		return;
+
+	for (const auto& transform : m_instanceTransforms)
 	{
-		globjects::critical() << "Could not open file " << filename << "!";
+		for (uint corner = 0; corner < 8; corner++)
+		{
+			const vec3 position = mix(m_minimumBounds, m_maximumBounds, vec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1));
+			const vec3 transformedPosition = vec3(transform * vec4(position, 1.0f));
+
+			m_minimumAssemblyBounds = min(m_minimumAssemblyBounds, transformedPosition);
+			m_maximumAssemblyBounds = max(m_maximumAssemblyBounds, transformedPosition);
+		}
 	}
+}
 
-	m_filename = filename;
+bool Protein::hasPendingTimesteps() const
+{
+	return m_pendingTimesteps;
+}
 
-	m_atoms.clear();
-	m_minimumBounds = vec3(std::numeric_limits<float>::max());
-	m_maximumBounds = vec3(-std::numeric_limits<float>::max());
+float Protein::loadProgress() const
+{
+	return m_loadProgress;
+}
 
-	m_elementIdMap.fill(0);
-	m_residueIdMap.fill(0);
-	m_chainIdMap.fill(0);
+void Protein::cancelLoad()
+{
+	m_loadCancelled = true;
+}
 
-	m_activeElementIds.clear();
-	m_activeElementIds.push_back(0);
+bool Protein::isLoadCancelled() const
+{
+	return m_loadCancelled;
+}
 
-	m_activeResidueIds.clear();
-	m_activeResidueIds.push_back(0);
+// Called by the parsers after every block, returns false once loading has been cancelled
+bool Protein::continueLoading()
+{
+	if (m_loadSize > 0 && m_loadPosition)
+		m_loadProgress = std::min(1.0f, float(double(m_loadPosition()) / double(m_loadSize)));
 
-	m_activeChainIds.clear();
-	m_activeChainIds.push_back(0);
+	return !m_loadCancelled;
+}
 
-	std::string str;
-	uint elementCount = 1;
+bool Protein::isPdbFrameBoundary(const char* begin, const char* end)
+{
+	return isFrameBoundary(column(std::string_view(begin, size_t(end - begin)), 0, 6));
+}
 
-	std::vector<vec4> atoms;
+bool Protein::isPdbAtomRecord(const char* begin, const char* end)
+{
+	const std::string_view recordName = column(std::string_view(begin, size_t(end - begin)), 0, 6);
+	return recordName == "ATOM" || recordName == "HETATM";
+}
 
-	while (std::getline(file, str))
+void Protein::parsePdbPositions(const char* begin, const char* end, std::vector<vec3>& positions)
+{
+	positions.clear();
+	positions.reserve(size_t(end - begin) / 81);
+
+	const char* lineBegin = begin;
+
+	while (lineBegin < end)
 	{
-		//std::vector<std::string> tokens;
-		//std::istringstream buffer(str);
-		//std::copy(std::istream_iterator<std::string>(buffer), std::istream_iterator<std::string>(), std::back_inserter(tokens));
+		const char* lineEnd = std::find(lineBegin, end, '\n');
+		const std::string_view line(lineBegin, size_t(lineEnd - lineBegin));
+		lineBegin = lineEnd + 1;
+
+		const std::string_view recordName = column(line, 0, 6);
+
+		if (recordName == "ATOM" || recordName == "HETATM")
+			positions.push_back(vec3(parseCoordinate(column(line, 30, 8)), parseCoordinate(column(line, 38, 8)), parseCoordinate(column(line, 46, 8))));
+	}
+}
+
+bool Protein::isQuantized() const
+{
+	return !m_quantizedTimesteps.empty();
+}
+
+void Protein::setSpatialOrderingEnabled(bool enabled)
+{
+	m_spatialOrderingEnabled = enabled;
+}
+
+bool Protein::isSpatialOrderingEnabled() const
+{
+	return m_spatialOrderingEnabled;
+}
 
-		std::string recordName = trim_copy(str.substr(0, 6));
+const std::vector<uint>& Protein::atomOrder() const
+{
+	return m_atomOrder;
+}
+
+void Protein::reorder()
+{
+	PROFILE_ZONE("Protein::reorder");
 
-		if (recordName == "END")
+	if (m_atoms.empty() || m_atoms.front().size() < 2)
+		return;
+
+	// one order is used for all timesteps, so interpolating between two of them still pairs up the same atoms
+	const std::vector<vec4>& first = m_atoms.front();
+	const size_t atomCount = first.size();
+
+	for (const auto& timestep : m_atoms)
+	{
+		if (timestep.size() != atomCount)
 		{
-			m_atoms.push_back(atoms);
-			atoms.clear();
+			globjects::warning() << "Timesteps differ in their number of atoms, keeping the atoms in file order.";
+			return;
 		}
-		else if (recordName == "ATOM" || recordName == "HETATM")
+	}
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	std::vector<uint> codes;
+	MortonOrder::sort(first, codes, m_atomOrder);
+
+	const uint timestepThreadCount = parallelThreadCount(m_atoms.size());
+
+	runParallel(timestepThreadCount, [&](uint thread) {
+		std::vector<vec4> sorted;
+
+		for (size_t t = thread; t < m_atoms.size(); t += timestepThreadCount)
 		{
-			float x = float(std::atof(trim_copy(str.substr(30, 8)).c_str()));
-			float y = float(std::atof(trim_copy(str.substr(38, 8)).c_str()));
-			float z = float(std::atof(trim_copy(str.substr(46, 8)).c_str()));
+			sorted.resize(atomCount);
 
+			for (size_t i = 0; i < atomCount; i++)
+				sorted[i] = m_atoms[t][m_atomOrder[i]];
 
-			std::string residueName = trim_copy(str.substr(17, 3));
-			std::string chainName = trim_copy(str.substr(21, 1));
-			std::string elementName = trim_copy(str.substr(76, 2));
+			m_atoms[t].swap(sorted);
+		}
+	});
 
-			uint elementId = 0;
-			uint elementIndex = 0;
-			
-			auto ei = elementIds().find(elementName);
+	const double reorderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	globjects::debug() << "Sorted " << uint(atomCount) << " atoms of " << uint(m_atoms.size()) << " timesteps along a Morton curve in " << reorderTime << " s";
+}
 
-			if (ei != elementIds().end())
-				elementId = ei->second;
+void Protein::quantize()
+{
+	PROFILE_ZONE("Protein::quantize");
 
-			elementIndex = m_elementIdMap[elementId];
+	if (m_atoms.empty() || m_atoms.front().empty())
+		return;
 
-			if (elementIndex == 0)
-			{
-				elementIndex = uint(m_activeElementIds.size());
-				m_activeElementIds.push_back(elementId);				
-				m_elementIdMap[elementId] = elementIndex;
-			}
+	// attributes are stored once, so all timesteps need to contain the same atoms in the same order
+	const std::vector<vec4>& first = m_atoms.front();
 
-			uint residueId = 0;
-			uint residueIndex = 0;
+	for (const auto& timestep : m_atoms)
+	{
+		bool consistent = (timestep.size() == first.size());
 
-			auto ri = residueIds().find(residueName);
+		for (size_t i = 0; consistent && i < timestep.size(); i++)
+			consistent = (floatBitsToUint(timestep[i].w) == floatBitsToUint(first[i].w));
 
-			if (ri != residueIds().end())
-				residueId = ri->second;
+		if (!consistent)
+		{
+			globjects::warning() << "Timesteps differ in their atoms, keeping full precision coordinates.";
+			return;
+		}
+	}
 
-			residueIndex = m_residueIdMap[residueId];
+	m_atomAttributes.resize(first.size());
 
-			if (residueIndex == 0)
-			{
-				residueIndex = uint(m_activeResidueIds.size());
-				m_activeResidueIds.push_back(residueId);
-				m_residueIdMap[residueId] = residueIndex;
-			}
+	for (size_t i = 0; i < first.size(); i++)
+		m_atomAttributes[i] = floatBitsToUint(first[i].w);
 
-			uint chainId = 0;
-			uint chainIndex = 0;
+	m_quantizedTimesteps.resize(m_atoms.size());
+	std::vector<float> errors(m_atoms.size(), 0.0f);
 
-			auto ci = chainIds().find(chainName);
+	const uint threadCount = parallelThreadCount(m_atoms.size());
 
-			if (ci != chainIds().end())
-				chainId = ci->second;
+	runParallel(threadCount, [&](uint thread) {
+		for (size_t t = thread; t < m_atoms.size(); t += threadCount)
+		{
+			const std::vector<vec4>& atoms = m_atoms[t];
+			QuantizedTimestep& quantized = m_quantizedTimesteps[t];
 
-			chainIndex = m_chainIdMap[chainId];
+			vec3 minimum = vec3(std::numeric_limits<float>::max());
+			vec3 maximum = vec3(-std::numeric_limits<float>::max());
 
-			if (chainIndex == 0)
+			for (const auto& atom : atoms)
 			{
-				chainIndex = uint(m_activeChainIds.size());
-				m_activeChainIds.push_back(chainId);
-				m_chainIdMap[chainId] = chainIndex;
+				minimum = min(minimum, vec3(atom));
+				maximum = max(maximum, vec3(atom));
 			}
 
-			uint atomAttributes = elementIndex | (residueIndex << 8) | (chainIndex << 16);
-			vec4 atom(x, y, z, uintBitsToFloat(atomAttributes));
-			atoms.push_back(atom);
+			quantized.offset = atoms.empty() ? vec3(0.0f) : minimum;
+			quantized.extent = atoms.empty() ? vec3(0.0f) : maximum - minimum;
+			quantized.positions.resize(atoms.size());
 
-			m_minimumBounds = min(m_minimumBounds, vec3(atom));
-			m_maximumBounds = max(m_maximumBounds, vec3(atom));
+			const float steps = float(std::numeric_limits<uint16_t>::max());
+			const vec3 scale = vec3(steps) / max(quantized.extent, vec3(std::numeric_limits<float>::min()));
+
+			for (size_t i = 0; i < atoms.size(); i++)
+			{
+				const vec3 q = clamp(round((vec3(atoms[i]) - quantized.offset) * scale), vec3(0.0f), vec3(steps));
+				quantized.positions[i] = u16vec3(q);
+
+				const vec3 dequantized = quantized.offset + vec3(quantized.positions[i]) / steps * quantized.extent;
+				const vec3 error = abs(dequantized - vec3(atoms[i]));
+				errors[t] = std::max(errors[t], std::max(error.x, std::max(error.y, error.z)));
+			}
 		}
+	});
+
+	const double fullSize = double(m_atoms.size()) * double(first.size()) * sizeof(vec4);
+	const double quantizedSize = double(m_atoms.size()) * double(first.size()) * sizeof(u16vec3) + double(first.size()) * sizeof(uint);
+
+	globjects::debug() << "Quantized " << uint(m_atoms.size()) << " timesteps from " << fullSize / double(1 << 20) << " MB to " << quantizedSize / double(1 << 20) << " MB, maximum error " << *std::max_element(errors.begin(), errors.end()) << " Angstrom.";
+
+	// the first timestep stays available at full precision as topology
+	m_atoms.resize(1);
+}
+
+std::string Protein::cacheFilename(const std::string& filename)
+{
+	return filename + ".dynamol";
+}
+
+bool Protein::loadCache(const std::string& filename)
+{
+	PROFILE_ZONE("Protein::loadCache");
+
+	CacheHeader sourceHeader;
+
+	if (!cacheSourceStamp(filename, sourceHeader))
+		return false;
+
+	const std::string cacheName = cacheFilename(filename);
+	std::ifstream file(cacheName, std::ios::binary);
+
+	if (!file.is_open())
+		return false;
+
+	const auto startTime = std::chrono::steady_clock::now();
+
+	CacheHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+
+	if (!file || std::memcmp(header.magic, cacheMagic, sizeof(header.magic)) != 0 || header.version != cacheVersion)
+	{
+		globjects::debug() << "Ignoring cache file " << cacheName << " (unknown format).";
+		return false;
 	}
 
-	for (auto id : m_activeElementIds)
+	if (header.sourceSize != sourceHeader.sourceSize || header.sourceTime != sourceHeader.sourceTime || header.sourceHash != sourceHeader.sourceHash)
 	{
-		m_activeElementColors.push_back(elementColors()[id]);
-		m_activeElementRadii.push_back(elementRadii()[id]);
-		m_activeElementColorsRadiiPacked.push_back(vec4(elementColors()[id],elementRadii()[id]));
+		globjects::debug() << "Ignoring cache file " << cacheName << " (source file has changed).";
+		return false;
 	}
 
-	for (auto id : m_activeResidueIds)
+	if (header.elementCount > m_elementIdMap.size() || header.residueCount > m_residueIdMap.size() || header.chainCount > maximumChainCount || header.instanceCount == 0)
+		return false;
+
+	// every structure has at least the unknown element, a cache without elements or timesteps cannot describe any atoms
+	if (header.elementCount == 0 || header.timestepCount == 0)
 	{
-		m_activeResidueColors.push_back(residueColors()[id]);
-		m_activeResidueColorsPacked.push_back(vec4(residueColors()[id],1.0f));
+		globjects::debug() << "Ignoring cache file " << cacheName << " (empty structure).";
+		return false;
 	}
 
-	for (auto id : m_activeChainIds)
+	m_activeElementIds.resize(header.elementCount);
+	m_activeResidueIds.resize(header.residueCount);
+	m_activeChainIds.resize(header.chainCount);
+	m_activeElementColorsRadiiPacked.resize(header.elementCount);
+	m_activeResidueColorsPacked.resize(header.residueCount);
+	m_activeChainColorsPacked.resize(header.chainCount);
+
+	file.read(reinterpret_cast<char*>(m_activeElementIds.data()), m_activeElementIds.size() * sizeof(uint));
+	file.read(reinterpret_cast<char*>(m_activeResidueIds.data()), m_activeResidueIds.size() * sizeof(uint));
+	file.read(reinterpret_cast<char*>(m_activeChainIds.data()), m_activeChainIds.size() * sizeof(uint));
+
+	std::vector<uint64_t> chainNameKeys(header.chainCount);
+	file.read(reinterpret_cast<char*>(chainNameKeys.data()), chainNameKeys.size() * sizeof(uint64_t));
+
+	file.read(reinterpret_cast<char*>(m_activeElementColorsRadiiPacked.data()), m_activeElementColorsRadiiPacked.size() * sizeof(vec4));
+	file.read(reinterpret_cast<char*>(m_activeResidueColorsPacked.data()), m_activeResidueColorsPacked.size() * sizeof(vec4));
+	file.read(reinterpret_cast<char*>(m_activeChainColorsPacked.data()), m_activeChainColorsPacked.size() * sizeof(vec4));
+
+	m_instanceTransforms.resize(header.instanceCount);
+	file.read(reinterpret_cast<char*>(m_instanceTransforms.data()), m_instanceTransforms.size() * sizeof(mat4));
+
+	std::vector<CacheTimestep> timesteps(header.timestepCount);
+	file.read(reinterpret_cast<char*>(timesteps.data()), timesteps.size() * sizeof(CacheTimestep));
+
+	// reading the cache is reported as progress and can be cancelled like parsing
+	std::error_code error;
+	const auto cacheSize = std::filesystem::file_size(cacheName, error);
+	m_loadSize = error ? 0 : size_t(cacheSize);
+	m_loadPosition = [&]() { return size_t(std::max(std::streamoff(0), std::streamoff(file.tellg()))); };
+
+	// atom data is stored at page-aligned offsets and goes straight into the timestep arrays
+	m_atoms.resize(timesteps.size());
+
+	for (size_t i = 0; i < timesteps.size() && file && continueLoading(); i++)
 	{
-		m_activeChainColors.push_back(chainColors()[id]);
-		m_activeChainColorsPacked.push_back(vec4(chainColors()[id], 1.0f));
+		m_atoms[i].resize(size_t(timesteps[i].atomCount));
+		file.seekg(std::streamoff(timesteps[i].offset));
+		file.read(reinterpret_cast<char*>(m_atoms[i].data()), m_atoms[i].size() * sizeof(vec4));
 	}
 
+	m_loadPosition = nullptr;
 
-	for (uint i = 0; i < m_atoms.size(); i++)
+	if (!file || m_loadCancelled)
 	{
-		globjects::debug() << "  Timestep " << i << ": " << uint(m_atoms[i].size()) << " atoms";
+		if (!m_loadCancelled)
+			globjects::warning() << "Cache file " << cacheName << " is truncated, parsing source file instead.";
+
+		m_atoms.clear();
+		m_activeElementIds.assign(1, 0);
+		m_activeResidueIds.assign(1, 0);
+		m_activeChainIds.assign(1, 0);
+		m_activeElementColorsRadiiPacked.clear();
+		m_activeResidueColorsPacked.clear();
+		m_activeChainColorsPacked.clear();
+		m_instanceTransforms.assign(1, mat4(1.0f));
+		return false;
+	}
+
+	for (uint i = 0; i < m_activeElementIds.size(); i++)
+	{
+		if (i > 0 && m_activeElementIds[i] < m_elementIdMap.size())
+			m_elementIdMap[m_activeElementIds[i]] = i;
+
+		m_activeElementColors.push_back(vec3(m_activeElementColorsRadiiPacked[i]));
+		m_activeElementRadii.push_back(m_activeElementColorsRadiiPacked[i].w);
+	}
+
+	for (uint i = 0; i < m_activeResidueIds.size(); i++)
+	{
+		if (i > 0 && m_activeResidueIds[i] < m_residueIdMap.size())
+			m_residueIdMap[m_activeResidueIds[i]] = i;
+
+		m_activeResidueColors.push_back(vec3(m_activeResidueColorsPacked[i]));
+	}
+
+	for (uint i = 0; i < m_activeChainIds.size(); i++)
+	{
+		if (i > 0)
+		{
+			if (m_activeChainIds[i] >= m_chainIdMap.size())
+				m_chainIdMap.resize(m_activeChainIds[i] + 1, 0);
+
+			m_chainIdMap[m_activeChainIds[i]] = i;
+		}
+
+		if (m_activeChainIds[i] >= firstChainNameId)
+		{
+			const uint nameIndex = m_activeChainIds[i] - firstChainNameId;
+
+			if (nameIndex >= m_chainNames.size())
+				m_chainNames.resize(nameIndex + 1, "?");
+
+			m_chainNames[nameIndex] = chainNameFromKey(chainNameKeys[i]);
+			m_chainNameIds[chainNameKeys[i]] = m_activeChainIds[i];
+		}
+
+		m_activeChainColors.push_back(vec3(m_activeChainColorsPacked[i]));
 	}
 
+	m_minimumBounds = header.minimumBounds;
+	m_maximumBounds = header.maximumBounds;
+
+	const double loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	const double megabytes = double(file.tellg()) / double(1 << 20);
+
+	globjects::debug() << "Read " << megabytes << " MB from cache file " << cacheName << " in " << loadTime << " s (" << megabytes / std::max(loadTime, 1e-6) << " MB/s)";
 	globjects::debug() << uint(m_atoms.size()) << " timesteps loaded." << std::endl;
+
+	return true;
+}
+
+void Protein::saveCache(const std::string& filename) const
+{
+	PROFILE_ZONE("Protein::saveCache");
+
+	if (m_atoms.empty() || m_atoms.front().empty())
+		return;
+
+	CacheHeader header;
+
+	if (!cacheSourceStamp(filename, header))
+		return;
+
+	const std::string cacheName = cacheFilename(filename);
+	const std::string temporaryName = cacheName + ".tmp";
+	std::ofstream file(temporaryName, std::ios::binary | std::ios::trunc);
+
+	if (!file.is_open())
+	{
+		globjects::debug() << "Could not write cache file " << cacheName << ".";
+		return;
+	}
+
+	std::memcpy(header.magic, cacheMagic, sizeof(header.magic));
+	header.version = cacheVersion;
+	header.timestepCount = uint32_t(m_atoms.size());
+	header.elementCount = uint32_t(m_activeElementIds.size());
+	header.residueCount = uint32_t(m_activeResidueIds.size());
+	header.chainCount = uint32_t(m_activeChainIds.size());
+	header.instanceCount = uint32_t(m_instanceTransforms.size());
+	header.minimumBounds = m_minimumBounds;
+	header.maximumBounds = m_maximumBounds;
+
+	uint64_t offset = sizeof(header);
+	offset += (m_activeElementIds.size() + m_activeResidueIds.size() + m_activeChainIds.size()) * sizeof(uint);
+	offset += m_activeChainIds.size() * sizeof(uint64_t);
+	offset += (m_activeElementColorsRadiiPacked.size() + m_activeResidueColorsPacked.size() + m_activeChainColorsPacked.size()) * sizeof(vec4);
+	offset += m_instanceTransforms.size() * sizeof(mat4);
+	offset += m_atoms.size() * sizeof(CacheTimestep);
+
+	std::vector<CacheTimestep> timesteps;
+
+	// names of the chains that are not in the table, stored as their keys and zero for the others
+	std::vector<uint64_t> chainNameKeys;
+
+	for (auto id : m_activeChainIds)
+		chainNameKeys.push_back(id >= firstChainNameId ? chainNameKey(chainName(id)) : 0);
+
+	for (const auto& atoms : m_atoms)
+	{
+		offset = (offset + cacheAlignment - 1) / cacheAlignment * cacheAlignment;
+		timesteps.push_back({ offset, atoms.size() });
+		offset += atoms.size() * sizeof(vec4);
+	}
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(m_activeElementIds.data()), m_activeElementIds.size() * sizeof(uint));
+	file.write(reinterpret_cast<const char*>(m_activeResidueIds.data()), m_activeResidueIds.size() * sizeof(uint));
+	file.write(reinterpret_cast<const char*>(m_activeChainIds.data()), m_activeChainIds.size() * sizeof(uint));
+	file.write(reinterpret_cast<const char*>(chainNameKeys.data()), chainNameKeys.size() * sizeof(uint64_t));
+	file.write(reinterpret_cast<const char*>(m_activeElementColorsRadiiPacked.data()), m_activeElementColorsRadiiPacked.size() * sizeof(vec4));
+	file.write(reinterpret_cast<const char*>(m_activeResidueColorsPacked.data()), m_activeResidueColorsPacked.size() * sizeof(vec4));
+	file.write(reinterpret_cast<const char*>(m_activeChainColorsPacked.data()), m_activeChainColorsPacked.size() * sizeof(vec4));
+	file.write(reinterpret_cast<const char*>(m_instanceTransforms.data()), m_instanceTransforms.size() * sizeof(mat4));
+	file.write(reinterpret_cast<const char*>(timesteps.data()), timesteps.size() * sizeof(CacheTimestep));
+
+	for (size_t i = 0; i < m_atoms.size(); i++)
+	{
+		const std::vector<char> padding(size_t(timesteps[i].offset - uint64_t(file.tellp())), 0);
+		file.write(padding.data(), padding.size());
+		file.write(reinterpret_cast<const char*>(m_atoms[i].data()), m_atoms[i].size() * sizeof(vec4));
+	}
+
+	file.close();
+
+	std::error_code error;
+
+	if (file.fail())
+	{
+		globjects::debug() << "Could not write cache file " << cacheName << ".";
+		std::filesystem::remove(temporaryName, error);
+		return;
+	}
+
+	std::filesystem::rename(temporaryName, cacheName, error);
+
+	if (error)
+	{
+		globjects::debug() << "Could not write cache file " << cacheName << ".";
+		std::filesystem::remove(temporaryName, error);
+		return;
+	}
+
+	globjects::debug() << "Wrote cache file " << cacheName << ".";
 }
 
 const std::string & Protein::filename() const
@@ -226,19 +2290,109 @@ const std::string & Protein::filename() const
 	return m_filename;
 }
 
+uint Protein::elementIndex(uint elementId)
+{
+	uint index = m_elementIdMap[elementId];
+
+	if (index == 0)
+	{
+		index = uint(m_activeElementIds.size());
+		m_activeElementIds.push_back(elementId);
+		m_elementIdMap[elementId] = index;
+	}
+
+	return index;
+}
+
+uint Protein::residueIndex(uint residueId)
+{
+	uint index = m_residueIdMap[residueId];
+
+	if (index == 0)
+	{
+		index = uint(m_activeResidueIds.size());
+		m_activeResidueIds.push_back(residueId);
+		m_residueIdMap[residueId] = index;
+	}
+
+	return index;
+}
+
+uint Protein::chainIndex(uint chainId)
+{
+	if (chainId >= m_chainIdMap.size())
+		m_chainIdMap.resize(chainId + 1, 0);
+
+	uint index = m_chainIdMap[chainId];
+
+	// the index is stored in 8 bits of the attributes, further chains share the index of unknown chains
+	if (index == 0 && m_activeChainIds.size() < maximumChainCount)
+	{
+		index = uint(m_activeChainIds.size());
+		m_activeChainIds.push_back(chainId);
+		m_chainIdMap[chainId] = index;
+	}
+
+	return index;
+}
+
+uint Protein::chainId(std::string_view name)
+{
+	const uint id = chainTable.find(name);
+
+	if (id != 0 || name.empty() || name.size() > maximumChainNameLength)
+		return id;
+
+	const auto result = m_chainNameIds.emplace(chainNameKey(name), firstChainNameId + uint(m_chainNames.size()));
+
+	if (result.second)
+		m_chainNames.emplace_back(name);
+
+	return result.first->second;
+}
+
+std::string Protein::chainName(uint chainId) const
+{
+	if (chainId >= firstChainNameId)
+		return chainId - firstChainNameId < m_chainNames.size() ? m_chainNames[chainId - firstChainNameId] : "?";
+
+	for (const auto& i : chainIds())
+	{
+		if (i.second == chainId)
+			return i.first;
+	}
+
+	return "?";
+}
+
 const std::vector< std::vector<glm::vec4> > & Protein::atoms() const
 {
 	return m_atoms;
 }
 
+glm::uint Protein::timestepCount() const
+{
+	return isQuantized() ? uint(m_quantizedTimesteps.size()) : uint(m_atoms.size());
+}
+
+const std::vector<Protein::QuantizedTimestep> & Protein::quantizedTimesteps() const
+{
+	return m_quantizedTimesteps;
+}
+
+const std::vector<glm::uint> & Protein::atomAttributes() const
+{
+	return m_atomAttributes;
+}
+
 vec3 Protein::minimumBounds() const
 {
-	return m_minimumBounds;
+	return m_assemblyEnabled ? m_minimumAssemblyBounds : m_minimumBounds;
 }
 
 vec3 Protein::maximumBounds() const
 {
-	return m_maximumBounds;
+	return m_assemblyEnabled ? m_maximumAssemblyBounds : m_maximumBounds;
 }
 
 const std::vector<glm::vec4>& Protein::activeElementColorsRadiiPacked() const
@@ -293,124 +2447,7 @@ const std::vector<glm::vec3>& dynamol::Protein::activeChainColors() const
 
 const std::unordered_map<std::string, uint>& dynamol::Protein::elementIds()
 {
-	static const std::unordered_map<std::string, uint> elementIds = {
-		{"H",1},
-		{"He",2},
-		{"Li",3},
-		{"Be",4},
-		{"B",5},
-		{"C",6},
-		{"N",7},
-		{"O",8},
-		{"F",9},
-		{"Ne",10},
-		{"Na",11},
-		{"Mg",12},
-		{"Al",13},
-		{"Si",14},
-		{"P",15},
-		{"S",16},
-		{"Cl",17},
-		{"Ar",18},
-		{"K",19},
-		{"Ca",20},
-		{"Sc",21},
-		{"Ti",22},
-		{"V",23},
-		{"Cr",24},
-		{"Mn",25},
-		{"Fe",26},
-		{"Co",27},
-		{"Ni",28},
-		{"Cu",29},
-		{"Zn",30},
-		{"Ga",31},
-		{"Ge",32},
-		{"As",33},
-		{"Se",34},
-		{"Br",35},
-		{"Kr",36},
-		{"Rb",37},
-		{"Sr",38},
-		{"Y",39},
-		{"Zr",40},
-		{"Nb",41},
-		{"Mo",42},
-		{"Tc",43},
-		{"Ru",44},
-		{"Rh",45},
-		{"Pd",46},
-		{"Ag",47},
-		{"Cd",48},
-		{"In",49},
-		{"Sn",50},
-		{"Sb",51},
-		{"Te",52},
-		{"I",53},
-		{"Xe",54},
-		{"Cs",55},
-		{"Ba",56},
-		{"La",57},
-		{"Ce",58},
-		{"Pr",59},
-		{"Nd",60},
-		{"Pm",61},
-		{"Sm",62},
-		{"Eu",63},
-		{"Gd",64},
-		{"Tb",65},
-		{"Dy",66},
-		{"Ho",67},
-		{"Er",68},
-		{"Tm",69},
-		{"Yb",70},
-		{"Lu",71},
-		{"Hf",72},
-		{"Ta",73},
-		{"W",74},
-		{"Re",75},
-		{"Os",76},
-		{"Ir",77},
-		{"Pt",78},
-		{"Au",79},
-		{"Hg",80},
-		{"Tl",81},
-		{"Pb",82},
-		{"Bi",83},
-		{"Po",84},
-		{"At",85},
-		{"Rn",86},
-		{"Fr",87},
-		{"Ra",88},
-		{"Ac",89},
-		{"Th",90},
-		{"Pa",91},
-		{"U",92},
-		{"Np",93},
-		{"Pu",94},
-		{"Am",95},
-		{"Cm",96},
-		{"Bk",97},
-		{"Cf",98},
-		{"Es",99},
-		{"Fm",100},
-		{"Md",101},
-		{"No",102},
-		{"Lr",103},
-		{"Rf",104},
-		{"Db",105},
-		{"Sg",106},
-		{"Bh",107},
-		{"Hs",108},
-		{"Mt",109},
-		{"Ds",110},
-		{"Rg",111},
-		{"Cn",112},
-		{"H (WAT)",113},
-		{"O (WAT)",114},
-		{"D",115 }
-	};
-
+	static const std::unordered_map<std::string, uint> elementIds = makeIdMap(elementCodes);
 	return elementIds;
 }
 
@@ -664,33 +2701,8 @@ const std::array<vec3, 116>& Protein::elementColors()
 
 const std::unordered_map<std::string, uint>& Protein::residueIds()
 {
-	static const std::unordered_map<std::string, uint> residueColors = {
-		{"ALA",1},
-		{"ARG",2},
-		{"ASN",3},
-		{"ASP",4},
-		{"CYS",5},
-		{"GLN",6},
-		{"GLU",7},
-		{"GLY",8},
-		{"HIS",9},
-		{"ILE",10},
-		{"LEU",11},
-		{"LYS",12},
-		{"MET",13},
-		{"PHE",14},
-		{"PRO",15},
-		{"SER",16},
-		{"THR",17},
-		{"TRP",18},
-		{"TYR",19},
-		{"VAL",20},
-		{"ASX",21},
-		{"GLX",22},
-		{"other",23 }
-	};
-	
-	return residueColors;
+	static const std::unordered_map<std::string, uint> residueIds = makeIdMap(residueCodes);
+	return residueIds;
 }
 
 const std::array<vec3, 24>& Protein::residueColors()
@@ -727,72 +2739,7 @@ const std::array<vec3, 24>& Protein::residueColors()
 
 const std::unordered_map<std::string, uint>& Protein::chainIds()
 {
-	static const std::unordered_map<std::string, uint> chainIds = {
-		{"A",1},
-		{"a",2},
-		{"B",3},
-		{"b",4},
-		{"C",5},
-		{"c",6},
-		{"D",7},
-		{"d",8},
-		{"E",9},
-		{"e",10},
-		{"F",11},
-		{"f",12},
-		{"G",13},
-		{"g",14},
-		{"H",15},
-		{"h",16},
-		{"I",17},
-		{"i",18},
-		{"J",19},
-		{"j",20},
-		{"K",21},
-		{"k",22},
-		{"L",23},
-		{"l",24},
-		{"M",25},
-		{"m",26},
-		{"N",27},
-		{"n",28},
-		{"O",29},
-		{"o",30},
-		{"P",31},
-		{"p",32},
-		{"0",33},
-		{"Q",34},
-		{"q",35},
-		{"1",36},
-		{"R",37},
-		{"r",38},
-		{"2",39},
-		{"S",40},
-		{"s",41},
-		{"3",42},
-		{"T",43},
-		{"t",44},
-		{"4",45},
-		{"U",46},
-		{"u",47},
-		{"5",48},
-		{"V",49},
-		{"v",50},
-		{"6",51},
-		{"W",52},
-		{"w",53},
-		{"7",54},
-		{"X",55},
-		{"x",56},
-		{"8",57},
-		{"Y",58},
-		{"y",59},
-		{"9",60},
-		{"Z",61},
-		{"z",62},
-		{"none",63}
-	};
-
+	static const std::unordered_map<std::string, uint> chainIds = makeIdMap(chainCodes);
 	return chainIds;
 }
 
@@ -2,10 +2,16 @@
 
 #include <vector>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include <unordered_map>
 #include <vector>
 #include <array>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <istream>
+#include <atomic>
+#include <functional>
 
 namespace dynamol
 {
@@ -19,12 +25,66 @@ namespace dynamol
 
 	public:
 
+		// Positions of one timestep as 16 bit fixed point numbers relative to the bounds of the timestep
+		// The error is at most half a step, i.e. extent / 131070 along each axis
+		struct QuantizedTimestep
+		{
+			glm::vec3 offset = glm::vec3(0.0f);
+			glm::vec3 extent = glm::vec3(0.0f);
+			std::vector<glm::u16vec3> positions;
+		};
+
 		Protein();
 		Protein(const std::string& filename);
 		void load(const std::string& filename);
 		const std::string & filename() const;
 
+		void setCacheEnabled(bool enabled);
+		bool isCacheEnabled() const;
+		static std::string cacheFilename(const std::string& filename);
+
+		// Quantized proteins only keep the first timestep in atoms(), all timesteps are in quantizedTimesteps()
+		void setQuantizationEnabled(bool enabled);
+		bool isQuantizationEnabled() const;
+		bool isQuantized() const;
+
+		// Spatially ordered proteins sort the atoms of all timesteps along a Morton curve through the first timestep
+		// The order maps each atom to its index in the file, it is empty if the atoms are in file order
+		void setSpatialOrderingEnabled(bool enabled);
+		bool isSpatialOrderingEnabled() const;
+		const std::vector<glm::uint> & atomOrder() const;
+
+		// Lazily loaded PDB files only parse their first timestep, the remaining ones can be streamed with a PdbTrajectory
+		// Compressed and mmCIF files cannot be indexed and are always loaded entirely
+		void setLazyLoadingEnabled(bool enabled);
+		bool isLazyLoadingEnabled() const;
+		bool hasPendingTimesteps() const;
+
+		// Fraction of the file read by a load() running on another thread
+		float loadProgress() const;
+
+		// Makes a load() running on another thread stop after the current block, the protein is then left incomplete
+		void cancelLoad();
+		bool isLoadCancelled() const;
+
+		// PDB record helpers shared with PdbTrajectory, positions are parsed exactly like load() does
+		// Frames end at MODEL, ENDMDL and END records and at the end of the file, frames without atoms are skipped
+		static bool isPdbFrameBoundary(const char* begin, const char* end);
+		static bool isPdbAtomRecord(const char* begin, const char* end);
+		static void parsePdbPositions(const char* begin, const char* end, std::vector<glm::vec3>& positions);
+
 		const std::vector < std::vector<glm::vec4> > & atoms() const;
+		glm::uint timestepCount() const;
+		const std::vector<QuantizedTimestep> & quantizedTimesteps() const;
+		const std::vector<glm::uint> & atomAttributes() const;
+
+		// Transforms of the copies of the atoms that make up the biological assembly (REMARK 350 BIOMT or _pdbx_struct_oper_list)
+		// Contains just the identity if the file does not describe an assembly
+		const std::vector<glm::mat4> & instanceTransforms() const;
+
+		// Whether all copies of the assembly are shown, the bounds then enclose all of them instead of just the atoms
+		void setAssemblyEnabled(bool enabled);
+		bool isAssemblyEnabled() const;
 		const std::vector<Element> & elements() const;
 		glm::vec3 minimumBounds() const;
 		glm::vec3 maximumBounds() const;
@@ -37,6 +97,9 @@ namespace dynamol
 		const std::vector<glm::uint> & activeResidueIds() const;
 		const std::vector<glm::uint> & activeChainIds() const;
 
+		// The identifier a chain id stands for in this structure, "?" if unknown
+		std::string chainName(glm::uint chainId) const;
+
 		const std::vector<float> & activeElementRadii() const;
 		const std::vector<glm::vec3> & activeElementColors() const;
 		const std::vector<glm::vec3> & activeResidueColors() const;
@@ -54,12 +117,48 @@ namespace dynamol
 
 	private:
 
+		glm::uint elementIndex(glm::uint elementId);
+		glm::uint residueIndex(glm::uint residueId);
+		glm::uint chainIndex(glm::uint chainId);
+
+		// Single character chain identifiers have fixed ids, longer ones are numbered in the order they appear in the structure
+		glm::uint chainId(std::string_view name);
+
+		bool continueLoading();
+
+		size_t loadPdb(std::istream& file, bool firstTimestepOnly);
+		size_t loadCif(std::istream& file);
+		size_t loadBinaryCif(std::istream& file);
+
+		void reorder();
+		void quantize();
+		void computeAssemblyBounds();
+
+		bool loadCache(const std::string& filename);
+		void saveCache(const std::string& filename) const;
+
 		std::string m_filename;
+		bool m_cacheEnabled = true;
+		bool m_quantizationEnabled = false;
+		bool m_spatialOrderingEnabled = false;
+		bool m_lazyLoadingEnabled = false;
+		bool m_assemblyEnabled = true;
+		bool m_pendingTimesteps = false;
+		std::atomic<float> m_loadProgress = { 0.0f };
+		std::atomic<bool> m_loadCancelled = { false };
+		std::function<size_t()> m_loadPosition;
+		size_t m_loadSize = 0;
 		std::vector<std::vector<glm::vec4> > m_atoms;
+		std::vector<QuantizedTimestep> m_quantizedTimesteps;
+		std::vector<glm::uint> m_atomAttributes;
+		std::vector<glm::uint> m_atomOrder;
+		std::vector<glm::mat4> m_instanceTransforms = { glm::mat4(1.0f) };
 
 		std::array<glm::uint, 116> m_elementIdMap;
 		std::array<glm::uint, 24> m_residueIdMap;
-		std::array<glm::uint, 64> m_chainIdMap;
+		std::vector<glm::uint> m_chainIdMap;
+		std::unordered_map<std::uint64_t, glm::uint> m_chainNameIds;
+		std::vector<std::string> m_chainNames;
 
 		std::vector<glm::uint> m_activeElementIds;
 		std::vector<glm::uint> m_activeResidueIds;
@@ -76,5 +175,7 @@ namespace dynamol
 
 		glm::vec3 m_minimumBounds = glm::vec3(0.0);
 		glm::vec3 m_maximumBounds = glm::vec3(0.0);
+		glm::vec3 m_minimumAssemblyBounds = glm::vec3(0.0);
+		glm::vec3 m_maximumAssemblyBounds = glm::vec3(0.0);
 	};
 }
\ No newline at end of file
@@ -0,0 +1,103 @@
+#include "ReadbackBuffer.h"
+
+#include <algorithm>
+
+#include <glbinding/gl/enum.h>
+#include <glbinding/gl/functions.h>
+
+using namespace dynamol;
+using namespace gl;
+using namespace glm;
+using namespace globjects;
+
+ReadbackBuffer::ReadbackBuffer(GLsizeiptr size, uint ringSize) : m_size(size)
+{
+	m_slots.resize(std::max(ringSize, 1u));
+
+	// coherent mappings make the data visible to the CPU as soon as the fence has been passed
+	for (auto& slot : m_slots)
+	{
+		slot.buffer = Buffer::create();
+		slot.buffer->setStorage(size, nullptr, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+		slot.data = slot.buffer->mapRange(0, size, GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT);
+	}
+}
+
+ReadbackBuffer::~ReadbackBuffer()
+{
+	for (auto& slot : m_slots)
+	{
+		if (slot.fence)
+			glDeleteSync(slot.fence);
+
+		slot.buffer->unmap();
+	}
+}
+
+Buffer* ReadbackBuffer::begin()
+{
+	Slot& slot = m_slots[m_next];
+
+	if (slot.fence)
+	{
+		const GLenum result = glClientWaitSync(slot.fence, GL_NONE_BIT, 0);
+
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			return nullptr;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+	}
+
+	m_current = m_next;
+	return slot.buffer.get();
+}
+
+void ReadbackBuffer::end()
+{
+	if (m_current >= m_slots.size())
+		return;
+
+	// shader writes into the buffer have to reach the mapping as well
+	glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+
+	Slot& slot = m_slots[m_current];
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, GL_NONE_BIT);
+	slot.frame = ++m_frame;
+
+	m_next = (m_current + 1) % uint(m_slots.size());
+	m_current = ~0u;
+}
+
+const void* ReadbackBuffer::read()
+{
+	const void* data = nullptr;
+	std::uint64_t latestFrame = 0;
+
+	for (auto& slot : m_slots)
+	{
+		if (!slot.fence)
+			continue;
+
+		const GLenum result = glClientWaitSync(slot.fence, GL_NONE_BIT, 0);
+
+		if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED)
+			continue;
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+
+		if (slot.frame > latestFrame)
+		{
+			latestFrame = slot.frame;
+			data = slot.data;
+		}
+	}
+
+	return data;
+}
+
+GLsizeiptr ReadbackBuffer::size() const
+{
+	return m_size;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glbinding/gl/gl.h>
+#include <globjects/Buffer.h>
+
+namespace dynamol
+{
+	// Ring of persistently mapped buffers for reading back data from the GPU without stalling the pipeline
+	// Every frame copies into the next buffer of the ring, which is fenced afterwards, and the data of a copy becomes readable once its fence has been passed,
+	// usually one or two frames later
+	class ReadbackBuffer
+	{
+	public:
+		ReadbackBuffer(gl::GLsizeiptr size, glm::uint ringSize = 3);
+		~ReadbackBuffer();
+
+		// Buffer that the commands of this frame should copy into, e.g. bound as GL_PIXEL_PACK_BUFFER for glReadPixels
+		// Returns nullptr if the copy into the next buffer is still in flight, the frame then has to be skipped
+		globjects::Buffer* begin();
+
+		// Fences the commands issued since begin()
+		void end();
+
+		// Data of the most recent copy that has completed, or nullptr if no copy has completed since the last call
+		// The data stays valid until the next call of begin()
+		const void* read();
+
+		gl::GLsizeiptr size() const;
+
+	private:
+		struct Slot
+		{
+			std::unique_ptr<globjects::Buffer> buffer;
+			const void* data = nullptr;
+			gl::GLsync fence = nullptr;
+			std::uint64_t frame = 0;
+		};
+
+		gl::GLsizeiptr m_size = 0;
+		std::vector<Slot> m_slots;
+		glm::uint m_next = 0;
+		glm::uint m_current = ~0u;
+		std::uint64_t m_frame = 0;
+	};
+}
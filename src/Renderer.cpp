@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "Profiler.h"
 #include <globjects/base/File.h>
 #include <globjects/State.h>
 #include <iostream>
@@ -32,6 +33,8 @@ bool Renderer::isEnabled() const
 
 void Renderer::reloadShaders()
 {
+	PROFILE_ZONE("Renderer::reloadShaders");
+
 	for (auto& p : m_shaderPrograms)
 	{
 		globjects::debug() << "Reloading shader program " << p.first << " ...";
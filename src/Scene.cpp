@@ -1,15 +1,237 @@
 #include "Scene.h"
 #include "Protein.h"
+#include "Trajectory.h"
+#include "TrajectoryStream.h"
+#include "UniformGrid.h"
+#include "BoundingVolumeHierarchy.h"
+#include "LevelOfDetail.h"
+#include "Profiler.h"
 #include <iostream>
+#include <limits>
+#include <globjects/logging.h>
 
 using namespace dynamol;
+using namespace glm;
 
 Scene::Scene()
 {
 	m_protein = std::make_unique<Protein>();
 }
 
+Scene::~Scene()
+{
+	cancelLoading();
+
+	if (m_loadingThread.joinable())
+		m_loadingThread.join();
+}
+
 Protein * Scene::protein()
 {
 	return m_protein.get();
-}
\ No newline at end of file
+}
+
+void Scene::load(const std::string& filename, const std::string& trajectoryFilename)
+{
+	// a load that is still running is abandoned, it stops after its current block
+	cancelLoading();
+
+	if (m_loadingThread.joinable())
+		m_loadingThread.join();
+
+	m_loadingProtein = std::make_unique<Protein>();
+	m_loadingProtein->setCacheEnabled(m_protein->isCacheEnabled());
+	m_loadingProtein->setQuantizationEnabled(m_protein->isQuantizationEnabled());
+	m_loadingProtein->setLazyLoadingEnabled(m_protein->isLazyLoadingEnabled());
+	m_loadingProtein->setSpatialOrderingEnabled(m_protein->isSpatialOrderingEnabled());
+	m_loadingProtein->setAssemblyEnabled(m_protein->isAssemblyEnabled());
+	m_loadingTrajectory.reset();
+	m_loadingFilename = filename;
+	m_loadingFinished = false;
+
+	m_loadingThread = std::thread([this, filename, trajectoryFilename]() {
+		Profiler::setThreadName("Loader");
+		m_loadingProtein->load(filename);
+
+		if (!m_loadingProtein->isLoadCancelled() && !m_loadingProtein->atoms().empty())
+		{
+			// lazily loaded files stream their remaining timesteps from the file itself
+			if (!trajectoryFilename.empty())
+				m_loadingTrajectory = openTrajectory(trajectoryFilename, *m_loadingProtein);
+			else if (m_loadingProtein->hasPendingTimesteps())
+				m_loadingTrajectory = openTrajectory(filename, *m_loadingProtein);
+		}
+
+		m_loadingFinished = true;
+	});
+}
+
+void Scene::cancelLoading()
+{
+	if (m_loadingProtein)
+		m_loadingProtein->cancelLoad();
+}
+
+bool Scene::isLoading() const
+{
+	return m_loadingThread.joinable();
+}
+
+float Scene::loadingProgress() const
+{
+	return m_loadingProtein ? m_loadingProtein->loadProgress() : 0.0f;
+}
+
+const std::string& Scene::loadingFilename() const
+{
+	return m_loadingFilename;
+}
+
+bool Scene::update()
+{
+	if (!m_loadingThread.joinable() || !m_loadingFinished)
+		return false;
+
+	m_loadingThread.join();
+
+	std::unique_ptr<Protein> protein = std::move(m_loadingProtein);
+	std::unique_ptr<TrajectoryStream> trajectory = std::move(m_loadingTrajectory);
+
+	if (protein->isLoadCancelled())
+		return false;
+
+	if (protein->atoms().empty())
+	{
+		globjects::critical() << "No atoms found in " << m_loadingFilename << "!";
+		return false;
+	}
+
+	m_trajectory = std::move(trajectory);
+	m_protein = std::move(protein);
+	m_loadCount++;
+
+	return true;
+}
+
+size_t Scene::loadCount() const
+{
+	return m_loadCount;
+}
+
+TrajectoryStream * Scene::trajectory()
+{
+	return m_trajectory.get();
+}
+
+const UniformGrid* Scene::atomGrid(uint timestep)
+{
+	const bool loaded = (m_atomGridLoadCount == m_loadCount);
+
+	if (loaded && timestep == m_atomGridTimestep)
+		return m_atomGrid.get();
+
+	const std::vector<vec4>* atoms = timestepAtoms(timestep);
+
+	if (!atoms)
+		return nullptr;
+
+	if (!m_atomGrid)
+		m_atomGrid = std::make_unique<UniformGrid>();
+
+	if (loaded)
+		m_atomGrid->update(*atoms);
+	else
+		m_atomGrid->build(*atoms);
+
+	m_atomGridTimestep = timestep;
+	m_atomGridLoadCount = m_loadCount;
+
+	return m_atomGrid.get();
+}
+
+const BoundingVolumeHierarchy* Scene::atomHierarchy(uint timestep)
+{
+	const bool loaded = (m_atomHierarchyLoadCount == m_loadCount);
+
+	if (loaded && timestep == m_atomHierarchyTimestep)
+		return m_atomHierarchy.get();
+
+	const std::vector<vec4>* atoms = timestepAtoms(timestep);
+
+	if (!atoms)
+		return nullptr;
+
+	if (!m_atomHierarchy)
+		m_atomHierarchy = std::make_unique<BoundingVolumeHierarchy>();
+
+	// the tree is built once per protein, later timesteps only move the bounds
+	if (loaded)
+		m_atomHierarchy->refit(*atoms);
+	else
+		m_atomHierarchy->build(*atoms, m_protein->activeElementRadii());
+
+	m_atomHierarchyTimestep = timestep;
+	m_atomHierarchyLoadCount = m_loadCount;
+
+	return m_atomHierarchy.get();
+}
+
+const LevelOfDetail* Scene::levelOfDetail()
+{
+	if (m_levelOfDetailLoadCount == m_loadCount)
+		return m_levelOfDetail.get();
+
+	if (m_protein->atoms().empty())
+		return nullptr;
+
+	if (!m_levelOfDetail)
+		m_levelOfDetail = std::make_unique<LevelOfDetail>();
+
+	m_levelOfDetail->build(m_protein->atoms().front(), m_protein->atomOrder(), m_protein->activeElementRadii());
+	m_levelOfDetailLoadCount = m_loadCount;
+
+	return m_levelOfDetail.get();
+}
+
+// Atoms of a timestep or trajectory frame, nullptr if the frame has not been decoded yet
+const std::vector<vec4>* Scene::timestepAtoms(uint timestep)
+{
+	if (m_trajectory)
+		return m_trajectory->frame(timestep);
+
+	if (m_protein->isQuantized())
+	{
+		// quantized timesteps are expanded into a temporary copy
+		const auto& quantizedTimestep = m_protein->quantizedTimesteps()[timestep % m_protein->quantizedTimesteps().size()];
+		const auto& attributes = m_protein->atomAttributes();
+		const float steps = float(std::numeric_limits<uint16_t>::max());
+
+		m_timestepAtoms.resize(quantizedTimestep.positions.size());
+
+		for (size_t i = 0; i < m_timestepAtoms.size(); i++)
+			m_timestepAtoms[i] = vec4(quantizedTimestep.offset + vec3(quantizedTimestep.positions[i]) / steps * quantizedTimestep.extent, uintBitsToFloat(attributes[i]));
+
+		return &m_timestepAtoms;
+	}
+
+	if (m_protein->atoms().empty())
+		return nullptr;
+
+	return &m_protein->atoms()[timestep % m_protein->atoms().size()];
+}
+
+std::unique_ptr<TrajectoryStream> Scene::openTrajectory(const std::string& filename, const Protein& protein)
+{
+	auto trajectory = Trajectory::open(filename);
+
+	if (!trajectory)
+		return nullptr;
+
+	if (protein.atoms().empty() || trajectory->atomCount() != protein.atoms().front().size())
+	{
+		globjects::critical() << "Trajectory " << filename << " does not match the topology of " << protein.filename() << "!";
+		return nullptr;
+	}
+
+	return std::make_unique<TrajectoryStream>(std::move(trajectory), protein.atoms().front(), protein.atomOrder());
+}
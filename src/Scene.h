@@ -1,20 +1,83 @@
 #pragma once
 
 #include <memory>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <glm/glm.hpp>
 
 namespace dynamol
 {
 	class Protein;
+	class TrajectoryStream;
+	class UniformGrid;
+	class BoundingVolumeHierarchy;
+	class LevelOfDetail;
 
 	class Scene
 	{
 	public:
 		Scene();
+		~Scene();
 		Protein* protein();
 
+		// Loads a structure on a worker thread, the current protein stays in place until the new one is complete
+		// The new protein takes over the settings of the current one, an optional trajectory is opened once its topology is available
+		void load(const std::string& filename, const std::string& trajectoryFilename = "");
+		void cancelLoading();
+		bool isLoading() const;
+		float loadingProgress() const;
+		const std::string& loadingFilename() const;
+
+		// Takes over a protein that has finished loading, returns true if the protein has changed
+		// Has to be called regularly from the thread that renders the scene
+		bool update();
+
+		// Incremented whenever a new protein has been taken over, renderers compare it to find out whether their buffers are outdated
+		size_t loadCount() const;
+
+		// Frames of a DCD, XTC or lazily loaded multi-model PDB file that replace the timesteps of the protein, nullptr if there is none
+		TrajectoryStream* trajectory();
+
+		// Uniform grid over the atoms of a timestep or trajectory frame, updated incrementally when the timestep changes
+		// Returns nullptr if the frame of a trajectory has not been decoded yet
+		const UniformGrid* atomGrid(glm::uint timestep);
+
+		// Bounding volume hierarchy over the atom spheres of a timestep or trajectory frame for ray queries
+		// It is built once for each protein and refitted when the timestep changes, returns nullptr if the frame is not decoded yet
+		const BoundingVolumeHierarchy* atomHierarchy(glm::uint timestep);
+
+		// Coarse-grained levels of detail, built once for each protein from its first timestep
+		const LevelOfDetail* levelOfDetail();
+
 	private:
+		const std::vector<glm::vec4>* timestepAtoms(glm::uint timestep);
+		static std::unique_ptr<TrajectoryStream> openTrajectory(const std::string& filename, const Protein& protein);
+
 		std::unique_ptr<Protein> m_protein;
+		std::unique_ptr<TrajectoryStream> m_trajectory;
+		size_t m_loadCount = 0;
+
+		std::vector<glm::vec4> m_timestepAtoms;
+
+		std::unique_ptr<UniformGrid> m_atomGrid;
+		glm::uint m_atomGridTimestep = ~0u;
+		size_t m_atomGridLoadCount = ~size_t(0);
+
+		std::unique_ptr<BoundingVolumeHierarchy> m_atomHierarchy;
+		glm::uint m_atomHierarchyTimestep = ~0u;
+		size_t m_atomHierarchyLoadCount = ~size_t(0);
+
+		std::unique_ptr<LevelOfDetail> m_levelOfDetail;
+		size_t m_levelOfDetailLoadCount = ~size_t(0);
+
+		std::unique_ptr<Protein> m_loadingProtein;
+		std::unique_ptr<TrajectoryStream> m_loadingTrajectory;
+		std::string m_loadingFilename;
+		std::thread m_loadingThread;
+		std::atomic<bool> m_loadingFinished = { false };
 	};
 
 
-}
\ No newline at end of file
+}
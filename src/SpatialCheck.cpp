@@ -0,0 +1,444 @@
+#include "SpatialCheck.h"
+#include "Scene.h"
+#include "Protein.h"
+#include "UniformGrid.h"
+#include "BoundingVolumeHierarchy.h"
+#include "LevelOfDetail.h"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <limits>
+#include <cmath>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	const uint queryCount = 256;
+
+	// Perspective projection with a vertical field of view of 60 degrees, as set up by the viewer
+	mat4 perspectiveProjection(float nearPlane, float farPlane)
+	{
+		const float focalLength = 1.0f / std::tan(radians(30.0f));
+
+		mat4 projection(0.0f);
+		projection[0][0] = focalLength;
+		projection[1][1] = focalLength;
+		projection[2][2] = (farPlane + nearPlane) / (nearPlane - farPlane);
+		projection[2][3] = -1.0f;
+		projection[3][2] = 2.0f * farPlane * nearPlane / (nearPlane - farPlane);
+		return projection;
+	}
+
+	// Scales the structure around its center and moves it in front of the camera, with the center at the given depth
+	mat4 modelView(const vec3& center, float scale, float depth)
+	{
+		mat4 matrix(scale);
+		matrix[3] = vec4(-center * scale - vec3(0.0f, 0.0f, depth), 1.0f);
+		return matrix;
+	}
+
+	// Levels selected for each segment of the first copy, segments are never merged
+	std::vector<uint> selectLevels(const LevelOfDetail& levelOfDetail, const LevelOfDetail::View& view, const std::vector<vec4>& bounds)
+	{
+		std::vector<LevelOfDetail::Range> ranges;
+		levelOfDetail.select(view, bounds, {}, ranges);
+
+		std::vector<uint> levels(levelOfDetail.segmentCount(), ~0u);
+
+		for (const auto& range : ranges)
+			levels[range.segment] = range.level;
+
+		return levels;
+	}
+
+	void computeBounds(const std::vector<vec4>& atoms, vec3& minimum, vec3& maximum)
+	{
+		minimum = vec3(std::numeric_limits<float>::max());
+		maximum = vec3(-std::numeric_limits<float>::max());
+
+		for (const auto& atom : atoms)
+		{
+			minimum = min(minimum, vec3(atom));
+			maximum = max(maximum, vec3(atom));
+		}
+	}
+
+	// Random offsets of up to the given distance along each axis
+	void moveAtoms(std::vector<vec4>& atoms, float distance, std::mt19937& random)
+	{
+		std::uniform_real_distribution<float> offset(-distance, distance);
+
+		for (auto& atom : atoms)
+			atom += vec4(offset(random), offset(random), offset(random), 0.0f);
+	}
+
+	bool checkGrid(const UniformGrid& grid, const std::vector<vec4>& atoms, const std::string& stage)
+	{
+		std::mt19937 random(1);
+		std::uniform_int_distribution<size_t> atomIndex(0, atoms.size() - 1);
+		std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+		std::uniform_real_distribution<float> size(0.5f, 12.0f);
+
+		std::vector<uint> found;
+		std::vector<uint> expected;
+
+		for (uint q = 0; q < queryCount; q++)
+		{
+			// queries are centered near atoms, the last one encloses the whole structure
+			vec3 center = vec3(atoms[atomIndex(random)]) + vec3(offset(random), offset(random), offset(random));
+			float radius = size(random);
+			vec3 extent = vec3(size(random), size(random), size(random));
+
+			if (q == queryCount - 1)
+			{
+				vec3 boundsMinimum, boundsMaximum;
+				computeBounds(atoms, boundsMinimum, boundsMaximum);
+				center = 0.5f * (boundsMinimum + boundsMaximum);
+				extent = 0.5f * (boundsMaximum - boundsMinimum) + vec3(1.0f);
+				radius = length(extent);
+			}
+
+			found.clear();
+			expected.clear();
+			grid.findNeighbors(center, radius, found);
+
+			for (size_t i = 0; i < atoms.size(); i++)
+			{
+				const vec3 difference = vec3(atoms[i]) - center;
+
+				if (dot(difference, difference) <= radius * radius)
+					expected.push_back(uint(i));
+			}
+
+			std::sort(found.begin(), found.end());
+
+			if (found != expected)
+			{
+				globjects::critical() << "Grid neighbor query " << q << " " << stage << " found " << found.size() << " instead of " << expected.size() << " atoms!";
+				return false;
+			}
+
+			const vec3 minimum = center - extent;
+			const vec3 maximum = center + extent;
+
+			found.clear();
+			expected.clear();
+			grid.findInBox(minimum, maximum, found);
+
+			for (size_t i = 0; i < atoms.size(); i++)
+			{
+				const vec3 position = vec3(atoms[i]);
+
+				if (position.x >= minimum.x && position.y >= minimum.y && position.z >= minimum.z && position.x <= maximum.x && position.y <= maximum.y && position.z <= maximum.z)
+					expected.push_back(uint(i));
+			}
+
+			std::sort(found.begin(), found.end());
+
+			if (found != expected)
+			{
+				globjects::critical() << "Grid box query " << q << " " << stage << " found " << found.size() << " instead of " << expected.size() << " atoms!";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Same ray-sphere test as the hierarchy, so both report identical distances
+	float intersectSphere(const BoundingVolumeHierarchy::Ray& ray, const vec4& atom, float radius)
+	{
+		const vec3 direction = normalize(ray.direction);
+		const vec3 offset = ray.origin - vec3(atom);
+		const float b = dot(offset, direction);
+		const float c = dot(offset, offset) - radius * radius;
+		const float discriminant = b * b - c;
+
+		if (discriminant < 0.0f)
+			return -1.0f;
+
+		const float root = std::sqrt(discriminant);
+		return (-b - root >= 0.0f) ? -b - root : -b + root;
+	}
+
+	float atomRadius(const vec4& atom, const std::vector<float>& elementRadii, float radiusScale)
+	{
+		const uint elementIndex = floatBitsToUint(atom.w) & 0xff;
+		return ((elementIndex < elementRadii.size()) ? elementRadii[elementIndex] : 1.0f) * radiusScale;
+	}
+
+	std::vector<BoundingVolumeHierarchy::Hit> intersectAll(const BoundingVolumeHierarchy::Ray& ray, const std::vector<vec4>& atoms, const std::vector<float>& elementRadii, float radiusScale)
+	{
+		std::vector<BoundingVolumeHierarchy::Hit> hits;
+
+		for (size_t i = 0; i < atoms.size(); i++)
+		{
+			const float distance = intersectSphere(ray, atoms[i], atomRadius(atoms[i], elementRadii, radiusScale));
+
+			if (distance >= 0.0f)
+			{
+				BoundingVolumeHierarchy::Hit hit;
+				hit.atom = uint(i);
+				hit.distance = distance;
+				hits.push_back(hit);
+			}
+		}
+
+		return hits;
+	}
+
+	BoundingVolumeHierarchy::Hit intersectNearest(const BoundingVolumeHierarchy::Ray& ray, const std::vector<vec4>& atoms, const std::vector<float>& elementRadii, float radiusScale)
+	{
+		BoundingVolumeHierarchy::Hit nearest;
+
+		for (const auto& hit : intersectAll(ray, atoms, elementRadii, radiusScale))
+		{
+			if (hit.distance < nearest.distance)
+				nearest = hit;
+		}
+
+		return nearest;
+	}
+
+	// Atoms at the same distance can be reported in any order
+	bool matches(const BoundingVolumeHierarchy::Hit& hit, const BoundingVolumeHierarchy::Hit& expected)
+	{
+		return hit.atom == expected.atom || (hit.atom != ~0u && expected.atom != ~0u && hit.distance == expected.distance);
+	}
+
+	bool checkHierarchy(const BoundingVolumeHierarchy& hierarchy, const std::vector<vec4>& atoms, const std::vector<float>& elementRadii, const std::string& stage)
+	{
+		const uint packetSize = BoundingVolumeHierarchy::packetSize;
+
+		std::mt19937 random(3);
+		std::uniform_int_distribution<size_t> atomIndex(0, atoms.size() - 1);
+		std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+
+		vec3 minimum, maximum;
+		computeBounds(atoms, minimum, maximum);
+
+		const vec3 center = 0.5f * (minimum + maximum);
+		const float distance = length(maximum - minimum);
+
+		std::vector<BoundingVolumeHierarchy::Hit> hits;
+
+		for (uint q = 0; q < queryCount; q++)
+		{
+			// a packet of rays from a random point outside of the structure towards neighboring atoms, every second query with spheres of influence
+			const float radiusScale = (q % 2 == 0) ? 1.0f : 2.5f;
+			const vec3 origin = center + distance * normalize(vec3(offset(random), offset(random), offset(random)) + vec3(0.001f));
+			const vec3 target = vec3(atoms[atomIndex(random)]);
+
+			std::array<BoundingVolumeHierarchy::Ray, packetSize> rays;
+
+			for (auto& ray : rays)
+			{
+				ray.origin = origin;
+				ray.direction = target + 2.0f * vec3(offset(random), offset(random), offset(random)) - origin;
+			}
+
+			std::array<BoundingVolumeHierarchy::Hit, packetSize> packetHits;
+			hierarchy.intersect(rays, radiusScale, packetHits);
+
+			for (uint r = 0; r < packetSize; r++)
+			{
+				const BoundingVolumeHierarchy::Hit expected = intersectNearest(rays[r], atoms, elementRadii, radiusScale);
+
+				BoundingVolumeHierarchy::Hit hit;
+				hierarchy.intersect(rays[r], radiusScale, hit);
+
+				if (!matches(hit, expected))
+				{
+					globjects::critical() << "Hierarchy ray query " << q << " " << stage << " hit atom " << int(hit.atom) << " instead of " << int(expected.atom) << "!";
+					return false;
+				}
+
+				if (!matches(packetHits[r], expected))
+				{
+					globjects::critical() << "Hierarchy packet query " << q << " " << stage << " hit atom " << int(packetHits[r].atom) << " instead of " << int(expected.atom) << " with ray " << r << "!";
+					return false;
+				}
+			}
+
+			std::vector<BoundingVolumeHierarchy::Hit> expectedHits = intersectAll(rays.front(), atoms, elementRadii, radiusScale);
+			hierarchy.intersectAll(rays.front(), radiusScale, hits);
+
+			auto byAtom = [](const BoundingVolumeHierarchy::Hit& a, const BoundingVolumeHierarchy::Hit& b) { return a.atom < b.atom; };
+			std::sort(expectedHits.begin(), expectedHits.end(), byAtom);
+
+			bool sorted = std::is_sorted(hits.begin(), hits.end(), [](const BoundingVolumeHierarchy::Hit& a, const BoundingVolumeHierarchy::Hit& b) { return a.distance < b.distance; });
+			std::sort(hits.begin(), hits.end(), byAtom);
+
+			bool equal = sorted && hits.size() == expectedHits.size();
+
+			for (size_t i = 0; equal && i < hits.size(); i++)
+				equal = (hits[i].atom == expectedHits[i].atom && hits[i].distance == expectedHits[i].distance);
+
+			if (!equal)
+			{
+				globjects::critical() << "Hierarchy query for all hits " << q << " " << stage << " found " << hits.size() << " instead of " << expectedHits.size() << " atoms" << (sorted ? "!" : " and did not sort them by distance!");
+				return false;
+			}
+		}
+
+		return true;
+	}
+}
+
+bool SpatialCheck::run(const std::string& filename)
+{
+	Scene scene;
+	scene.load(filename);
+
+	while (scene.isLoading() && !scene.update())
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+	if (scene.protein()->atoms().empty())
+	{
+		globjects::critical() << "Could not load " << filename << " for checking!";
+		return false;
+	}
+
+	bool passed = checkAtomGrid(scene);
+	passed = checkAtomHierarchy(scene) && passed;
+	passed = checkLevelOfDetail(scene) && passed;
+
+	if (passed)
+		globjects::debug() << "All checks passed for " << filename;
+
+	return passed;
+}
+
+bool SpatialCheck::checkAtomGrid(Scene& scene)
+{
+	const std::vector<vec4>& atoms = scene.protein()->atoms().front();
+	const UniformGrid* sceneGrid = scene.atomGrid(0);
+
+	if (!sceneGrid || !checkGrid(*sceneGrid, atoms, "after building the grid of the scene"))
+		return false;
+
+	// unchanged positions only refresh the positions, small moves sort atoms into their new cells, large ones leave the margin and rebuild the grid
+	UniformGrid grid;
+	grid.build(atoms);
+
+	std::vector<vec4> movedAtoms = atoms;
+	std::mt19937 random(2);
+
+	grid.update(movedAtoms);
+
+	if (!checkGrid(grid, movedAtoms, "after updating unchanged atoms"))
+		return false;
+
+	moveAtoms(movedAtoms, 1.0f, random);
+	grid.update(movedAtoms);
+
+	if (!checkGrid(grid, movedAtoms, "after updating slightly moved atoms"))
+		return false;
+
+	const vec3 gridSize = grid.maximumBounds() - grid.minimumBounds();
+	moveAtoms(movedAtoms, 2.0f * std::max(gridSize.x, std::max(gridSize.y, gridSize.z)), random);
+	grid.update(movedAtoms);
+
+	if (!checkGrid(grid, movedAtoms, "after updating displaced atoms"))
+		return false;
+
+	globjects::debug() << "Uniform grid queries match the brute-force results for " << atoms.size() << " atoms";
+	return true;
+}
+
+bool SpatialCheck::checkAtomHierarchy(Scene& scene)
+{
+	const std::vector<vec4>& atoms = scene.protein()->atoms().front();
+	const std::vector<float>& elementRadii = scene.protein()->activeElementRadii();
+	const BoundingVolumeHierarchy* sceneHierarchy = scene.atomHierarchy(0);
+
+	if (!sceneHierarchy || !checkHierarchy(*sceneHierarchy, atoms, elementRadii, "after building the hierarchy of the scene"))
+		return false;
+
+	// refitting keeps the tree of the original positions, so moved atoms end up in nodes that are no longer spatially coherent
+	BoundingVolumeHierarchy hierarchy;
+	hierarchy.build(atoms, elementRadii);
+
+	std::vector<vec4> movedAtoms = atoms;
+	std::mt19937 random(4);
+
+	moveAtoms(movedAtoms, 3.0f, random);
+	hierarchy.refit(movedAtoms);
+
+	if (!checkHierarchy(hierarchy, movedAtoms, elementRadii, "after refitting moved atoms"))
+		return false;
+
+	globjects::debug() << "Bounding volume hierarchy queries match the brute-force results for " << atoms.size() << " atoms";
+	return true;
+}
+
+bool SpatialCheck::checkLevelOfDetail(Scene& scene)
+{
+	const std::vector<vec4>& atoms = scene.protein()->atoms().front();
+	const LevelOfDetail* levelOfDetail = scene.levelOfDetail();
+
+	if (!levelOfDetail || levelOfDetail->segmentCount() == 0)
+	{
+		globjects::critical() << "No levels of detail were built!";
+		return false;
+	}
+
+	std::vector<vec4> bounds;
+	levelOfDetail->bounds(atoms, bounds);
+
+	vec3 minimum, maximum;
+	computeBounds(atoms, minimum, maximum);
+
+	const vec3 center = 0.5f * (minimum + maximum);
+	const float size = std::max(maximum.x - minimum.x, std::max(maximum.y - minimum.y, maximum.z - minimum.z));
+
+	// the viewer scales the structure to a size of two, the levels have to be the same as for the structure in Angstrom
+	const float fittedScale = 2.0f / size;
+
+	LevelOfDetail::View view;
+	view.viewportHeight = 1080.0f;
+	view.pixelThreshold = 4.0f;
+	view.merging = false;
+
+	for (float distance : { 1.0f, 2.0f, 4.0f, 16.0f })
+	{
+		view.modelViewMatrix = modelView(center, 1.0f, distance * size);
+		view.projectionMatrix = perspectiveProjection(0.1f, 100.0f * size);
+		const std::vector<uint> levels = selectLevels(*levelOfDetail, view, bounds);
+
+		view.modelViewMatrix = modelView(center, fittedScale, distance * 2.0f);
+		view.projectionMatrix = perspectiveProjection(0.1f * fittedScale, 200.0f);
+		const std::vector<uint> fittedLevels = selectLevels(*levelOfDetail, view, bounds);
+
+		for (size_t s = 0; s < levels.size(); s++)
+		{
+			if (levels[s] != fittedLevels[s])
+			{
+				globjects::critical() << "Level of detail of segment " << uint(s) << " at a distance of " << distance << " sizes is " << fittedLevels[s] << " for the fitted view instead of " << levels[s] << "!";
+				return false;
+			}
+		}
+	}
+
+	// far away, even the segments are smaller than a pixel
+	view.modelViewMatrix = modelView(center, fittedScale, 2000.0f);
+	view.projectionMatrix = perspectiveProjection(0.1f * fittedScale, 4000.0f);
+	const std::vector<uint> distantLevels = selectLevels(*levelOfDetail, view, bounds);
+
+	for (size_t s = 0; s < distantLevels.size(); s++)
+	{
+		if (distantLevels[s] != 2)
+		{
+			globjects::critical() << "Level of detail of segment " << uint(s) << " is " << distantLevels[s] << " for a distant fitted view instead of 2!";
+			return false;
+		}
+	}
+
+	globjects::debug() << "Levels of detail do not depend on the scale of the view for " << uint(levelOfDetail->segmentCount()) << " segments";
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+
+namespace dynamol
+{
+	class Scene;
+
+	// Compares the queries of the spatial data structures of a scene with brute-force scans over all atoms
+	// The checks need no OpenGL context and are run with the --check option instead of opening the viewer
+	class SpatialCheck
+	{
+	public:
+		// Loads the structure and runs all checks, returns false if any query differs from the brute-force result
+		static bool run(const std::string& filename);
+
+		// Neighbor and box queries of the grid after building it and after updating it for unchanged, slightly moved and displaced atoms
+		static bool checkAtomGrid(Scene& scene);
+
+		// Nearest hits of single rays and packets and all hits along rays after building the hierarchy and after refitting it for moved atoms
+		static bool checkAtomHierarchy(Scene& scene);
+
+		// Levels of detail selected for views that only differ in the scale of the model view matrix, and for a distant view
+		static bool checkLevelOfDetail(Scene& scene);
+	};
+}
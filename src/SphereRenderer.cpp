@@ -1,16 +1,23 @@
 #include "SphereRenderer.h"
 #include <globjects/base/File.h>
 #include <globjects/State.h>
+#include <globjects/globjects.h>
 #include <iostream>
 #include <filesystem>
 #include <imgui.h>
 #include "Viewer.h"
 #include "Scene.h"
 #include "Protein.h"
+#include "TrajectoryStream.h"
+#include "LevelOfDetail.h"
+#include "Profiler.h"
 #include <sstream>
+#include <limits>
+#include <algorithm>
 
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_precision.hpp>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
@@ -23,8 +30,43 @@ using namespace gl;
 using namespace glm;
 using namespace globjects;
 
+// Layout of the commands of glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+// Layout of the commands of glMultiDrawArraysIndirect, used by vertex pulling
+struct DrawArraysIndirectCommand
+{
+	uint count;
+	uint instanceCount;
+	uint first;
+	uint baseInstance;
+};
+
+// Layout of the intersection buffer, a count followed by the entries, each of which takes 48 bytes under std430
+const GLsizeiptr intersectionHeaderSize = 16;
+const GLsizeiptr intersectionEntrySize = 48;
+
+// Layout of the chunks tested for occlusion, the bounds enclose the spheres of influence of their atoms
+struct OcclusionChunk
+{
+	vec4 bounds;
+	uint first;
+	uint count;
+	uint segment;
+	uint level;
+};
+
 std::unique_ptr<Texture> loadTexture(const std::string& filename)
 {
+	PROFILE_ZONE("loadTexture");
+
 	int width, height, channels;
 
 	stbi_set_flip_vertically_on_load(true);
@@ -72,25 +114,30 @@ std::unique_ptr<Texture> loadTexture(const std::string& filename)
 	return std::unique_ptr<Texture>();
 }
 
-SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
+// Name that an element, residue or chain id has been assigned to
+std::string idName(const std::unordered_map<std::string, uint>& ids, uint id)
 {
-	Shader::hintIncludeImplementation(Shader::IncludeImplementation::Fallback);
-
-	for (auto i : viewer->scene()->protein()->atoms())
+	for (const auto& i : ids)
 	{
-		m_vertices.push_back(Buffer::create());
-		m_vertices.back()->setStorage(i, gl::GL_NONE_BIT);
+		if (i.second == id)
+			return i.first;
 	}
-	
-	m_elementColorsRadii->setStorage(viewer->scene()->protein()->activeElementColorsRadiiPacked(), gl::GL_NONE_BIT);
-	m_residueColors->setStorage(viewer->scene()->protein()->activeResidueColorsPacked(), gl::GL_NONE_BIT);
-	m_chainColors->setStorage(viewer->scene()->protein()->activeChainColorsPacked(), gl::GL_NONE_BIT);
 
-	//m_intersectionBuffer->setStorage(sizeof(vec3) * 1024 * 1024 * 128 + sizeof(uint), nullptr, gl::GL_NONE_BIT);
+	return "?";
+}
 
-	int maximumSize;
-	glGetIntegerv(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maximumSize);
-	m_intersectionBuffer->setStorage(maximumSize, nullptr, gl::GL_NONE_BIT);
+SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
+{
+	Shader::hintIncludeImplementation(Shader::IncludeImplementation::Fallback);
+
+	// the intersection buffer is allocated on demand, it can never exceed the largest storage block
+	GLint64 maximumSize;
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maximumSize);
+	m_intersectionCapacityLimit = uint(std::min<GLint64>((maximumSize - intersectionHeaderSize) / intersectionEntrySize, std::numeric_limits<uint>::max()));
+	m_intersectionReadback = std::make_unique<ReadbackBuffer>(sizeof(uint));
+
+	m_statisticsBuffer->setStorage(sizeof(uvec4), nullptr, gl::GL_NONE_BIT);
+	m_statisticsReadback = std::make_unique<ReadbackBuffer>(sizeof(uvec4));
 
 	m_verticesQuad->setStorage(std::array<vec3, 1>({ vec3(0.0f, 0.0f, 0.0f) }), gl::GL_NONE_BIT);
 	auto vertexBindingQuad = m_vaoQuad->binding(0);
@@ -107,21 +154,33 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 			{ GL_GEOMETRY_SHADER,"./res/sphere/sphere-gs.glsl" },
 			{ GL_FRAGMENT_SHADER,"./res/sphere/sphere-fs.glsl" },
 		},
-		{ "./res/model/globals.glsl" });
+		{ "./res/model/globals.glsl", "./res/sphere/atom.glsl", "./res/sphere/bounds.glsl" });
 
 	createShaderProgram("spawn", {
 			{ GL_VERTEX_SHADER,"./res/sphere/sphere-vs.glsl" },
 			{ GL_GEOMETRY_SHADER,"./res/sphere/sphere-gs.glsl" },
 			{ GL_FRAGMENT_SHADER,"./res/sphere/spawn-fs.glsl" },
 		},
-		{ "./res/sphere/globals.glsl" });
+		{ "./res/sphere/globals.glsl", "./res/sphere/atom.glsl", "./res/sphere/bounds.glsl" });
+
+	createShaderProgram("spherePulling", {
+			{ GL_VERTEX_SHADER,"./res/sphere/sphere-pulling-vs.glsl" },
+			{ GL_FRAGMENT_SHADER,"./res/sphere/sphere-fs.glsl" },
+		},
+		{ "./res/model/globals.glsl", "./res/sphere/atom.glsl", "./res/sphere/quantization.glsl", "./res/sphere/bounds.glsl" });
+
+	createShaderProgram("spawnPulling", {
+			{ GL_VERTEX_SHADER,"./res/sphere/sphere-pulling-vs.glsl" },
+			{ GL_FRAGMENT_SHADER,"./res/sphere/spawn-fs.glsl" },
+		},
+		{ "./res/sphere/globals.glsl", "./res/sphere/atom.glsl", "./res/sphere/quantization.glsl", "./res/sphere/bounds.glsl" });
 
 	createShaderProgram("surface", {
 			{ GL_VERTEX_SHADER,"./res/sphere/image-vs.glsl" },
 			{ GL_GEOMETRY_SHADER,"./res/sphere/image-gs.glsl" },
 			{ GL_FRAGMENT_SHADER,"./res/sphere/surface-fs.glsl" },
 		},
-		{ "./res/sphere/globals.glsl" });
+		{ "./res/sphere/globals.glsl", "./res/sphere/atom.glsl" });
 
 	createShaderProgram("aosample", {
 			{ GL_VERTEX_SHADER,"./res/sphere/image-vs.glsl" },
@@ -170,7 +229,24 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 			{ GL_GEOMETRY_SHADER,"./res/sphere/sphere-gs.glsl" },
 			{ GL_FRAGMENT_SHADER,"./res/sphere/shadow-fs.glsl" },
 		},
-		{ "./res/model/globals.glsl" });
+		{ "./res/model/globals.glsl", "./res/sphere/atom.glsl", "./res/sphere/bounds.glsl" });
+
+	createShaderProgram("hierarchy", {
+			{ GL_COMPUTE_SHADER,"./res/sphere/hiz-cs.glsl" },
+		});
+
+	createShaderProgram("occlusion", {
+			{ GL_COMPUTE_SHADER,"./res/sphere/occlusion-cs.glsl" },
+		});
+
+	createShaderProgram("prefixSum", {
+			{ GL_COMPUTE_SHADER,"./res/sphere/prefix-sum-cs.glsl" },
+		});
+
+	createShaderProgram("animation", {
+			{ GL_COMPUTE_SHADER,"./res/sphere/animation-cs.glsl" },
+		},
+		{ "./res/sphere/quantization.glsl" });
 
 	m_framebufferSize = viewer->viewportSize();
 
@@ -195,6 +271,13 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	m_sphereNormalTexture->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	m_sphereNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 
+	m_atomIdTexture = Texture::create(GL_TEXTURE_2D);
+	m_atomIdTexture->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	m_atomIdTexture->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	m_atomIdTexture->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	m_atomIdTexture->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	m_atomIdTexture->image2D(0, GL_RG32UI, m_framebufferSize, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+
 	m_surfacePositionTexture = Texture::create(GL_TEXTURE_2D);
 	m_surfacePositionTexture->setParameter(GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	m_surfacePositionTexture->setParameter(GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -311,6 +394,7 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	m_sphereFramebuffer = Framebuffer::create();
 	m_sphereFramebuffer->attachTexture(GL_COLOR_ATTACHMENT0, m_spherePositionTexture.get());
 	m_sphereFramebuffer->attachTexture(GL_COLOR_ATTACHMENT1, m_sphereNormalTexture.get());
+	m_sphereFramebuffer->attachTexture(GL_COLOR_ATTACHMENT2, m_atomIdTexture.get());
 	m_sphereFramebuffer->attachTexture(GL_DEPTH_ATTACHMENT, m_depthTexture.get());
 	m_sphereFramebuffer->setDrawBuffers({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 });
 
@@ -352,14 +436,183 @@ SphereRenderer::SphereRenderer(Viewer* viewer) : Renderer(viewer)
 	
 }
 
+void SphereRenderer::uploadProtein()
+{
+	PROFILE_ZONE("SphereRenderer::uploadProtein");
+
+	Protein* protein = viewer()->scene()->protein();
+	const LevelOfDetail* levelOfDetail = viewer()->scene()->levelOfDetail();
+	const size_t primitiveCount = levelOfDetail->primitiveCount();
+
+	m_vertices.clear();
+	m_segmentBounds.clear();
+	m_chunkBounds.clear();
+	m_atomAttributes = Buffer::create();
+
+	// the primitives of the coarser levels of detail follow the atoms of each timestep
+	if (protein->isQuantized())
+	{
+		std::vector<u16vec3> primitives;
+
+		for (const auto& i : protein->quantizedTimesteps())
+		{
+			levelOfDetail->primitives(i.positions, primitives);
+			m_segmentBounds.emplace_back();
+			levelOfDetail->bounds(i.positions, i.offset, i.extent, m_segmentBounds.back());
+			m_chunkBounds.emplace_back();
+			levelOfDetail->chunkBounds(i.positions, i.offset, i.extent, m_chunkBounds.back());
+
+			m_vertices.push_back(Buffer::create());
+			// rounded up to whole 32 bit words, which is how vertex pulling reads the positions
+			const size_t size = (i.positions.size() + primitiveCount) * sizeof(u16vec3);
+			m_vertices.back()->setStorage((size + sizeof(uint) - 1) / sizeof(uint) * sizeof(uint), nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+			m_vertices.back()->setSubData(i.positions);
+			m_vertices.back()->setSubData(primitives, i.positions.size() * sizeof(u16vec3));
+		}
+
+		m_atomAttributes->setStorage((protein->atomAttributes().size() + primitiveCount) * sizeof(uint), nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+		m_atomAttributes->setSubData(protein->atomAttributes());
+		m_atomAttributes->setSubData(levelOfDetail->primitiveAttributes(), protein->atomAttributes().size() * sizeof(uint));
+	}
+	else
+	{
+		std::vector<vec4> primitives;
+
+		for (const auto& i : protein->atoms())
+		{
+			levelOfDetail->primitives(i, primitives);
+			m_segmentBounds.emplace_back();
+			levelOfDetail->bounds(i, m_segmentBounds.back());
+			m_chunkBounds.emplace_back();
+			levelOfDetail->chunkBounds(i, m_chunkBounds.back());
+
+			m_vertices.push_back(Buffer::create());
+			m_vertices.back()->setStorage((i.size() + primitiveCount) * sizeof(vec4), nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+			m_vertices.back()->setSubData(i);
+			m_vertices.back()->setSubData(primitives, i.size() * sizeof(vec4));
+		}
+	}
+
+	// positions of all atoms and primitives after the animation pass, written on the GPU every frame while animating
+	const size_t atomCount = protein->isQuantized() ? protein->atomAttributes().size() : protein->atoms().front().size();
+	m_animatedVertices = Buffer::create();
+	m_animatedVertices->setStorage((atomCount + primitiveCount) * sizeof(vec4), nullptr, gl::GL_NONE_BIT);
+
+	m_levelOfDetailIndices = Buffer::create();
+	m_levelOfDetailIndices->setStorage(levelOfDetail->indices(), gl::GL_NONE_BIT);
+	m_vao->bindElementBuffer(m_levelOfDetailIndices.get());
+
+	m_elementColorsRadii = Buffer::create();
+	m_elementColorsRadii->setStorage(protein->activeElementColorsRadiiPacked(), gl::GL_NONE_BIT);
+	m_residueColors = Buffer::create();
+	m_residueColors->setStorage(protein->activeResidueColorsPacked(), gl::GL_NONE_BIT);
+	m_chainColors = Buffer::create();
+	m_chainColors->setStorage(protein->activeChainColorsPacked(), gl::GL_NONE_BIT);
+	m_instanceTransforms = Buffer::create();
+	m_instanceTransforms->setStorage(protein->instanceTransforms(), gl::GL_NONE_BIT);
+
+	std::vector<uint> instanceIndices(protein->instanceTransforms().size());
+
+	for (uint i = 0; i < uint(instanceIndices.size()); i++)
+		instanceIndices[i] = i;
+
+	m_instanceIndices = Buffer::create();
+	m_instanceIndices->setStorage(instanceIndices, gl::GL_NONE_BIT);
+
+	// no chunk has been found visible yet, the first frame is drawn entirely by the second phase of occlusion culling
+	const size_t occlusionCapacity = levelOfDetail->chunks().size() * std::max(instanceIndices.size(), size_t(1));
+	const std::vector<uint> visibility(occlusionCapacity, 0);
+	m_occlusionVisibility = Buffer::create();
+	m_occlusionVisibility->setStorage(visibility, gl::GL_NONE_BIT);
+
+	for (auto& commands : m_occlusionCommands)
+	{
+		commands = Buffer::create();
+		commands->setStorage(sizeof(uint) + occlusionCapacity * sizeof(DrawElementsIndirectCommand), nullptr, gl::GL_NONE_BIT);
+	}
+
+	// the trajectory buffers are initialized from the new topology on their next use
+	for (auto& buffer : m_frameVertices)
+		buffer.reset();
+
+	// readbacks still in flight refer to the atoms of the previous protein
+	m_pickingReadback = std::make_unique<ReadbackBuffer>(sizeof(uvec2));
+	m_pickedAtom = uvec2(0);
+
+	m_loadCount = viewer()->scene()->loadCount();
+}
+
+// Entries of a frame that exceed the capacity are dropped instead of spawning them again into a larger buffer within the same frame
+// Learning the demand in time would mean waiting for the GPU after every spawn pass, so a sudden increase, e.g. when zooming in,
+// leaves parts of the surface missing for the few frames until the readback arrives and the grown buffer is in use
+void SphereRenderer::updateIntersectionCapacity(uint demand)
+{
+	// peak demand over about a second of frames, the buffer grows at once but only shrinks after the peak has stayed low
+	const uint windowSize = 60;
+	const uint granularity = 1 << 16;
+
+	if (demand > 0)
+	{
+		if (m_intersectionDemands.size() < windowSize)
+			m_intersectionDemands.push_back(demand);
+		else
+			m_intersectionDemands[m_intersectionDemandIndex] = demand;
+
+		m_intersectionDemandIndex = (m_intersectionDemandIndex + 1) % windowSize;
+	}
+
+	const uint peak = m_intersectionDemands.empty() ? 0 : *std::max_element(m_intersectionDemands.begin(), m_intersectionDemands.end());
+	const bool overflow = m_intersectionBuffer && demand > m_intersectionCapacity;
+	uint capacity = m_intersectionCapacity;
+
+	if (!m_intersectionBuffer)
+	{
+		// before anything has been measured, start with a few entries per pixel
+		capacity = std::max(uint(m_framebufferSize.x) * uint(m_framebufferSize.y) * 2, granularity);
+	}
+	else if (peak > capacity - capacity / 8 || (m_intersectionDemands.size() == windowSize && peak < capacity / 4))
+	{
+		// half again as much as the peak, so that neither small growth nor the following shrink reallocate right away
+		capacity = uint(std::min<uint64_t>(uint64_t(peak) * 3 / 2, m_intersectionCapacityLimit));
+	}
+
+	capacity = std::min(std::max((capacity + granularity - 1) / granularity * granularity, granularity), m_intersectionCapacityLimit);
+
+	// beyond the largest buffer the device supports, entries are dropped in every frame
+	if (demand > m_intersectionCapacityLimit && !m_intersectionLimitReported)
+	{
+		globjects::warning() << "Intersection buffer limit reached, " << demand << " entries needed but only " << m_intersectionCapacityLimit << " can be stored";
+		m_intersectionLimitReported = true;
+	}
+
+	if (capacity == m_intersectionCapacity && m_intersectionBuffer)
+		return;
+
+	if (overflow)
+		globjects::debug() << "Intersection buffer overflow, " << demand << " entries needed, growing to " << capacity << " entries";
+
+	m_intersectionCapacity = capacity;
+	m_intersectionBuffer = Buffer::create();
+	m_intersectionBuffer->setStorage(intersectionHeaderSize + GLsizeiptr(capacity) * intersectionEntrySize, nullptr, gl::GL_NONE_BIT);
+}
+
 void SphereRenderer::display()
 {
+	PROFILE_ZONE("SphereRenderer::display");
+
 	if (viewer()->scene()->protein()->atoms().size() == 0)
 		return;
 
+	// Buffers are created again whenever the scene has taken over a new protein
+	if (m_loadCount != viewer()->scene()->loadCount())
+		uploadProtein();
+
 	// SaveOpenGL state
 	auto currentState = State::currentState();
 
+	GpuTimer* timer = viewer()->gpuTimer();
+	timer->begin("Sphere Renderer");
+
 	static float resolutionScale = 1.0f;
 
 	const ivec2 viewportSize = ivec2(vec2(viewer()->viewportSize()) * resolutionScale);
@@ -372,6 +625,7 @@ void SphereRenderer::display()
 		m_depthTexture->image2D(0, GL_DEPTH_COMPONENT, m_framebufferSize, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, nullptr);
 		m_spherePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		m_sphereNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_atomIdTexture->image2D(0, GL_RG32UI, m_framebufferSize, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
 		m_surfacePositionTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		m_surfaceNormalTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		m_surfaceDiffuseTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
@@ -379,12 +633,17 @@ void SphereRenderer::display()
 		m_ambientTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		m_blurTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
 		m_colorTexture->image2D(0, GL_RGBA32F, m_framebufferSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		m_depthHierarchyTexture.reset();
+		m_listOffsets.reset();
+		m_listOffsetSums.clear();
 	}
 
 	// our shader programs
 
 	auto programSphere = shaderProgram("sphere");
 	auto programSpawn = shaderProgram("spawn");
+	auto programSpherePulling = shaderProgram("spherePulling");
+	auto programSpawnPulling = shaderProgram("spawnPulling");
 	auto programSurface = shaderProgram("surface");
 	auto programAOSample = shaderProgram("aosample");
 	auto programAOBlur = shaderProgram("aoblur");
@@ -393,6 +652,10 @@ void SphereRenderer::display()
 	auto programDOFBlend = shaderProgram("dofblend");
 	auto programDisplay = shaderProgram("display");
 	auto programShadow = shaderProgram("shadow");
+	auto programHierarchy = shaderProgram("hierarchy");
+	auto programOcclusion = shaderProgram("occlusion");
+	auto programAnimation = shaderProgram("animation");
+	auto programPrefixSum = shaderProgram("prefixSum");
 
 	
 	// get cursor position for magic lens
@@ -400,6 +663,12 @@ void SphereRenderer::display()
 	glfwGetCursorPos(viewer()->window(), &mouseX, &mouseY);
 	const vec2 focusPosition = vec2(2.0f*float(mouseX) / float(viewportSize.x) - 1.0f, -2.0f*float(mouseY) / float(viewportSize.y) + 1.0f);
 
+	// pixel under the cursor for picking, the cursor position is given in screen coordinates which may differ from pixels on high DPI displays
+	int windowWidth, windowHeight;
+	glfwGetWindowSize(viewer()->window(), &windowWidth, &windowHeight);
+	const ivec2 cursorPixel = ivec2(vec2(float(mouseX), float(mouseY)) * vec2(viewportSize) / max(vec2(float(windowWidth), float(windowHeight)), vec2(1.0f)));
+	const bool cursorInside = cursorPixel.x >= 0 && cursorPixel.y >= 0 && cursorPixel.x < viewportSize.x && cursorPixel.y < viewportSize.y && !ImGui::GetIO().WantCaptureMouse;
+
 	// retrieve/compute all necessary matrices and related properties
 	const mat4 viewMatrix = viewer()->viewTransform();
 	const mat4 inverseViewMatrix = inverse(viewMatrix);
@@ -455,6 +724,16 @@ void SphereRenderer::display()
 	static float animationAmplitude = 1.0f;
 	static float animationFrequency = 1.0f;
 	static bool lens = false;
+	static bool assembly = true;
+	static bool picking = true;
+	static bool levelOfDetail = true;
+	static float levelOfDetailThreshold = 4.0f;
+	static bool culling = true;
+	static bool occlusionCulling = true;
+	static bool vertexPulling = false;
+	static bool listCompaction = false;
+	static bool statistics = false;
+	static bool statisticsLogging = false;
 
 	static float focalDistance = 2.0f * sqrt(3.0f);
 	static float maximumCoCRadius = 9.0f;
@@ -494,6 +773,14 @@ void SphereRenderer::display()
 			ImGui::SliderFloat("Dist. Scale", &distanceScale, 0.0f, 16.0f);
 			ImGui::Combo("Coloring", &coloring, "None\0Element\0Residue\0Chain\0");
 			ImGui::Checkbox("Magic Lens", &lens);
+			ImGui::Checkbox("Biological Assembly", &assembly);
+			ImGui::Checkbox("Atom Picking", &picking);
+			ImGui::Checkbox("Level of Detail", &levelOfDetail);
+			ImGui::SliderFloat("LOD Threshold", &levelOfDetailThreshold, 0.5f, 32.0f);
+			ImGui::Checkbox("Frustum Culling", &culling);
+			ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+			ImGui::Checkbox("Vertex Pulling", &vertexPulling);
+			ImGui::Checkbox("Compact Lists", &listCompaction);
 		}
 
 
@@ -606,21 +893,160 @@ void SphereRenderer::display()
 			ImGui::SliderFloat("Amplitude", &animationAmplitude, 1.0f, 32.0f);
 		}
 
+		if (ImGui::CollapsingHeader("Statistics"))
+		{
+			ImGui::Checkbox("Gather Statistics", &statistics);
+			ImGui::Checkbox("Log to CSV", &statisticsLogging);
+
+			if (statistics)
+			{
+				const float averageEntryCount = m_statistics.y > 0 ? float(m_statistics.z) / float(m_statistics.y) : 0.0f;
+				ImGui::Text("Surface Pixels: %u", m_statistics.x);
+				ImGui::Text("List Pixels: %u", m_statistics.y);
+				ImGui::Text("Entries: %u (%.2f per pixel)", m_statistics.z, averageEntryCount);
+				ImGui::Text("Longest List: %u", m_statistics.w);
+				ImGui::Text("Buffer: %u of %u entries", m_intersectionDemand, m_intersectionCapacity);
+			}
+		}
+
 		ImGui::EndMenu();
 	}
 
+	// The bounds only enclose the copies of the assembly while they are drawn, so the view is fitted again when toggling them
+	if (viewer()->scene()->protein()->isAssemblyEnabled() != assembly)
+	{
+		viewer()->scene()->protein()->setAssemblyEnabled(assembly);
+		viewer()->fitModelTransform();
+	}
+
 	// Scaling for sphere of influence radius based on estimated density
 	const float contributingAtoms = 32.0f;
 	const float radiusScale = sqrtf(log(contributingAtoms * exp(sharpness)) / sharpness);
 
 	// Properties for animation
-	const uint timestepCount = (uint)viewer()->scene()->protein()->atoms().size();
+	TrajectoryStream* trajectory = viewer()->scene()->trajectory();
+	const bool quantized = !trajectory && viewer()->scene()->protein()->isQuantized();
+	const uint timestepCount = trajectory ? trajectory->frameCount() : viewer()->scene()->protein()->timestepCount();
 	const float animationTime = animate ? float(glfwGetTime()) : -1.0f;
 	const float currentTime = glfwGetTime() * animationFrequency;
 	const uint currentTimestep = uint(currentTime) % timestepCount;
 	const uint nextTimestep = (currentTimestep + 1) % timestepCount;
 	const float animationDelta = currentTime - floor(currentTime);
-	const int vertexCount = int(viewer()->scene()->protein()->atoms()[currentTimestep].size());
+	int vertexCount = 0;
+
+	if (trajectory)
+		vertexCount = int(trajectory->atomCount());
+	else if (quantized)
+		vertexCount = int(viewer()->scene()->protein()->atomAttributes().size());
+	else
+		vertexCount = int(viewer()->scene()->protein()->atoms()[currentTimestep].size());
+
+	// Copies of the asymmetric unit that make up the biological assembly are drawn as instances
+	const int instanceCount = assembly ? int(viewer()->scene()->protein()->instanceTransforms().size()) : 1;
+
+	// Atom under the cursor as of the most recent readback that has completed
+	if (const void* pickingData = m_pickingReadback->read())
+		m_pickedAtom = *static_cast<const uvec2*>(pickingData);
+
+	if (!picking || !cursorInside)
+		m_pickedAtom = uvec2(0);
+
+	if (m_pickedAtom.x > 0 && m_pickedAtom.x <= uint(vertexCount) && m_pickedAtom.y < uint(instanceCount))
+	{
+		Protein* protein = viewer()->scene()->protein();
+		const uint atomIndex = m_pickedAtom.x - 1;
+		const std::vector<vec4>* atoms = nullptr;
+		vec4 atom = vec4(0.0f);
+
+		if (trajectory)
+			atoms = trajectory->frame(currentTimestep);
+		else if (!quantized)
+			atoms = &protein->atoms()[currentTimestep];
+
+		if (atoms)
+		{
+			atom = (*atoms)[atomIndex];
+		}
+		else if (quantized)
+		{
+			const auto& quantizedTimestep = protein->quantizedTimesteps()[currentTimestep];
+			const float steps = float(std::numeric_limits<uint16_t>::max());
+			atom = vec4(quantizedTimestep.offset + vec3(quantizedTimestep.positions[atomIndex]) / steps * quantizedTimestep.extent, uintBitsToFloat(protein->atomAttributes()[atomIndex]));
+		}
+
+		if (atoms || quantized)
+		{
+			const uint attributes = floatBitsToUint(atom.w);
+			const uint elementIndex = attributes & 0xff;
+			const uint residueIndex = (attributes >> 8) & 0xff;
+			const uint chainIndex = (attributes >> 16) & 0xff;
+			const uint fileIndex = protein->atomOrder().empty() ? atomIndex : protein->atomOrder()[atomIndex];
+			const vec3 position = (instanceCount > 1) ? vec3(protein->instanceTransforms()[m_pickedAtom.y] * vec4(vec3(atom), 1.0f)) : vec3(atom);
+
+			const auto& elementIds = protein->activeElementIds();
+			const auto& residueIds = protein->activeResidueIds();
+			const auto& chainIds = protein->activeChainIds();
+
+			ImGui::BeginTooltip();
+			ImGui::Text("Atom %u", fileIndex);
+
+			if (instanceCount > 1)
+				ImGui::Text("Copy %u", m_pickedAtom.y);
+
+			ImGui::Text("Element: %s", elementIndex < elementIds.size() ? idName(Protein::elementIds(), elementIds[elementIndex]).c_str() : "?");
+			ImGui::Text("Residue: %s", residueIndex < residueIds.size() ? idName(Protein::residueIds(), residueIds[residueIndex]).c_str() : "?");
+			ImGui::Text("Chain: %s", chainIndex < chainIds.size() ? protein->chainName(chainIds[chainIndex]).c_str() : "?");
+			ImGui::Text("Position: %.3f, %.3f, %.3f", position.x, position.y, position.z);
+			ImGui::EndTooltip();
+		}
+	}
+
+	// Statistics of the most recent frame whose readback has completed, appended to the log together with the current parameters
+	// The parameters may be a few frames newer than the statistics, which only matters while they are being changed
+	if (const void* statisticsData = m_statisticsReadback->read())
+	{
+		m_statistics = *static_cast<const uvec4*>(statisticsData);
+
+		if (statistics && statisticsLogging)
+		{
+			if (!m_statisticsLog.is_open())
+			{
+				std::string basename = viewer()->scene()->protein()->filename();
+				size_t pos = basename.rfind('.', basename.length());
+
+				if (pos != std::string::npos)
+					basename = basename.substr(0, pos);
+
+				const std::string filename = basename + "-statistics.csv";
+				const bool exists = std::filesystem::exists(filename);
+
+				m_statisticsLog.open(filename, std::ios::app);
+
+				if (!m_statisticsLog.good())
+				{
+					globjects::warning() << "Could not open statistics log " << filename;
+					statisticsLogging = false;
+				}
+				else
+				{
+					globjects::debug() << "Logging statistics to " << filename;
+
+					if (!exists)
+						m_statisticsLog << "time,width,height,sharpness,radiusScale,surfacePixels,listPixels,entries,maximumEntries,demand,capacity" << std::endl;
+				}
+			}
+
+			if (m_statisticsLog.is_open())
+			{
+				m_statisticsLog << glfwGetTime() << "," << m_framebufferSize.x << "," << m_framebufferSize.y << "," << sharpness << "," << radiusScale << ",";
+				m_statisticsLog << m_statistics.x << "," << m_statistics.y << "," << m_statistics.z << "," << m_statistics.w << ",";
+				m_statisticsLog << m_intersectionDemand << "," << m_intersectionCapacity << "\n";
+			}
+		}
+	}
+
+	if ((!statistics || !statisticsLogging) && m_statisticsLog.is_open())
+		m_statisticsLog.close();
 
 	// Defines for enabling/disabling shader feature based on parameter setting
 	std::string defines = "";
@@ -628,9 +1054,18 @@ void SphereRenderer::display()
 	if (animate)
 		defines += "#define ANIMATION\n";
 
+	if (quantized)
+		defines += "#define QUANTIZATION\n";
+
+	if (instanceCount > 1)
+		defines += "#define INSTANCING\n";
+
 	if (lens)
 		defines += "#define LENSING\n";
 
+	if (picking)
+		defines += "#define PICKING\n";
+
 	if (coloring > 0)
 		defines += "#define COLORING\n";
 
@@ -652,6 +1087,12 @@ void SphereRenderer::display()
 	if (depthOfField)
 		defines += "#define DEPTHOFFIELD\n";
 
+	if (listCompaction)
+		defines += "#define COMPACTION\n";
+
+	if (statistics)
+		defines += "#define STATISTICS\n";
+
 	// Reload shaders if settings have changed
 	if (defines != m_shaderSourceDefines->string())
 	{
@@ -659,22 +1100,437 @@ void SphereRenderer::display()
 		reloadShaders();
 	}
 
+	Buffer* currentVertices = nullptr;
+	Buffer* nextVertices = nullptr;
+
+	if (trajectory)
+	{
+		// Trajectory frames are decoded in the background and uploaded once they are available
+		// Until then, the previously uploaded frame is shown instead of waiting for the decoder
+		if (!m_frameVertices[0])
+		{
+			const size_t frameVertexCount = viewer()->scene()->protein()->atoms().front().size() + viewer()->scene()->levelOfDetail()->primitiveCount();
+
+			for (auto& buffer : m_frameVertices)
+			{
+				buffer = Buffer::create();
+				buffer->setStorage(frameVertexCount * sizeof(vec4), nullptr, gl::GL_DYNAMIC_STORAGE_BIT);
+			}
+
+			m_frameIndices = { ~0u, ~0u };
+
+			for (auto& bounds : m_frameSegmentBounds)
+				bounds.clear();
+
+			for (auto& bounds : m_frameChunkBounds)
+				bounds.clear();
+			m_currentFrameBuffer = 0;
+		}
+
+		trajectory->setPosition(currentTimestep);
+
+		auto residentFrameBuffer = [&](uint frame, uint replacement) {
+			for (uint i = 0; i < 2; i++)
+			{
+				if (m_frameIndices[i] == frame)
+					return int(i);
+			}
+
+			if (const std::vector<vec4>* atoms = trajectory->frame(frame))
+			{
+				std::vector<vec4> primitives;
+				viewer()->scene()->levelOfDetail()->primitives(*atoms, primitives);
+
+				m_frameVertices[replacement]->setSubData(*atoms);
+				m_frameVertices[replacement]->setSubData(primitives, atoms->size() * sizeof(vec4));
+				viewer()->scene()->levelOfDetail()->bounds(*atoms, m_frameSegmentBounds[replacement]);
+				viewer()->scene()->levelOfDetail()->chunkBounds(*atoms, m_frameChunkBounds[replacement]);
+				m_frameIndices[replacement] = frame;
+				return int(replacement);
+			}
+
+			return -1;
+		};
+
+		const int current = residentFrameBuffer(currentTimestep, 1 - m_currentFrameBuffer);
+
+		if (current >= 0)
+			m_currentFrameBuffer = uint(current);
+
+		const int next = residentFrameBuffer(nextTimestep, 1 - m_currentFrameBuffer);
+
+		currentVertices = m_frameVertices[m_currentFrameBuffer].get();
+		nextVertices = (next >= 0) ? m_frameVertices[next].get() : currentVertices;
+	}
+	else
+	{
+		currentVertices = m_vertices[currentTimestep].get();
+		nextVertices = m_vertices[nextTimestep].get();
+	}
+
+	// Offset and extent of the bounds the quantized positions of the current and next timestep are relative to
+	vec3 positionOffset = vec3(0.0f), positionExtent = vec3(1.0f);
+	vec3 nextPositionOffset = vec3(0.0f), nextPositionExtent = vec3(1.0f);
+
+	if (quantized)
+	{
+		const auto& quantizedTimesteps = viewer()->scene()->protein()->quantizedTimesteps();
+		positionOffset = quantizedTimesteps[currentTimestep].offset;
+		positionExtent = quantizedTimesteps[currentTimestep].extent;
+		nextPositionOffset = quantizedTimesteps[nextTimestep].offset;
+		nextPositionExtent = quantizedTimesteps[nextTimestep].extent;
+	}
+
+	//////////////////////////////////////////////////////////////////////////
+	// Animation pass
+	//////////////////////////////////////////////////////////////////////////
+	// The procedural animation is evaluated once for all atoms and primitives instead of in every sphere pass,
+	// the passes then draw the animated positions, which are no longer quantized
+	const bool quantizedVertices = quantized && !animate;
+
+	if (animate)
+	{
+		timer->begin("Animation");
+
+		const uint animatedVertexCount = uint(vertexCount) + viewer()->scene()->levelOfDetail()->primitiveCount();
+
+		programAnimation->setUniform("vertexCount", animatedVertexCount);
+		programAnimation->setUniform("animationDelta", animationDelta);
+		programAnimation->setUniform("animationTime", animationTime);
+		programAnimation->setUniform("animationAmplitude", animationAmplitude);
+		programAnimation->setUniform("animationFrequency", animationFrequency);
+		programAnimation->setUniform("positionOffset", positionOffset);
+		programAnimation->setUniform("positionExtent", positionExtent);
+		programAnimation->setUniform("nextPositionOffset", nextPositionOffset);
+		programAnimation->setUniform("nextPositionExtent", nextPositionExtent);
+
+		currentVertices->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+		nextVertices->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+
+		if (quantized)
+			m_atomAttributes->bindBase(GL_SHADER_STORAGE_BUFFER, 6);
+
+		m_animatedVertices->bindBase(GL_SHADER_STORAGE_BUFFER, 7);
+
+		programAnimation->dispatchCompute((animatedVertexCount + 255) / 256, 1, 1);
+		programAnimation->release();
+
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+		currentVertices = m_animatedVertices.get();
+		nextVertices = currentVertices;
+
+		timer->end();
+	}
+
 	// Vertex binding setup
+	// Quantized positions are normalized 16 bit integers, the attributes of the atoms are then stored in a separate buffer
 	auto vertexBinding = m_vao->binding(0);
 	vertexBinding->setAttribute(0);
-	vertexBinding->setBuffer(m_vertices[currentTimestep].get(), 0, sizeof(vec4));
-	vertexBinding->setFormat(4, GL_FLOAT);
+
+	if (quantizedVertices)
+	{
+		vertexBinding->setBuffer(currentVertices, 0, sizeof(u16vec3));
+		vertexBinding->setFormat(3, GL_UNSIGNED_SHORT, GL_TRUE);
+	}
+	else
+	{
+		vertexBinding->setBuffer(currentVertices, 0, sizeof(vec4));
+		vertexBinding->setFormat(4, GL_FLOAT);
+	}
+
 	m_vao->enable(0);
+	m_vao->disable(1);
+
+	if (quantizedVertices)
+	{
+		auto attributeBinding = m_vao->binding(2);
+		attributeBinding->setAttribute(2);
+		attributeBinding->setBuffer(m_atomAttributes.get(), 0, sizeof(uint));
+		attributeBinding->setIFormat(1, GL_UNSIGNED_INT);
+		m_vao->enable(2);
+	}
+	else
+	{
+		m_vao->disable(2);
+	}
+
+	// one index per copy of the asymmetric unit, advanced once per instance
+	auto instanceBinding = m_vao->binding(3);
+	instanceBinding->setAttribute(3);
+	instanceBinding->setBuffer(m_instanceIndices.get(), 0, sizeof(uint));
+	instanceBinding->setIFormat(1, GL_UNSIGNED_INT);
+	instanceBinding->setDivisor(1);
+	m_vao->enable(3);
+
+	auto pullingInstanceBinding = m_vaoPulling->binding(3);
+	pullingInstanceBinding->setAttribute(3);
+	pullingInstanceBinding->setBuffer(m_instanceIndices.get(), 0, sizeof(uint));
+	pullingInstanceBinding->setIFormat(1, GL_UNSIGNED_INT);
+	pullingInstanceBinding->setDivisor(1);
+	m_vaoPulling->enable(3);
+
+	// Vertex pulling replaces the geometry shader by two triangles per sphere, the programs take the same uniforms
+	VertexArray* vao = m_vao.get();
+
+	if (vertexPulling)
+	{
+		vao = m_vaoPulling.get();
+		programSphere = programSpherePulling;
+		programSpawn = programSpawnPulling;
+	}
+
+	// Levels of detail are selected for each chain segment and copy of the assembly by the size of its groups on screen,
+	// copies of segments outside of the view frustum are culled. Each copy is drawn by its own commands, which select its
+	// transformation through the base instance
+	const LevelOfDetail* segments = viewer()->scene()->levelOfDetail();
+	const std::vector<vec4>& segmentBounds = trajectory ? m_frameSegmentBounds[m_currentFrameBuffer] : m_segmentBounds[currentTimestep];
+	const bool indirect = (levelOfDetail || culling || occlusionCulling) && segmentBounds.size() == segments->segmentCount();
+	const bool occlusion = indirect && occlusionCulling;
+	const uint chunkCount = uint(segments->chunks().size());
+	GLsizei drawCommandCount = 0;
+
+	if (indirect)
+	{
+		const std::vector<mat4> identityTransform = { mat4(1.0f) };
+
+		LevelOfDetail::View view;
+		view.modelViewMatrix = modelViewMatrix;
+		view.projectionMatrix = projectionMatrix;
+		view.viewportHeight = float(viewportSize.y);
+		view.pixelThreshold = levelOfDetail ? levelOfDetailThreshold : 0.0f;
+		view.culling = culling;
+		view.radiusScale = radiusScale;
+		view.margin = animate ? animationAmplitude * sqrt(3.0f) : 0.0f;
+		view.merging = !occlusion;
+
+		std::vector<LevelOfDetail::Range> ranges;
+		segments->select(view, segmentBounds, (instanceCount > 1) ? viewer()->scene()->protein()->instanceTransforms() : identityTransform, ranges);
+
+		if (occlusion)
+		{
+			// The chunks are drawn at the level selected for their segment and copy, which are left out if they are culled
+			std::vector<uint> selection(size_t(segments->segmentCount()) * size_t(instanceCount), ~0u);
+
+			for (const auto& range : ranges)
+				selection[size_t(range.instance) * segments->segmentCount() + range.segment] = range.level;
+
+			const std::vector<vec4>& chunkBounds = trajectory ? m_frameChunkBounds[m_currentFrameBuffer] : m_chunkBounds[currentTimestep];
+
+			// only the radii of the atoms are scaled to their spheres of influence
+			std::vector<OcclusionChunk> chunks(chunkBounds.size());
+
+			for (size_t i = 0; i < chunks.size(); i++)
+			{
+				const LevelOfDetail::Chunk& chunk = segments->chunks()[i];
+				const float radius = chunkBounds[i].w + chunk.radius * (radiusScale - 1.0f) + view.margin;
+				chunks[i] = { vec4(vec3(chunkBounds[i]), radius), chunk.first, chunk.count, chunk.segment, chunk.level };
+			}
+
+			if (chunkCount > 0 && chunks.size() == chunkCount && !selection.empty())
+			{
+				m_occlusionChunks->setData(chunks, GL_STREAM_DRAW);
+				m_occlusionSelection->setData(selection, GL_STREAM_DRAW);
+				drawCommandCount = GLsizei(chunks.size() * size_t(instanceCount));
+			}
+		}
+		else
+		{
+			if (vertexPulling)
+			{
+				std::vector<DrawArraysIndirectCommand> commands;
+
+				for (const auto& range : ranges)
+					commands.push_back({ range.count * 6, 1, range.first * 6, range.instance });
+
+				if (!commands.empty())
+					m_levelOfDetailCommands->setData(commands, GL_STREAM_DRAW);
+
+				drawCommandCount = GLsizei(commands.size());
+			}
+			else
+			{
+				std::vector<DrawElementsIndirectCommand> commands;
+
+				for (const auto& range : ranges)
+					commands.push_back({ range.count, 1, range.first, 0, range.instance });
+
+				if (!commands.empty())
+					m_levelOfDetailCommands->setData(commands, GL_STREAM_DRAW);
+
+				drawCommandCount = GLsizei(commands.size());
+			}
+		}
+	}
+
+	// The number of commands appended by each phase of occlusion culling is taken from the GPU where possible,
+	// otherwise all commands up to the number of chunks are submitted and the ones left unused draw nothing
+	static const bool indirectParameters = hasExtension(GLextension::GL_ARB_indirect_parameters);
+
+	if (occlusion && drawCommandCount > 0)
+	{
+		const uint commandClearValue = 0;
 
-	if (timestepCount > 0)
+		for (auto& commands : m_occlusionCommands)
+		{
+			if (indirectParameters)
+				commands->clearSubData(GL_R32UI, 0, sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &commandClearValue);
+			else
+				commands->clearSubData(GL_R32UI, 0, sizeof(uint) + drawCommandCount * sizeof(DrawElementsIndirectCommand), GL_RED_INTEGER, GL_UNSIGNED_INT, &commandClearValue);
+		}
+	}
+
+	// The depth hierarchy covers the sphere framebuffer, level 0 has its full size and every further level half the size of the previous one
+	if (occlusion && !m_depthHierarchyTexture)
 	{
-		auto nextVertexBinding = m_vao->binding(1);
-		nextVertexBinding->setAttribute(1);
-		nextVertexBinding->setBuffer(m_vertices[nextTimestep].get(), 0, sizeof(vec4));
-		nextVertexBinding->setFormat(4, GL_FLOAT);
-		m_vao->enable(1);
+		m_depthHierarchyLevels = 1 + int(floor(log2(float(std::max(m_framebufferSize.x, m_framebufferSize.y)))));
+
+		m_depthHierarchyTexture = Texture::create(GL_TEXTURE_2D);
+		m_depthHierarchyTexture->setParameter(GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		m_depthHierarchyTexture->setParameter(GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		m_depthHierarchyTexture->setParameter(GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		m_depthHierarchyTexture->setParameter(GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		m_depthHierarchyTexture->setParameter(GL_TEXTURE_MAX_LEVEL, m_depthHierarchyLevels - 1);
+
+		for (int level = 0; level < m_depthHierarchyLevels; level++)
+			m_depthHierarchyTexture->image2D(level, GL_R32F, max(m_framebufferSize >> level, ivec2(1)), 0, GL_RED, GL_FLOAT, nullptr);
 	}
 
+	// Tests the chunks of the selected segments in the given phase of occlusion culling and appends the commands of the ones to draw
+	auto testOcclusion = [&](uint phase) {
+		programOcclusion->setUniform("modelViewMatrix", modelViewMatrix);
+		programOcclusion->setUniform("projectionMatrix", projectionMatrix);
+		programOcclusion->setUniform("chunkCount", chunkCount);
+		programOcclusion->setUniform("segmentCount", segments->segmentCount());
+		programOcclusion->setUniform("instanceCount", uint(instanceCount));
+		programOcclusion->setUniform("phase", phase);
+		programOcclusion->setUniform("hierarchyLevels", m_depthHierarchyLevels);
+		programOcclusion->setUniform("arrayCommands", vertexPulling);
+
+		m_depthHierarchyTexture->bindActive(0);
+		m_instanceTransforms->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+		m_occlusionChunks->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+		m_occlusionSelection->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+		m_occlusionVisibility->bindBase(GL_SHADER_STORAGE_BUFFER, 6);
+		m_occlusionCommands[phase]->bindBase(GL_SHADER_STORAGE_BUFFER, 7);
+
+		programOcclusion->dispatchCompute((uint(drawCommandCount) + 63) / 64, 1, 1);
+		programOcclusion->release();
+
+		m_depthHierarchyTexture->unbindActive(0);
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	};
+
+	// Builds the depth hierarchy from the depth buffer of the sphere pass, one level at a time
+	auto buildDepthHierarchy = [&]() {
+		for (int level = 0; level < m_depthHierarchyLevels; level++)
+		{
+			const ivec2 levelSize = max(m_framebufferSize >> level, ivec2(1));
+
+			programHierarchy->setUniform("level", level);
+
+			if (level == 0)
+				m_depthTexture->bindActive(0);
+			else
+				m_depthHierarchyTexture->bindImageTexture(0, level - 1, false, 0, GL_READ_ONLY, GL_R32F);
+
+			m_depthHierarchyTexture->bindImageTexture(1, level, false, 0, GL_WRITE_ONLY, GL_R32F);
+
+			programHierarchy->dispatchCompute((levelSize.x + 7) / 8, (levelSize.y + 7) / 8, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+
+		programHierarchy->release();
+		m_depthTexture->unbindActive(0);
+		m_depthHierarchyTexture->unbindImageTexture(0);
+		m_depthHierarchyTexture->unbindImageTexture(1);
+	};
+
+	// Binds the buffers that vertex pulling reads the atoms from, again before every draw since occlusion culling uses the same bindings
+	auto bindPulledVertices = [&]() {
+		currentVertices->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+
+		if (quantizedVertices)
+			m_atomAttributes->bindBase(GL_SHADER_STORAGE_BUFFER, 6);
+
+		m_levelOfDetailIndices->bindBase(GL_SHADER_STORAGE_BUFFER, 7);
+	};
+
+	// Draws the commands appended by one phase of occlusion culling, which follow their number
+	// Commands for vertex pulling keep the stride of DrawElementsIndirectCommand
+	auto drawOcclusionPhase = [&](uint phase) {
+		if (drawCommandCount == 0)
+			return;
+
+		const void* commands = reinterpret_cast<const void*>(sizeof(uint));
+		m_occlusionCommands[phase]->bind(GL_DRAW_INDIRECT_BUFFER);
+
+		if (vertexPulling)
+		{
+			bindPulledVertices();
+
+			if (indirectParameters)
+			{
+				m_occlusionCommands[phase]->bind(GL_PARAMETER_BUFFER_ARB);
+				glMultiDrawArraysIndirectCountARB(GL_TRIANGLES, commands, 0, drawCommandCount, sizeof(DrawElementsIndirectCommand));
+				m_occlusionCommands[phase]->unbind(GL_PARAMETER_BUFFER_ARB);
+			}
+			else
+			{
+				glMultiDrawArraysIndirect(GL_TRIANGLES, commands, drawCommandCount, sizeof(DrawElementsIndirectCommand));
+			}
+		}
+		else if (indirectParameters)
+		{
+			m_occlusionCommands[phase]->bind(GL_PARAMETER_BUFFER_ARB);
+			glMultiDrawElementsIndirectCountARB(GL_POINTS, GL_UNSIGNED_INT, commands, 0, drawCommandCount, 0);
+			m_occlusionCommands[phase]->unbind(GL_PARAMETER_BUFFER_ARB);
+		}
+		else
+		{
+			glMultiDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, commands, drawCommandCount, 0);
+		}
+
+		m_occlusionCommands[phase]->unbind(GL_DRAW_INDIRECT_BUFFER);
+	};
+
+	// Draws either all atoms or the selected ranges, with one instance for each copy of the biological assembly
+	// With occlusion culling, the chunks drawn by both phases of the sphere pass are drawn
+	auto drawSpheres = [&]() {
+		if (occlusion)
+		{
+			drawOcclusionPhase(0);
+			drawOcclusionPhase(1);
+			return;
+		}
+
+		if (vertexPulling)
+		{
+			bindPulledVertices();
+
+			if (!indirect)
+			{
+				vao->drawArraysInstanced(GL_TRIANGLES, 0, vertexCount * 6, instanceCount);
+			}
+			else if (drawCommandCount > 0)
+			{
+				m_levelOfDetailCommands->bind(GL_DRAW_INDIRECT_BUFFER);
+				glMultiDrawArraysIndirect(GL_TRIANGLES, nullptr, drawCommandCount, 0);
+				m_levelOfDetailCommands->unbind(GL_DRAW_INDIRECT_BUFFER);
+			}
+		}
+		else if (!indirect)
+		{
+			vao->drawArraysInstanced(GL_POINTS, 0, vertexCount, instanceCount);
+		}
+		else if (drawCommandCount > 0)
+		{
+			m_levelOfDetailCommands->bind(GL_DRAW_INDIRECT_BUFFER);
+			glMultiDrawElementsIndirect(GL_POINTS, GL_UNSIGNED_INT, nullptr, drawCommandCount, 0);
+			m_levelOfDetailCommands->unbind(GL_DRAW_INDIRECT_BUFFER);
+		}
+	};
+
 	//////////////////////////////////////////////////////////////////////////
 	// Shadow rendering pass
 	//////////////////////////////////////////////////////////////////////////
@@ -707,12 +1563,20 @@ void SphereRenderer::display()
 	programShadow->setUniform("animationTime", animationTime);
 	programShadow->setUniform("animationAmplitude", animationAmplitude);
 	programShadow->setUniform("animationFrequency", animationFrequency);
+	programShadow->setUniform("positionOffset", positionOffset);
+	programShadow->setUniform("positionExtent", positionExtent);
+	programShadow->setUniform("nextPositionOffset", nextPositionOffset);
+	programShadow->setUniform("nextPositionExtent", nextPositionExtent);
+
+	m_instanceTransforms->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
 
 	m_vao->bind();
 	programShadow->use();
-	m_vao->drawArrays(GL_POINTS, 0, vertexCount);
+	drawSpheres();
 	programShadow->release();
 	m_vao->unbind();
+
+	m_instanceTransforms->unbind(GL_SHADER_STORAGE_BUFFER);
 	m_shadowFramebuffer->unbind();
 
 	glDisable(GL_BLEND);
@@ -724,11 +1588,22 @@ void SphereRenderer::display()
 	//////////////////////////////////////////////////////////////////////////
 	// Sphere rendering pass
 	//////////////////////////////////////////////////////////////////////////
+	timer->begin("Spheres");
+
 	m_sphereFramebuffer->bind();
+	m_sphereFramebuffer->setDrawBuffers({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 });
 	glClearDepth(1.0f);
 	glClearColor(0.0, 0.0, 0.0, 65535.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+	// the integer atom ID attachment is only written when picking and has to be cleared separately
+	if (picking)
+	{
+		const uvec4 atomIdClearValue = uvec4(0);
+		m_sphereFramebuffer->setDrawBuffers({ GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 });
+		glClearBufferuiv(GL_COLOR, 2, value_ptr(atomIdClearValue));
+	}
+
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
@@ -739,26 +1614,138 @@ void SphereRenderer::display()
 	programSphere->setUniform("radiusScale", 1.0f);
 	programSphere->setUniform("clipRadiusScale", radiusScale);
 	programSphere->setUniform("nearPlaneZ", nearPlane.z);
-	programSphere->setUniform("animationDelta", animationDelta);
-	programSphere->setUniform("animationTime", animationTime);
-	programSphere->setUniform("animationAmplitude", animationAmplitude);
-	programSphere->setUniform("animationFrequency", animationFrequency);
+	programSphere->setUniform("positionOffset", positionOffset);
+	programSphere->setUniform("positionExtent", positionExtent);
 
-	m_vao->bind();
-	programSphere->use();
-	m_vao->drawArrays(GL_POINTS, 0, vertexCount);
-	programSphere->release();
-	m_vao->unbind();
+	m_instanceTransforms->bindBase(GL_SHADER_STORAGE_BUFFER, 3);
+
+	// With occlusion culling, the chunks visible in the previous frame are drawn first, the rest is tested against
+	// the depth hierarchy of what these cover and drawn if visible
+	if (occlusion && drawCommandCount > 0)
+	{
+		testOcclusion(0);
+
+		vao->bind();
+		programSphere->use();
+		drawOcclusionPhase(0);
+		programSphere->release();
+		vao->unbind();
+
+		buildDepthHierarchy();
+		testOcclusion(1);
+
+		vao->bind();
+		programSphere->use();
+		drawOcclusionPhase(1);
+		programSphere->release();
+		vao->unbind();
+	}
+	else
+	{
+		vao->bind();
+		programSphere->use();
+		drawSpheres();
+		programSphere->release();
+		vao->unbind();
+	}
+
+	// Copy the atom ID under the cursor into a buffer that is read back once the GPU has caught up
+	// If the copy of an earlier frame is still in flight, this frame is skipped instead of waiting
+	if (picking && cursorInside)
+	{
+		if (Buffer* pickingBuffer = m_pickingReadback->begin())
+		{
+			pickingBuffer->bind(GL_PIXEL_PACK_BUFFER);
+			m_sphereFramebuffer->setReadBuffer(GL_COLOR_ATTACHMENT2);
+			glReadPixels(cursorPixel.x, viewportSize.y - 1 - cursorPixel.y, 1, 1, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+			pickingBuffer->unbind(GL_PIXEL_PACK_BUFFER);
+			m_pickingReadback->end();
+		}
+	}
+
+	timer->end();
 
 	//////////////////////////////////////////////////////////////////////////
 	// List generation pass
 	//////////////////////////////////////////////////////////////////////////
+	timer->begin("Lists");
+
+	// The number of entries needed by an earlier frame decides whether the intersection buffer has to grow or can shrink
+	if (const void* intersectionData = m_intersectionReadback->read())
+	{
+		m_intersectionDemand = *static_cast<const uint*>(intersectionData) + (listCompaction ? 1 : 0);
+		updateIntersectionCapacity(m_intersectionDemand);
+	}
+	else if (!m_intersectionBuffer)
+		updateIntersectionCapacity(0);
+
 	const uint intersectionClearValue = 1;
 	m_intersectionBuffer->clearSubData(GL_R32UI, 0, sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &intersectionClearValue);
 
 	const uint offsetClearValue = 0;
 	m_offsetTexture->clearImage(0, GL_RED_INTEGER, GL_UNSIGNED_INT, &offsetClearValue);
 
+	// Compacted lists store the entries of each pixel next to each other, at offsets found by a prefix sum over the counts of all pixels
+	// The prefix sum works on blocks of 1024 values, the sums of the blocks are scanned the same way level by level down to a single block
+	const uint prefixSumBlockSize = 1024;
+	const uint pixelCount = uint(m_framebufferSize.x) * uint(m_framebufferSize.y);
+
+	if (listCompaction)
+	{
+		if (!m_listOffsets)
+		{
+			m_listOffsets = Buffer::create();
+			m_listOffsets->setStorage((pixelCount + 1) * sizeof(uint), nullptr, gl::GL_NONE_BIT);
+
+			uint count = pixelCount + 1;
+
+			do
+			{
+				count = (count + prefixSumBlockSize - 1) / prefixSumBlockSize;
+				m_listOffsetSums.push_back(Buffer::create());
+				m_listOffsetSums.back()->setStorage(count * sizeof(uint), nullptr, gl::GL_NONE_BIT);
+			} while (count > 1);
+		}
+
+		m_listOffsets->clearSubData(GL_R32UI, 0, (pixelCount + 1) * sizeof(uint), GL_RED_INTEGER, GL_UNSIGNED_INT, &offsetClearValue);
+	}
+
+	// Turns the number of entries of each pixel into the index of its first entry, the value after the last pixel becomes the total
+	auto prefixSumListOffsets = [&]() {
+		std::vector<Buffer*> values = { m_listOffsets.get() };
+		std::vector<uint> counts = { pixelCount + 1 };
+
+		for (auto& sums : m_listOffsetSums)
+		{
+			values.push_back(sums.get());
+			counts.push_back((counts.back() + prefixSumBlockSize - 1) / prefixSumBlockSize);
+		}
+
+		programPrefixSum->setUniform("pass", 0u);
+
+		for (size_t level = 0; level + 1 < values.size(); level++)
+		{
+			values[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+			values[level + 1]->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+			programPrefixSum->setUniform("valueCount", counts[level]);
+			programPrefixSum->dispatchCompute(counts[level + 1], 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+
+		programPrefixSum->setUniform("pass", 1u);
+
+		for (size_t level = values.size() - 2; level-- > 0;)
+		{
+			values[level]->bindBase(GL_SHADER_STORAGE_BUFFER, 4);
+			values[level + 1]->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+			programPrefixSum->setUniform("valueCount", counts[level]);
+			programPrefixSum->dispatchCompute(counts[level + 1], 1, 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+
+		programPrefixSum->release();
+	};
+
 	glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
 	glDepthFunc(GL_ALWAYS);
@@ -770,6 +1757,7 @@ void SphereRenderer::display()
 	m_elementColorsRadii->bindBase(GL_UNIFORM_BUFFER, 0);
 	m_residueColors->bindBase(GL_UNIFORM_BUFFER, 1);
 	m_chainColors->bindBase(GL_UNIFORM_BUFFER, 2);
+	m_intersectionBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
 
 	programSpawn->setUniform("modelViewMatrix", modelViewMatrix);
 	programSpawn->setUniform("projectionMatrix", projectionMatrix);
@@ -778,18 +1766,36 @@ void SphereRenderer::display()
 	programSpawn->setUniform("radiusScale", radiusScale);
 	programSpawn->setUniform("clipRadiusScale", radiusScale);
 	programSpawn->setUniform("nearPlaneZ", nearPlane.z);
-	programSpawn->setUniform("animationDelta", animationDelta);
-	programSpawn->setUniform("animationTime", animationTime);
-	programSpawn->setUniform("animationAmplitude", animationAmplitude);
-	programSpawn->setUniform("animationFrequency", animationFrequency);
+	programSpawn->setUniform("positionOffset", positionOffset);
+	programSpawn->setUniform("positionExtent", positionExtent);
 
-	m_vao->bind();
+	if (listCompaction)
+	{
+		// the spheres are drawn twice, first to count the entries of every pixel and then to store them at their offsets
+		m_listOffsets->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+		programSpawn->setUniform("counting", true);
+
+		vao->bind();
+		programSpawn->use();
+		drawSpheres();
+		programSpawn->release();
+		vao->unbind();
+
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		prefixSumListOffsets();
+
+		m_listOffsets->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
+		programSpawn->setUniform("counting", false);
+	}
+
+	vao->bind();
 	programSpawn->use();
-	m_vao->drawArrays(GL_POINTS, 0, vertexCount);
+	drawSpheres();
 	programSpawn->release();
-	m_vao->unbind();
+	vao->unbind();
 
 
+	m_instanceTransforms->unbind(GL_SHADER_STORAGE_BUFFER);
 	m_spherePositionTexture->unbindActive(0);
 	m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
 	m_offsetTexture->unbindImageTexture(0);
@@ -797,9 +1803,29 @@ void SphereRenderer::display()
 	m_sphereFramebuffer->unbind();
 	glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
+	// Copy the number of entries the frame needed, which the count of the linked lists holds including the unused first entry
+	// Compacted lists keep their total after the offsets of the pixels instead
+	if (Buffer* intersectionReadbackBuffer = m_intersectionReadback->begin())
+	{
+		if (listCompaction)
+		{
+			m_listOffsets->copySubData(intersectionReadbackBuffer, GLintptr(pixelCount) * sizeof(uint), 0, sizeof(uint));
+		}
+		else
+		{
+			m_intersectionBuffer->copySubData(intersectionReadbackBuffer, 0, 0, sizeof(uint));
+		}
+
+		m_intersectionReadback->end();
+	}
+
+	timer->end();
+
 	//////////////////////////////////////////////////////////////////////////
 	// Surface intersection pass
 	//////////////////////////////////////////////////////////////////////////
+	timer->begin("Surface");
+
 	m_surfaceFramebuffer->bind();
 	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 	glDepthMask(GL_TRUE);
@@ -815,7 +1841,16 @@ void SphereRenderer::display()
 	m_bumpTextures[bumpTextureIndex]->bindActive(5);
 	m_materialTextures[materialTextureIndex]->bindActive(6);
 	m_intersectionBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 1);
-	m_statisticsBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+
+	if (statistics)
+	{
+		const uint statisticsClearValue = 0;
+		m_statisticsBuffer->clearData(GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &statisticsClearValue);
+		m_statisticsBuffer->bindBase(GL_SHADER_STORAGE_BUFFER, 2);
+	}
+
+	if (listCompaction)
+		m_listOffsets->bindBase(GL_SHADER_STORAGE_BUFFER, 5);
 
 	programSurface->setUniform("modelViewMatrix", modelViewMatrix);
 	programSurface->setUniform("projectionMatrix", projectionMatrix);
@@ -847,6 +1882,20 @@ void SphereRenderer::display()
 
 	m_intersectionBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
 
+	// Copy the statistics once the surface pass has accumulated them, frames are skipped while all copies are still in flight
+	if (statistics)
+	{
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+		if (Buffer* statisticsReadbackBuffer = m_statisticsReadback->begin())
+		{
+			m_statisticsBuffer->copySubData(statisticsReadbackBuffer, 0, 0, sizeof(uvec4));
+			m_statisticsReadback->end();
+		}
+
+		m_statisticsBuffer->unbind(GL_SHADER_STORAGE_BUFFER);
+	}
+
 	m_materialTextures[materialTextureIndex]->unbindActive(6);
 	m_bumpTextures[bumpTextureIndex]->unbindActive(5);
 	m_environmentTextures[environmentTextureIndex]->unbindActive(4);
@@ -860,12 +1909,16 @@ void SphereRenderer::display()
 
 	m_surfaceFramebuffer->unbind();
 
+	timer->end();
+
 
 	//////////////////////////////////////////////////////////////////////////
 	// Ambient occlusion (optional)
 	//////////////////////////////////////////////////////////////////////////
 	if (ambientOcclusion)
 	{
+		timer->begin("Ambient Occlusion");
+
 		//////////////////////////////////////////////////////////////////////////
 		// Ambient occlusion sampling
 		//////////////////////////////////////////////////////////////////////////
@@ -926,11 +1979,15 @@ void SphereRenderer::display()
 		m_surfaceNormalTexture->unbindActive(0);
 
 		m_aoFramebuffer->unbind();
+
+		timer->end();
 	}
 
 	//////////////////////////////////////////////////////////////////////////
 	// Shading
 	//////////////////////////////////////////////////////////////////////////
+	timer->begin("Shading");
+
 	m_shadeFramebuffer->bind();
 	glDepthMask(GL_FALSE);
 
@@ -1010,12 +2067,16 @@ void SphereRenderer::display()
 
 	m_shadeFramebuffer->unbind();
 
+	timer->end();
+
 
 	//////////////////////////////////////////////////////////////////////////
 	// Depth of field (optional)
 	//////////////////////////////////////////////////////////////////////////
 	if (depthOfField)
 	{
+		timer->begin("Depth of Field");
+
 		//////////////////////////////////////////////////////////////////////////
 		// Depth of field blurring -- horizontal
 		//////////////////////////////////////////////////////////////////////////
@@ -1097,6 +2158,8 @@ void SphereRenderer::display()
 		m_surfaceDiffuseTexture->unbindActive(1);
 		m_sphereDiffuseTexture->unbindActive(0);
 		m_shadeFramebuffer->unbind();
+
+		timer->end();
 	}
 /*
 	if (viewportSize == viewer()->viewportSize())
@@ -1106,6 +2169,8 @@ void SphereRenderer::display()
 	}
 	else*/
 	{
+		timer->begin("Display");
+
 		m_colorTexture->bindActive(0);
 		m_depthTexture->bindActive(1);
 
@@ -1123,8 +2188,12 @@ void SphereRenderer::display()
 
 		m_depthTexture->unbindActive(1);
 		m_colorTexture->unbindActive(0);
+
+		timer->end();
 	}
 
+	timer->end();
+
 	// Restore OpenGL state
 	currentState->apply();
 }
\ No newline at end of file
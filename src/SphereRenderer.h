@@ -1,6 +1,9 @@
 #pragma once
 #include "Renderer.h"
+#include "ReadbackBuffer.h"
 #include <memory>
+#include <array>
+#include <fstream>
 
 #include <glm/glm.hpp>
 #include <glbinding/gl/gl.h>
@@ -31,12 +34,57 @@ namespace dynamol
 		virtual void display();
 
 	private:
-		
+		void uploadProtein();
+
+		// Adapts the size of the intersection buffer to the number of entries that recent frames have needed
+		void updateIntersectionCapacity(glm::uint demand);
+
+		// Load count of the scene when the protein buffers were created
+		size_t m_loadCount = ~size_t(0);
+
 		std::vector< std::unique_ptr<globjects::Buffer> > m_vertices;
+		std::unique_ptr<globjects::Buffer> m_atomAttributes = std::make_unique<globjects::Buffer>();
+
+		// Vertices of the current and next trajectory frame when a trajectory is streamed
+		std::array< std::unique_ptr<globjects::Buffer>, 2 > m_frameVertices;
+		std::array<glm::uint, 2> m_frameIndices = { ~0u, ~0u };
+		glm::uint m_currentFrameBuffer = 0;
+
+		// Positions of the atoms and primitives with the procedural animation applied, written by the animation pass and drawn by all sphere passes
+		std::unique_ptr<globjects::Buffer> m_animatedVertices = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::VertexArray> m_vao = std::make_unique<globjects::VertexArray>();
+
+		// Vertex pulling reads the atoms from storage buffers, its vertex array only holds the instanced index of the copy of the assembly
+		std::unique_ptr<globjects::VertexArray> m_vaoPulling = std::make_unique<globjects::VertexArray>();
 		std::unique_ptr<globjects::Buffer> m_elementColorsRadii = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::Buffer> m_residueColors = std::make_unique<globjects::Buffer>();
 		std::unique_ptr<globjects::Buffer> m_chainColors = std::make_unique<globjects::Buffer>();
+
+		// Transformations of the asymmetric unit into the copies of the biological assembly
+		std::unique_ptr<globjects::Buffer> m_instanceTransforms = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_instanceIndices = std::make_unique<globjects::Buffer>();
+
+		// Vertex indices of all levels of detail and the draw commands for the levels selected in the current frame
+		// The vertices of the coarser levels are stored after the atoms in every vertex buffer
+		std::unique_ptr<globjects::Buffer> m_levelOfDetailIndices = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_levelOfDetailCommands = std::make_unique<globjects::Buffer>();
+
+		// Bounds of the chain segments for culling and of their chunks for occlusion culling,
+		// for each timestep and for the trajectory frames in m_frameVertices
+		std::vector< std::vector<glm::vec4> > m_segmentBounds;
+		std::array< std::vector<glm::vec4>, 2 > m_frameSegmentBounds;
+		std::vector< std::vector<glm::vec4> > m_chunkBounds;
+		std::array< std::vector<glm::vec4>, 2 > m_frameChunkBounds;
+
+		// Two-phase occlusion culling of the chunks of the selected segments against a depth hierarchy built from the sphere pass
+		// The visibility of every chunk and copy of the assembly is kept from one frame to the next, each phase appends the commands
+		// of the chunks it draws to its own buffer, which starts with their number
+		std::unique_ptr<globjects::Buffer> m_occlusionChunks = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_occlusionSelection = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<globjects::Buffer> m_occlusionVisibility = std::make_unique<globjects::Buffer>();
+		std::array< std::unique_ptr<globjects::Buffer>, 2 > m_occlusionCommands;
+		std::unique_ptr<globjects::Texture> m_depthHierarchyTexture = nullptr;
+		int m_depthHierarchyLevels = 0;
 		
 		std::unique_ptr<globjects::VertexArray> m_vaoQuad = std::make_unique<globjects::VertexArray>();
 		std::unique_ptr<globjects::Buffer> m_verticesQuad = std::make_unique<globjects::Buffer>();
@@ -44,12 +92,33 @@ namespace dynamol
 		std::unique_ptr<globjects::StaticStringSource> m_shaderSourceDefines = nullptr;
 		std::unique_ptr<globjects::NamedString> m_shaderDefines = nullptr;
 
-		std::unique_ptr<globjects::Buffer> m_intersectionBuffer = std::make_unique<globjects::Buffer>();
+		// Intersections of the spheres of influence with the rays of all pixels, sized by the peak demand of the recent frames
+		// The number of entries a frame needed is read back a few frames later, frames that overflow the buffer drop the excess entries
+		std::unique_ptr<globjects::Buffer> m_intersectionBuffer = nullptr;
+		std::unique_ptr<ReadbackBuffer> m_intersectionReadback;
+		std::vector<glm::uint> m_intersectionDemands;
+		glm::uint m_intersectionDemandIndex = 0;
+		glm::uint m_intersectionDemand = 0;
+		glm::uint m_intersectionCapacity = 0;
+		glm::uint m_intersectionCapacityLimit = 0;
+		bool m_intersectionLimitReported = false;
+
+		// First intersection of every pixel for compacted lists, followed by the total, and the sums of the blocks of each level of the prefix sum
+		std::unique_ptr<globjects::Buffer> m_listOffsets = nullptr;
+		std::vector< std::unique_ptr<globjects::Buffer> > m_listOffsetSums;
+
+		// Pixels hitting the surface, pixels with a non-empty list, entries of all lists and entries of the longest list, accumulated by the surface pass
+		// The statistics are read back a few frames later and can be appended to a CSV file along with the parameters they were measured with
 		std::unique_ptr<globjects::Buffer> m_statisticsBuffer = std::make_unique<globjects::Buffer>();
+		std::unique_ptr<ReadbackBuffer> m_statisticsReadback;
+		glm::uvec4 m_statistics = glm::uvec4(0);
+		std::ofstream m_statisticsLog;
+
 		std::unique_ptr<globjects::Texture> m_offsetTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_depthTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_spherePositionTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_sphereNormalTexture = nullptr;
+		std::unique_ptr<globjects::Texture> m_atomIdTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_surfacePositionTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_surfaceNormalTexture = nullptr;
 		std::unique_ptr<globjects::Texture> m_sphereDiffuseTexture = nullptr;
@@ -74,6 +143,11 @@ namespace dynamol
 		std::vector< std::unique_ptr<globjects::Texture> > m_materialTextures;
 		std::vector< std::unique_ptr<globjects::Texture> > m_bumpTextures;
 
+		// Atom under the cursor, read back from the atom ID attachment a few frames later so that the pipeline never stalls
+		// Holds the index of the atom plus one (zero if there is none) and the index of its copy in the biological assembly
+		std::unique_ptr<ReadbackBuffer> m_pickingReadback;
+		glm::uvec2 m_pickedAtom = glm::uvec2(0);
+
 		glm::ivec2 m_shadowMapSize = glm::ivec2(512, 512);
 		glm::ivec2 m_framebufferSize;
 	};
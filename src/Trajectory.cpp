@@ -0,0 +1,65 @@
+#include "Trajectory.h"
+#include "DcdTrajectory.h"
+#include "XtcTrajectory.h"
+#include "PdbTrajectory.h"
+
+#include <algorithm>
+#include <cctype>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+
+std::unique_ptr<Trajectory> Trajectory::open(const std::string& filename)
+{
+	std::string extension = filename.substr(std::min(filename.find_last_of('.'), filename.size()));
+	std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+
+	std::unique_ptr<Trajectory> trajectory;
+
+	if (extension == ".dcd")
+		trajectory.reset(new DcdTrajectory(filename));
+	else if (extension == ".xtc")
+		trajectory.reset(new XtcTrajectory(filename));
+	else if (extension == ".pdb")
+		trajectory.reset(new PdbTrajectory(filename));
+	else
+	{
+		globjects::critical() << "Unknown trajectory format " << extension << "!";
+		return nullptr;
+	}
+
+	globjects::debug() << "Opening trajectory " << filename << " ...";
+
+	if (!trajectory->readHeader())
+	{
+		globjects::critical() << "Could not read trajectory " << filename << "!";
+		return nullptr;
+	}
+
+	globjects::debug() << trajectory->frameCount() << " frames of " << trajectory->atomCount() << " atoms found.";
+
+	return trajectory;
+}
+
+Trajectory::Trajectory(const std::string& filename) : m_filename(filename)
+{
+}
+
+Trajectory::~Trajectory()
+{
+}
+
+const std::string& Trajectory::filename() const
+{
+	return m_filename;
+}
+
+glm::uint Trajectory::atomCount() const
+{
+	return m_atomCount;
+}
+
+glm::uint Trajectory::frameCount() const
+{
+	return m_frameCount;
+}
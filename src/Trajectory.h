@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Atom positions of a molecular dynamics run, stored separately from the topology
+	// Frames are read on demand, so trajectories do not need to fit into memory
+	class Trajectory
+	{
+	public:
+		// Opens a trajectory based on the file extension, returns nullptr if the file cannot be read
+		static std::unique_ptr<Trajectory> open(const std::string& filename);
+
+		virtual ~Trajectory();
+
+		const std::string& filename() const;
+		glm::uint atomCount() const;
+
+		// Trajectories that are indexed in the background may report a growing number of frames
+		virtual glm::uint frameCount() const;
+
+		// Reads the positions of one frame in Angstrom
+		// Calls must not overlap, but they do not have to come from the thread that opened the trajectory
+		virtual bool readFrame(glm::uint frame, std::vector<glm::vec3>& positions) = 0;
+
+	protected:
+		Trajectory(const std::string& filename);
+		virtual bool readHeader() = 0;
+
+		std::string m_filename;
+		glm::uint m_atomCount = 0;
+		glm::uint m_frameCount = 0;
+	};
+}
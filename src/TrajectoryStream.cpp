@@ -0,0 +1,178 @@
+#include "TrajectoryStream.h"
+#include "Trajectory.h"
+
+#include <algorithm>
+#include <chrono>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+TrajectoryStream::TrajectoryStream(std::unique_ptr<Trajectory> trajectory, const std::vector<vec4>& topology, const std::vector<uint>& order, uint capacity, uint lookahead) : m_trajectory(std::move(trajectory))
+{
+	// frames are only reordered if the order covers all of their atoms
+	if (order.size() == m_trajectory->atomCount())
+		m_order = order;
+
+	m_attributes.resize(m_trajectory->atomCount(), 0.0f);
+
+	for (size_t i = 0; i < std::min(m_attributes.size(), topology.size()); i++)
+		m_attributes[i] = topology[i].w;
+
+	// the renderer reads the current and the following frame, both have to stay resident
+	m_lookahead = std::max(2u, lookahead);
+
+	// slots only allocate memory once they hold a frame, so short trajectories simply leave some of them empty
+	m_slots.resize(std::max(m_lookahead, capacity));
+
+	m_thread = std::thread(&TrajectoryStream::decode, this);
+}
+
+TrajectoryStream::~TrajectoryStream()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+const Trajectory* TrajectoryStream::trajectory() const
+{
+	return m_trajectory.get();
+}
+
+uint TrajectoryStream::frameCount() const
+{
+	return m_trajectory->frameCount();
+}
+
+uint TrajectoryStream::atomCount() const
+{
+	return m_trajectory->atomCount();
+}
+
+void TrajectoryStream::setPosition(uint frame)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		if (frame == m_position)
+			return;
+
+		m_position = frame;
+	}
+
+	m_condition.notify_all();
+}
+
+const std::vector<vec4>* TrajectoryStream::frame(uint index) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	for (auto& slot : m_slots)
+	{
+		if (slot.frame == index)
+		{
+			slot.lastUse = ++m_useCount;
+			return &slot.atoms;
+		}
+	}
+
+	return nullptr;
+}
+
+// Frames from the playback position on up to the lookahead, wrapping around at the end
+bool TrajectoryStream::isAhead(uint frame) const
+{
+	const uint frameCount = m_trajectory->frameCount();
+	const uint distance = (frame + frameCount - m_position % frameCount) % frameCount;
+
+	return distance < m_lookahead;
+}
+
+void TrajectoryStream::decode()
+{
+	std::vector<vec3> positions;
+	std::vector<vec4> atoms;
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+
+	while (!m_stop)
+	{
+		// decode the first frame ahead of the playback position that is missing
+		const uint frameCount = m_trajectory->frameCount();
+		uint frame = ~0u;
+
+		for (uint i = 0; i < std::min(m_lookahead, frameCount) && frame == ~0u; i++)
+		{
+			const uint candidate = (m_position + i) % frameCount;
+			auto match = std::find_if(m_slots.begin(), m_slots.end(), [&](const Slot& slot) { return slot.frame == candidate; });
+
+			if (match == m_slots.end())
+				frame = candidate;
+		}
+
+		if (frame == ~0u)
+		{
+			// trajectories that are still being indexed can grow without the playback position changing
+			m_condition.wait_for(lock, std::chrono::milliseconds(100));
+			continue;
+		}
+
+		lock.unlock();
+
+		const bool success = m_trajectory->readFrame(frame, positions);
+
+		if (success)
+		{
+			atoms.resize(positions.size());
+
+			if (m_order.size() != positions.size())
+			{
+				for (size_t i = 0; i < positions.size(); i++)
+					atoms[i] = vec4(positions[i], m_attributes[i]);
+			}
+			else
+			{
+				for (size_t i = 0; i < positions.size(); i++)
+					atoms[i] = vec4(positions[m_order[i]], m_attributes[i]);
+			}
+		}
+
+		lock.lock();
+
+		if (!success)
+		{
+			globjects::warning() << "Could not read frame " << frame << " of trajectory " << m_trajectory->filename() << "!";
+
+			// keep the previous contents but stop retrying until the playback position changes
+			const uint position = m_position;
+			m_condition.wait(lock, [&]() { return m_stop || m_position != position; });
+			continue;
+		}
+
+		// the playback position may have moved while decoding
+		// there are at least as many slots as frames ahead, so one of them always holds a frame that is no longer needed
+		// of these, empty slots are used first and then the least recently used frame is replaced
+		if (isAhead(frame))
+		{
+			Slot* replacement = nullptr;
+
+			for (auto& slot : m_slots)
+			{
+				if ((slot.frame == ~0u || !isAhead(slot.frame)) && (!replacement || slot.lastUse < replacement->lastUse))
+					replacement = &slot;
+			}
+
+			if (replacement)
+			{
+				replacement->atoms.swap(atoms);
+				replacement->frame = frame;
+				replacement->lastUse = ++m_useCount;
+			}
+		}
+	}
+}
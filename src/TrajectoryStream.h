@@ -0,0 +1,63 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	class Trajectory;
+
+	// Decodes trajectory frames ahead of the playback position on a background thread
+	// At most capacity frames are kept, so memory use does not depend on the length of the trajectory
+	// Frames behind the playback position stay resident until they are the least recently used ones, which keeps scrubbing back cheap
+	class TrajectoryStream
+	{
+	public:
+		// Atom attributes (the w component of the atoms) are taken from the topology, positions from the trajectory
+		// The order maps each atom of the topology to an atom of the trajectory, an empty order keeps the atoms of the trajectory as they are
+		// The lookahead is the number of frames from the playback position on that are decoded in advance
+		TrajectoryStream(std::unique_ptr<Trajectory> trajectory, const std::vector<glm::vec4>& topology, const std::vector<glm::uint>& order = {}, glm::uint capacity = 32, glm::uint lookahead = 8);
+		~TrajectoryStream();
+
+		const Trajectory* trajectory() const;
+		glm::uint frameCount() const;
+		glm::uint atomCount() const;
+
+		// Moves the playback position, the following frames are decoded in the background
+		void setPosition(glm::uint frame);
+
+		// Returns a decoded frame or nullptr if it has not been decoded yet
+		// The data stays valid until the playback position is changed
+		const std::vector<glm::vec4>* frame(glm::uint index) const;
+
+	private:
+		struct Slot
+		{
+			glm::uint frame = ~0u;
+			std::uint64_t lastUse = 0;
+			std::vector<glm::vec4> atoms;
+		};
+
+		void decode();
+		bool isAhead(glm::uint frame) const;
+
+		std::unique_ptr<Trajectory> m_trajectory;
+		std::vector<float> m_attributes;
+		std::vector<glm::uint> m_order;
+		mutable std::vector<Slot> m_slots;
+		mutable std::uint64_t m_useCount = 0;
+
+		glm::uint m_lookahead = 0;
+		glm::uint m_position = 0;
+		bool m_stop = false;
+
+		mutable std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::thread m_thread;
+	};
+}
@@ -0,0 +1,288 @@
+#include "UniformGrid.h"
+#include "Parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	// Upper limit for the number of cells per atom, keeps the offsets small for sparse structures
+	const size_t maximumCellsPerAtom = 4;
+}
+
+UniformGrid::UniformGrid(float cellSize) : m_requestedCellSize(cellSize), m_cellSize(cellSize)
+{
+}
+
+void UniformGrid::build(const std::vector<vec4>& atoms)
+{
+	m_atomCount = uint(atoms.size());
+	m_threadCount = parallelThreadCount(atoms.size(), atomsPerThread);
+
+	std::vector<vec3> minimumBounds(m_threadCount, vec3(std::numeric_limits<float>::max()));
+	std::vector<vec3> maximumBounds(m_threadCount, vec3(-std::numeric_limits<float>::max()));
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+		{
+			minimumBounds[thread] = min(minimumBounds[thread], vec3(atoms[i]));
+			maximumBounds[thread] = max(maximumBounds[thread], vec3(atoms[i]));
+		}
+	});
+
+	vec3 minimum = atoms.empty() ? vec3(0.0f) : minimumBounds.front();
+	vec3 maximum = atoms.empty() ? vec3(0.0f) : maximumBounds.front();
+
+	for (uint i = 1; i < m_threadCount; i++)
+	{
+		minimum = min(minimum, minimumBounds[i]);
+		maximum = max(maximum, maximumBounds[i]);
+	}
+
+	// the margin lets moving atoms stay in their grid for a while
+	m_cellSize = m_requestedCellSize;
+
+	const size_t maximumCellCount = std::max(size_t(64), atoms.size() * maximumCellsPerAtom);
+	const vec3 extent = maximum - minimum + vec3(2.0f * m_requestedCellSize);
+	const double cellCount = double(extent.x) * double(extent.y) * double(extent.z) / pow(double(m_cellSize), 3.0);
+
+	if (cellCount > double(maximumCellCount))
+		m_cellSize *= float(cbrt(cellCount / double(maximumCellCount)));
+
+	m_minimumBounds = minimum - vec3(m_requestedCellSize);
+	m_resolution = max(ivec3(1), ivec3(ceil(extent / m_cellSize)));
+	m_cellCount = size_t(m_resolution.x) * size_t(m_resolution.y) * size_t(m_resolution.z);
+
+	m_cellOffsets.resize(m_cellCount + 1);
+	m_cellCounters = std::make_unique<std::atomic<uint>[]>(m_cellCount);
+	m_atomCells.resize(atoms.size());
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+			cellIndex(vec3(atoms[i]), m_atomCells[i]);
+	});
+
+	sort(atoms);
+}
+
+void UniformGrid::update(const std::vector<vec4>& atoms)
+{
+	if (atoms.size() != m_atomCount || m_cellCount == 0)
+	{
+		build(atoms);
+		return;
+	}
+
+	std::vector<uint> movedCounts(m_threadCount, 0);
+	std::vector<char> outside(m_threadCount, 0);
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+		{
+			uint index = 0;
+
+			if (!cellIndex(vec3(atoms[i]), index))
+			{
+				outside[thread] = 1;
+				return;
+			}
+
+			if (index != m_atomCells[i])
+			{
+				m_atomCells[i] = index;
+				movedCounts[thread]++;
+			}
+		}
+	});
+
+	// atoms that left the margin need a new grid
+	if (std::find(outside.begin(), outside.end(), 1) != outside.end())
+	{
+		build(atoms);
+		return;
+	}
+
+	uint movedCount = 0;
+
+	for (auto count : movedCounts)
+		movedCount += count;
+
+	if (movedCount > 0)
+		sort(atoms);
+	else
+		gatherPositions(atoms);
+}
+
+// Counting sort of the atoms into their cells, m_atomCells has to be up to date
+void UniformGrid::sort(const std::vector<vec4>& atoms)
+{
+	const uint threadCount = m_threadCount;
+
+	runParallel(threadCount, [&](uint thread) {
+		for (size_t c = rangeBegin(m_cellCount, thread, threadCount); c < rangeBegin(m_cellCount, thread + 1, threadCount); c++)
+			m_cellCounters[c].store(0, std::memory_order_relaxed);
+	});
+
+	runParallel(threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, threadCount); i < rangeBegin(atoms.size(), thread + 1, threadCount); i++)
+			m_cellCounters[m_atomCells[i]].fetch_add(1, std::memory_order_relaxed);
+	});
+
+	// exclusive prefix sum over the counts, first within the range of each thread and then across threads
+	std::vector<uint> rangeSums(threadCount + 1, 0);
+
+	runParallel(threadCount, [&](uint thread) {
+		uint sum = 0;
+
+		for (size_t c = rangeBegin(m_cellCount, thread, threadCount); c < rangeBegin(m_cellCount, thread + 1, threadCount); c++)
+			sum += m_cellCounters[c].load(std::memory_order_relaxed);
+
+		rangeSums[thread + 1] = sum;
+	});
+
+	for (uint i = 1; i <= threadCount; i++)
+		rangeSums[i] += rangeSums[i - 1];
+
+	runParallel(threadCount, [&](uint thread) {
+		uint offset = rangeSums[thread];
+
+		for (size_t c = rangeBegin(m_cellCount, thread, threadCount); c < rangeBegin(m_cellCount, thread + 1, threadCount); c++)
+		{
+			m_cellOffsets[c] = offset;
+			offset += m_cellCounters[c].load(std::memory_order_relaxed);
+			m_cellCounters[c].store(m_cellOffsets[c], std::memory_order_relaxed);
+		}
+	});
+
+	m_cellOffsets[m_cellCount] = rangeSums[threadCount];
+	m_cellAtoms.resize(atoms.size());
+
+	runParallel(threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, threadCount); i < rangeBegin(atoms.size(), thread + 1, threadCount); i++)
+			m_cellAtoms[m_cellCounters[m_atomCells[i]].fetch_add(1, std::memory_order_relaxed)] = uint(i);
+	});
+
+	// the scatter order within a cell depends on the threads, sorting the few atoms of each cell makes the result deterministic
+	runParallel(threadCount, [&](uint thread) {
+		for (size_t c = rangeBegin(m_cellCount, thread, threadCount); c < rangeBegin(m_cellCount, thread + 1, threadCount); c++)
+		{
+			if (m_cellOffsets[c + 1] - m_cellOffsets[c] > 1)
+				std::sort(m_cellAtoms.begin() + m_cellOffsets[c], m_cellAtoms.begin() + m_cellOffsets[c + 1]);
+		}
+	});
+
+	gatherPositions(atoms);
+}
+
+void UniformGrid::gatherPositions(const std::vector<vec4>& atoms)
+{
+	m_cellPositions.resize(atoms.size());
+
+	runParallel(m_threadCount, [&](uint thread) {
+		for (size_t i = rangeBegin(atoms.size(), thread, m_threadCount); i < rangeBegin(atoms.size(), thread + 1, m_threadCount); i++)
+			m_cellPositions[i] = vec3(atoms[m_cellAtoms[i]]);
+	});
+}
+
+// Returns false if the position is outside of the grid
+bool UniformGrid::cellIndex(const vec3& position, uint& index) const
+{
+	const vec3 cell = floor((position - m_minimumBounds) / m_cellSize);
+
+	if (cell.x < 0.0f || cell.y < 0.0f || cell.z < 0.0f || cell.x >= float(m_resolution.x) || cell.y >= float(m_resolution.y) || cell.z >= float(m_resolution.z))
+	{
+		index = 0;
+		return false;
+	}
+
+	const ivec3 c = ivec3(cell);
+	index = uint((size_t(c.z) * size_t(m_resolution.y) + size_t(c.y)) * size_t(m_resolution.x) + size_t(c.x));
+	return true;
+}
+
+ivec3 UniformGrid::clampedCell(const vec3& position) const
+{
+	const vec3 cell = floor((position - m_minimumBounds) / m_cellSize);
+	return clamp(ivec3(clamp(cell, vec3(-1.0f), vec3(m_resolution))), ivec3(0), m_resolution - ivec3(1));
+}
+
+void UniformGrid::findNeighbors(const vec3& center, float radius, std::vector<uint>& indices) const
+{
+	if (m_cellCount == 0 || m_atomCount == 0)
+		return;
+
+	const ivec3 first = clampedCell(center - vec3(radius));
+	const ivec3 last = clampedCell(center + vec3(radius));
+	const float squaredRadius = radius * radius;
+
+	for (int z = first.z; z <= last.z; z++)
+	{
+		for (int y = first.y; y <= last.y; y++)
+		{
+			const size_t row = (size_t(z) * size_t(m_resolution.y) + size_t(y)) * size_t(m_resolution.x);
+
+			// the cells of a row are contiguous, so are their atoms
+			for (uint i = m_cellOffsets[row + first.x]; i < m_cellOffsets[row + last.x + 1]; i++)
+			{
+				const vec3 offset = m_cellPositions[i] - center;
+
+				if (dot(offset, offset) <= squaredRadius)
+					indices.push_back(m_cellAtoms[i]);
+			}
+		}
+	}
+}
+
+void UniformGrid::findInBox(const vec3& minimum, const vec3& maximum, std::vector<uint>& indices) const
+{
+	if (m_cellCount == 0 || m_atomCount == 0)
+		return;
+
+	const ivec3 first = clampedCell(minimum);
+	const ivec3 last = clampedCell(maximum);
+
+	for (int z = first.z; z <= last.z; z++)
+	{
+		for (int y = first.y; y <= last.y; y++)
+		{
+			const size_t row = (size_t(z) * size_t(m_resolution.y) + size_t(y)) * size_t(m_resolution.x);
+
+			for (uint i = m_cellOffsets[row + first.x]; i < m_cellOffsets[row + last.x + 1]; i++)
+			{
+				const vec3& position = m_cellPositions[i];
+
+				if (position.x >= minimum.x && position.y >= minimum.y && position.z >= minimum.z && position.x <= maximum.x && position.y <= maximum.y && position.z <= maximum.z)
+					indices.push_back(m_cellAtoms[i]);
+			}
+		}
+	}
+}
+
+float UniformGrid::cellSize() const
+{
+	return m_cellSize;
+}
+
+ivec3 UniformGrid::resolution() const
+{
+	return m_resolution;
+}
+
+vec3 UniformGrid::minimumBounds() const
+{
+	return m_minimumBounds;
+}
+
+vec3 UniformGrid::maximumBounds() const
+{
+	return m_minimumBounds + vec3(m_resolution) * m_cellSize;
+}
+
+uint UniformGrid::atomCount() const
+{
+	return m_atomCount;
+}
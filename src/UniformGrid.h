@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <glm/glm.hpp>
+
+namespace dynamol
+{
+	// Uniform grid (cell list) over the atoms of one timestep for neighbor and range queries
+	// Atoms are sorted into cells with a parallel counting sort, the atoms of each cell are then stored contiguously
+	// and located through a compact array with one offset per cell
+	class UniformGrid
+	{
+	public:
+		UniformGrid(float cellSize = 4.0f);
+
+		// Sorts the atoms into a grid that encloses them with a margin of one cell, the w component of the atoms is ignored
+		void build(const std::vector<glm::vec4>& atoms);
+
+		// Rebuilds the grid for new positions of the same atoms, e.g. the next frame of a trajectory
+		// As long as all atoms stay within the margin, the grid keeps its cells and memory and only the positions are refreshed if no atom changed its cell
+		void update(const std::vector<glm::vec4>& atoms);
+
+		// Append the indices of all atoms with their center within the radius or the box, in the order of the cells
+		void findNeighbors(const glm::vec3& center, float radius, std::vector<glm::uint>& indices) const;
+		void findInBox(const glm::vec3& minimum, const glm::vec3& maximum, std::vector<glm::uint>& indices) const;
+
+		// The cell size can be larger than the requested one to limit the number of cells for sparse structures
+		float cellSize() const;
+		glm::ivec3 resolution() const;
+		glm::vec3 minimumBounds() const;
+		glm::vec3 maximumBounds() const;
+		glm::uint atomCount() const;
+
+	private:
+		bool cellIndex(const glm::vec3& position, glm::uint& index) const;
+		glm::ivec3 clampedCell(const glm::vec3& position) const;
+		void sort(const std::vector<glm::vec4>& atoms);
+		void gatherPositions(const std::vector<glm::vec4>& atoms);
+
+		float m_requestedCellSize = 4.0f;
+		float m_cellSize = 4.0f;
+		glm::ivec3 m_resolution = glm::ivec3(0);
+		glm::vec3 m_minimumBounds = glm::vec3(0.0f);
+		glm::uint m_atomCount = 0;
+		glm::uint m_threadCount = 1;
+
+		// offset of the first atom of each cell, followed by the total number of atoms
+		std::vector<glm::uint> m_cellOffsets;
+
+		// indices and positions of the atoms, sorted by cell
+		std::vector<glm::uint> m_cellAtoms;
+		std::vector<glm::vec3> m_cellPositions;
+
+		// cell of each atom in the order of the input
+		std::vector<glm::uint> m_atomCells;
+
+		// number of atoms per cell while counting, insertion positions while scattering
+		std::unique_ptr<std::atomic<glm::uint>[]> m_cellCounters;
+		size_t m_cellCount = 0;
+	};
+}
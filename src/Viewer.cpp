@@ -18,9 +18,11 @@
 #include "SphereRenderer.h"
 #include "Scene.h"
 #include "Protein.h"
+#include "Profiler.h"
 #include <fstream>
 #include <sstream>
 #include <list>
+#include <tinyfiledialogs.h>
 
 
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -68,6 +70,8 @@ Viewer::Viewer(GLFWwindow *window, Scene *scene) : m_window(window), m_scene(sce
 
 	io.Fonts->AddFontFromFileTTF("./res/ui/Lato-Semibold.ttf", 18.0f * m_highDPIscaleFactor);
 
+	m_gpuTimer = std::make_unique<GpuTimer>();
+
 	m_interactors.emplace_back(std::make_unique<CameraInteractor>(this));
 	m_renderers.emplace_back(std::make_unique<SphereRenderer>(this));
 	m_renderers.emplace_back(std::make_unique<BoundingBoxRenderer>(this));
@@ -88,8 +92,17 @@ Viewer::Viewer(GLFWwindow *window, Scene *scene) : m_window(window), m_scene(sce
 
 void Viewer::display()
 {
+	PROFILE_ZONE("Viewer::display");
+
+	// a structure that has finished loading in the background replaces the current one
+	if (m_scene->update())
+		fitModelTransform();
+
 	beginFrame();
 	mainMenu();
+	loadingWindow();
+
+	m_gpuTimer->beginFrame();
 
 	glClearColor(m_backgroundColor.r, m_backgroundColor.g, m_backgroundColor.b, 1.0f);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -149,6 +162,11 @@ Scene* Viewer::scene()
 	return m_scene;
 }
 
+GpuTimer* Viewer::gpuTimer()
+{
+	return m_gpuTimer.get();
+}
+
 ivec2 Viewer::viewportSize() const
 {
 	int width, height;
@@ -258,6 +276,17 @@ float Viewer::highDPIscaleFactor() const
 	return m_highDPIscaleFactor;
 }
 
+std::string Viewer::openFileDialog()
+{
+	const char *filterExtensions[] = { "*.pdb", "*.cif", "*.bcif", "*.gz", "*.zst" };
+	const char *openfileName = tinyfd_openFileDialog("Open File", "./", 5, filterExtensions, "Protein Data Bank Files (*.pdb, *.cif, *.bcif, optionally compressed)", 0);
+
+	if (openfileName)
+		return std::string(openfileName);
+
+	return std::string();
+}
+
 void Viewer::saveImage(const std::string & filename)
 {
 	uvec2 size = viewportSize();
@@ -437,29 +466,7 @@ void Viewer::endFrame()
 
 	if (m_saveScreenshot)
 	{
-		std::string basename = scene()->protein()->filename();
-		size_t pos = basename.rfind('.', basename.length());
-
-		if (pos != std::string::npos)
-			basename = basename.substr(0,pos);
-
-		uint i = 0;
-		std::string filename;
-
-		for (uint i = 0; i <= 9999; i++)
-		{
-			std::stringstream ss;
-			ss << basename << "-";
-			ss << std::setw(4) << std::setfill('0') << i;
-			ss << ".png";
-
-			filename = ss.str();
-
-			std::ifstream f(filename.c_str());
-			
-			if (!f.good())
-				break;
-		}
+		std::string filename = captureFilename("", ".png");
 
 		std::cout << "Saving screenshot to " << filename << " ..." << std::endl;
 
@@ -468,7 +475,13 @@ void Viewer::endFrame()
 	}
 
 	if (m_showUi)
+	{
+		m_gpuTimer->begin("User Interface");
 		renderUi();
+		m_gpuTimer->end();
+	}
+
+	m_gpuTimer->endFrame();
 }
 
 void Viewer::renderUi()
@@ -484,6 +497,17 @@ void Viewer::mainMenu()
 {
 	if (ImGui::BeginMenu("File"))
 	{
+		if (ImGui::MenuItem("Open..."))
+		{
+			const std::string filename = openFileDialog();
+
+			if (!filename.empty())
+				m_scene->load(filename);
+		}
+
+		if (ImGui::MenuItem("Cancel Loading", nullptr, false, m_scene->isLoading()))
+			m_scene->cancelLoading();
+
 		if (ImGui::MenuItem("Screenshot", "F2"))
 			m_saveScreenshot = true;
 
@@ -561,4 +585,142 @@ void Viewer::mainMenu()
 		}
 		ImGui::EndMenu();
 	}
+
+	if (ImGui::BeginMenu("Profiling"))
+	{
+		// turning the CPU profiler on starts a new capture, which is kept until it is turned on again
+		bool cpuProfiling = Profiler::isEnabled();
+
+		if (ImGui::Checkbox("CPU Profiling", &cpuProfiling))
+			Profiler::setEnabled(cpuProfiling);
+
+		ImGui::SameLine();
+		ImGui::Text("%zu zones", Profiler::zoneCount());
+
+		if (ImGui::MenuItem("Save CPU Trace"))
+		{
+			const std::string filename = captureFilename("cpu-", ".json");
+
+			std::cout << "Saving CPU trace to " << filename << " ..." << std::endl;
+
+			Profiler::saveTrace(filename);
+
+			if (const size_t droppedZoneCount = Profiler::droppedZoneCount())
+				globjects::warning() << droppedZoneCount << " zones did not fit into the buffers and are missing from the trace";
+		}
+
+		ImGui::Separator();
+
+		bool gpuTiming = m_gpuTimer->isEnabled();
+
+		if (ImGui::Checkbox("GPU Timing", &gpuTiming))
+			m_gpuTimer->setEnabled(gpuTiming);
+
+		if (gpuTiming)
+		{
+			// passes of the most recent measured frame, averaged over recent frames and relative to the whole frame
+			const auto& zones = m_gpuTimer->zones();
+			const double frameDuration = zones.empty() ? 0.0 : m_gpuTimer->averageDuration(zones.front().name);
+
+			for (size_t i = 0; i < zones.size(); i++)
+			{
+				// zones that occur more than once per frame are shown once with their total
+				bool repeated = false;
+
+				for (size_t j = 0; j < i && !repeated; j++)
+					repeated = (zones[j].name == zones[i].name);
+
+				if (repeated)
+					continue;
+
+				const double duration = m_gpuTimer->averageDuration(zones[i].name);
+				const float fraction = frameDuration > 0.0 ? float(duration / frameDuration) : 0.0f;
+
+				std::stringstream stream;
+				stream << std::fixed << std::setprecision(3) << duration << " ms";
+
+				ImGui::Text("%*s%s", int(zones[i].depth * 2), "", zones[i].name.c_str());
+				ImGui::SameLine(192.0f * m_highDPIscaleFactor);
+				ImGui::ProgressBar(fraction, ImVec2(160.0f * m_highDPIscaleFactor, 0.0f), stream.str().c_str());
+			}
+
+			ImGui::Separator();
+
+			bool recording = m_gpuTimer->isRecording();
+
+			if (ImGui::Checkbox("Record Trace", &recording))
+				m_gpuTimer->setRecording(recording);
+
+			ImGui::SameLine();
+			ImGui::Text("%zu frames", m_gpuTimer->recordedFrameCount());
+
+			if (ImGui::MenuItem("Save Trace", nullptr, false, m_gpuTimer->recordedFrameCount() > 0))
+			{
+				const std::string filename = captureFilename("gpu-", ".json");
+				const std::string csvFilename = filename.substr(0, filename.size() - 5) + ".csv";
+
+				std::cout << "Saving GPU trace to " << filename << " and " << csvFilename << " ..." << std::endl;
+
+				m_gpuTimer->saveTrace(filename);
+				m_gpuTimer->saveCsv(csvFilename);
+			}
+		}
+
+		ImGui::EndMenu();
+	}
+}
+
+void Viewer::loadingWindow()
+{
+	if (!m_scene->isLoading())
+		return;
+
+	ImGui::SetNextWindowPos(ImVec2(0.5f * ImGui::GetIO().DisplaySize.x, 0.5f * ImGui::GetIO().DisplaySize.y), ImGuiCond_Always, ImVec2(0.5f, 0.5f));
+	ImGui::Begin("Loading", nullptr, ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoCollapse | ImGuiWindowFlags_NoMove);
+
+	ImGui::Text("%s", m_scene->loadingFilename().c_str());
+	ImGui::ProgressBar(m_scene->loadingProgress(), ImVec2(384.0f * m_highDPIscaleFactor, 0.0f));
+
+	if (ImGui::Button("Cancel"))
+		m_scene->cancelLoading();
+
+	ImGui::End();
+}
+
+std::string Viewer::captureFilename(const std::string& suffix, const std::string& extension)
+{
+	std::string basename = scene()->protein()->filename();
+	size_t pos = basename.rfind('.', basename.length());
+
+	if (pos != std::string::npos)
+		basename = basename.substr(0,pos);
+
+	std::string filename;
+
+	for (uint i = 0; i <= 9999; i++)
+	{
+		std::stringstream ss;
+		ss << basename << "-" << suffix;
+		ss << std::setw(4) << std::setfill('0') << i;
+		ss << extension;
+
+		filename = ss.str();
+
+		std::ifstream f(filename.c_str());
+
+		if (!f.good())
+			break;
+	}
+
+	return filename;
+}
+
+// Scales the bounding box of the protein to the canonical view volume
+void Viewer::fitModelTransform()
+{
+	vec3 boundingBoxSize = m_scene->protein()->maximumBounds() - m_scene->protein()->minimumBounds();
+	float maximumSize = std::max(boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z));
+	mat4 modelTransform = scale(mat4(1.0f), vec3(2.0f) / vec3(maximumSize));
+	modelTransform = modelTransform * translate(mat4(1.0f), -0.5f*(m_scene->protein()->minimumBounds() + m_scene->protein()->maximumBounds()));
+	setModelTransform(modelTransform);
 }
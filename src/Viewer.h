@@ -11,6 +11,7 @@
 #include "Scene.h"
 #include "Interactor.h"
 #include "Renderer.h"
+#include "GpuTimer.h"
 
 namespace dynamol
 {
@@ -24,6 +25,9 @@ namespace dynamol
 		GLFWwindow * window();
 		Scene* scene();
 
+		// Timer for the passes of all renderers, the zones of a frame are only measured while timing is enabled in the profiling menu
+		GpuTimer* gpuTimer();
+
 		glm::ivec2 viewportSize() const;
 		glm::ivec2 viewportOrigin() const;
 
@@ -38,6 +42,7 @@ namespace dynamol
 		void setModelTransform(const glm::mat4& m);
 		void setLightTransform(const glm::mat4& m);
 		void setProjectionTransform(const glm::mat4& m);
+		void fitModelTransform();
 
 		glm::mat4 modelViewTransform() const;
 		glm::mat4 modelViewProjectionTransform() const;
@@ -49,12 +54,19 @@ namespace dynamol
 
 		void saveImage(const std::string & filename);
 
+		// Shows a file dialog for the supported structure formats, returns an empty string if it was cancelled
+		static std::string openFileDialog();
+
 	private:
 
 		void beginFrame();
 		void endFrame();
 		void renderUi();
 		void mainMenu();
+		void loadingWindow();
+
+		// First unused filename of the form <structure>-<suffix>NNNN<extension> next to the loaded structure
+		std::string captureFilename(const std::string& suffix, const std::string& extension);
 
 		static void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 		static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -67,6 +79,7 @@ namespace dynamol
 
 		std::vector<std::unique_ptr<Interactor>> m_interactors;
 		std::vector<std::unique_ptr<Renderer>> m_renderers;
+		std::unique_ptr<GpuTimer> m_gpuTimer;
 
 		glm::vec3 m_backgroundColor = glm::vec3(0.2f, 0.2f, 0.2f);
 		glm::mat4 m_modelTransform = glm::mat4(1.0f);
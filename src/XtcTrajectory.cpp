@@ -0,0 +1,472 @@
+#include "XtcTrajectory.h"
+
+#include <cstring>
+#include <algorithm>
+#include <globjects/logging.h>
+
+using namespace dynamol;
+using namespace glm;
+
+namespace
+{
+	const int32_t xtcMagic = 1995;
+
+	// Size of the frame header up to the atom count that starts the coordinate block
+	const uint64_t headerSize = 56;
+
+	// Size of the parameters preceding the compressed data: precision, minimum, maximum, small index and byte count
+	const uint64_t compressionHeaderSize = 36;
+
+	// Frames with few atoms are stored uncompressed
+	const int32_t minimumCompressedAtoms = 10;
+
+	// XTC stores coordinates in nanometers
+	const float nanometersToAngstrom = 10.0f;
+
+	// Sizes of the small integer ranges used for coordinates close to the previous one
+	const int32_t magicInts[] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 0, 8, 10, 12, 16, 20, 25, 32, 40, 50, 64,
+		80, 101, 128, 161, 203, 256, 322, 406, 512, 645, 812, 1024, 1290,
+		1625, 2048, 2580, 3250, 4096, 5060, 6501, 8192, 10321, 13003,
+		16384, 20642, 26007, 32768, 41285, 52015, 65536, 82570, 104031,
+		131072, 165140, 208063, 262144, 330280, 416127, 524287, 660561,
+		832255, 1048576, 1321122, 1664510, 2097152, 2642245, 3329021,
+		4194304, 5284491, 6658042, 8388607, 10568983, 13316085, 16777216
+	};
+
+	const int32_t firstMagicIndex = 9;
+	const int32_t lastMagicIndex = int32_t(sizeof(magicInts) / sizeof(magicInts[0])) - 1;
+
+	// XDR encodes all numbers as big-endian 32 bit values
+	uint32_t readBigEndian(const uint8_t* data)
+	{
+		return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+	}
+
+	int32_t readInt(const uint8_t* data)
+	{
+		return int32_t(readBigEndian(data));
+	}
+
+	float readFloat(const uint8_t* data)
+	{
+		const uint32_t bits = readBigEndian(data);
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	// Number of bits needed to store values up to size
+	int32_t bitsForInt(uint32_t size)
+	{
+		uint64_t num = 1;
+		int32_t bits = 0;
+
+		while (size >= num && bits < 32)
+		{
+			bits++;
+			num <<= 1;
+		}
+
+		return bits;
+	}
+
+	// Number of bits needed to store three integers in mixed radix with the given ranges
+	int32_t bitsForInts(const uint32_t sizes[3])
+	{
+		uint32_t bytes[32] = { 1 };
+		int32_t byteCount = 1;
+
+		for (int32_t i = 0; i < 3; i++)
+		{
+			uint64_t tmp = 0;
+			int32_t byte = 0;
+
+			for (; byte < byteCount; byte++)
+			{
+				tmp = uint64_t(bytes[byte]) * sizes[i] + tmp;
+				bytes[byte] = uint32_t(tmp & 0xff);
+				tmp >>= 8;
+			}
+
+			while (tmp != 0 && byte < 32)
+			{
+				bytes[byte++] = uint32_t(tmp & 0xff);
+				tmp >>= 8;
+			}
+
+			byteCount = byte;
+		}
+
+		uint32_t num = 1;
+		int32_t bits = 0;
+		byteCount--;
+
+		while (bytes[byteCount] >= num && bits < 32)
+		{
+			bits++;
+			num *= 2;
+		}
+
+		return bits + byteCount * 8;
+	}
+
+	// Reads the bit stream of a compressed frame, most significant bits first
+	class BitReader
+	{
+	public:
+		BitReader(const uint8_t* data, size_t size) : m_data(data), m_size(size)
+		{
+		}
+
+		uint32_t bits(int32_t count)
+		{
+			const uint64_t mask = (uint64_t(1) << count) - 1;
+			uint64_t num = 0;
+
+			while (count >= 8)
+			{
+				m_lastByte = (m_lastByte << 8) | nextByte();
+				num |= uint64_t(m_lastByte >> m_lastBits) << (count - 8);
+				count -= 8;
+			}
+
+			if (count > 0)
+			{
+				if (m_lastBits < uint32_t(count))
+				{
+					m_lastBits += 8;
+					m_lastByte = (m_lastByte << 8) | nextByte();
+				}
+
+				m_lastBits -= uint32_t(count);
+				num |= (m_lastByte >> m_lastBits) & ((uint32_t(1) << count) - 1);
+			}
+
+			return uint32_t(num & mask);
+		}
+
+		// Reads three integers stored in mixed radix with the given ranges
+		void ints(int32_t bitCount, const uint32_t sizes[3], int32_t values[3])
+		{
+			uint32_t bytes[32] = {};
+			int32_t byteCount = 0;
+
+			while (bitCount > 8 && byteCount < 31)
+			{
+				bytes[byteCount++] = bits(8);
+				bitCount -= 8;
+			}
+
+			if (bitCount > 0)
+				bytes[byteCount++] = bits(bitCount);
+
+			for (int32_t i = 2; i > 0; i--)
+			{
+				uint32_t num = 0;
+
+				for (int32_t j = byteCount - 1; j >= 0; j--)
+				{
+					num = (num << 8) | bytes[j];
+					const uint32_t p = num / sizes[i];
+					bytes[j] = p;
+					num = num - p * sizes[i];
+				}
+
+				values[i] = int32_t(num);
+			}
+
+			values[0] = int32_t(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24));
+		}
+
+		bool overflow() const
+		{
+			return m_overflow;
+		}
+
+	private:
+		uint32_t nextByte()
+		{
+			if (m_position >= m_size)
+			{
+				m_overflow = true;
+				return 0;
+			}
+
+			return m_data[m_position++];
+		}
+
+		const uint8_t* m_data;
+		size_t m_size;
+		size_t m_position = 0;
+		uint32_t m_lastBits = 0;
+		uint32_t m_lastByte = 0;
+		bool m_overflow = false;
+	};
+
+	// Decompresses the integer coordinates of a frame, following the reference implementation of the xdrfile library
+	bool decompressCoordinates(const uint8_t* parameters, const uint8_t* data, size_t dataSize, int32_t atomCount, std::vector<int32_t>& coordinates)
+	{
+		int32_t minimum[3], maximum[3];
+		uint32_t sizes[3];
+		int32_t bitSizes[3] = { 0, 0, 0 };
+		int32_t bitSize = 0;
+
+		for (int i = 0; i < 3; i++)
+		{
+			minimum[i] = readInt(parameters + 4 + 4 * i);
+			maximum[i] = readInt(parameters + 16 + 4 * i);
+			sizes[i] = uint32_t(int64_t(maximum[i]) - int64_t(minimum[i]) + 1);
+		}
+
+		// large ranges are stored as separate integers, smaller ones are combined into one number
+		if ((sizes[0] | sizes[1] | sizes[2]) > 0xffffff)
+		{
+			for (int i = 0; i < 3; i++)
+				bitSizes[i] = bitsForInt(sizes[i]);
+		}
+		else
+		{
+			bitSize = bitsForInts(sizes);
+		}
+
+		int32_t smallIndex = readInt(parameters + 28);
+
+		if (smallIndex < firstMagicIndex || smallIndex > lastMagicIndex)
+			return false;
+
+		int32_t smaller = magicInts[std::max(firstMagicIndex, smallIndex - 1)] / 2;
+		int32_t smallNumber = magicInts[smallIndex] / 2;
+		uint32_t smallSizes[3];
+		std::fill(smallSizes, smallSizes + 3, uint32_t(magicInts[smallIndex]));
+
+		coordinates.resize(size_t(atomCount) * 3);
+
+		BitReader reader(data, dataSize);
+		int32_t run = 0;
+		int32_t i = 0;
+		int32_t* output = coordinates.data();
+
+		while (i < atomCount)
+		{
+			int32_t current[3];
+
+			if (bitSize == 0)
+			{
+				for (int c = 0; c < 3; c++)
+					current[c] = int32_t(reader.bits(bitSizes[c]));
+			}
+			else
+			{
+				reader.ints(bitSize, sizes, current);
+			}
+
+			i++;
+
+			for (int c = 0; c < 3; c++)
+				current[c] += minimum[c];
+
+			int32_t previous[3] = { current[0], current[1], current[2] };
+			int32_t isSmaller = 0;
+
+			// the run length only changes when the flag is set, otherwise the previous one is used again
+			if (reader.bits(1) == 1)
+			{
+				run = int32_t(reader.bits(5));
+				isSmaller = run % 3;
+				run -= isSmaller;
+				isSmaller--;
+			}
+
+			if (run > 0)
+			{
+				if (i + run / 3 > atomCount)
+					return false;
+
+				for (int32_t k = 0; k < run; k += 3)
+				{
+					reader.ints(smallIndex, smallSizes, current);
+					i++;
+
+					for (int c = 0; c < 3; c++)
+						current[c] += previous[c] - smallNumber;
+
+					if (k == 0)
+					{
+						// the first two atoms of a run are swapped, which compresses water molecules better
+						for (int c = 0; c < 3; c++)
+							std::swap(current[c], previous[c]);
+
+						for (int c = 0; c < 3; c++)
+							*output++ = previous[c];
+					}
+					else
+					{
+						for (int c = 0; c < 3; c++)
+							previous[c] = current[c];
+					}
+
+					for (int c = 0; c < 3; c++)
+						*output++ = current[c];
+				}
+			}
+			else
+			{
+				for (int c = 0; c < 3; c++)
+					*output++ = current[c];
+			}
+
+			smallIndex += isSmaller;
+
+			if (smallIndex < firstMagicIndex || smallIndex > lastMagicIndex)
+				return false;
+
+			if (isSmaller < 0)
+			{
+				smallNumber = smaller;
+				smaller = (smallIndex > firstMagicIndex) ? magicInts[smallIndex - 1] / 2 : 0;
+			}
+			else if (isSmaller > 0)
+			{
+				smaller = smallNumber;
+				smallNumber = magicInts[smallIndex] / 2;
+			}
+
+			std::fill(smallSizes, smallSizes + 3, uint32_t(magicInts[smallIndex]));
+		}
+
+		return !reader.overflow();
+	}
+}
+
+XtcTrajectory::XtcTrajectory(const std::string& filename) : Trajectory(filename)
+{
+}
+
+bool XtcTrajectory::readHeader()
+{
+	m_file.open(m_filename, std::ios::binary);
+
+	if (!m_file.is_open())
+		return false;
+
+	// frames have varying sizes, so the file is scanned once for their offsets
+	uint64_t offset = 0;
+	uint8_t header[headerSize + compressionHeaderSize];
+
+	while (m_file.seekg(std::streamoff(offset)), m_file.read(reinterpret_cast<char*>(header), headerSize))
+	{
+		const int32_t atomCount = readInt(header + 4);
+
+		if (readInt(header) != xtcMagic || atomCount <= 0 || readInt(header + 52) != atomCount)
+		{
+			globjects::warning() << "Invalid XTC frame at offset " << offset << ", ignoring the rest of the file.";
+			break;
+		}
+
+		if (m_frameOffsets.empty())
+		{
+			m_atomCount = uint(atomCount);
+		}
+		else if (uint(atomCount) != m_atomCount)
+		{
+			globjects::warning() << "XTC frame at offset " << offset << " has a different number of atoms, ignoring the rest of the file.";
+			break;
+		}
+
+		uint64_t frameSize = headerSize;
+
+		if (atomCount < minimumCompressedAtoms)
+		{
+			frameSize += uint64_t(atomCount) * 3 * sizeof(float);
+		}
+		else
+		{
+			if (!m_file.read(reinterpret_cast<char*>(header + headerSize), compressionHeaderSize))
+				break;
+
+			const uint64_t byteCount = readBigEndian(header + headerSize + 32);
+			frameSize += compressionHeaderSize + ((byteCount + 3) & ~uint64_t(3));
+		}
+
+		m_frameOffsets.push_back(offset);
+		offset += frameSize;
+	}
+
+	m_file.clear();
+
+	// a truncated last frame is dropped
+	if (!m_frameOffsets.empty())
+	{
+		m_file.seekg(0, std::ios::end);
+
+		if (uint64_t(m_file.tellg()) < offset)
+			m_frameOffsets.pop_back();
+	}
+
+	m_frameCount = uint(m_frameOffsets.size());
+	return m_frameCount > 0;
+}
+
+bool XtcTrajectory::readFrame(uint frame, std::vector<vec3>& positions)
+{
+	if (frame >= m_frameCount)
+		return false;
+
+	const uint64_t begin = m_frameOffsets[frame];
+	uint64_t end = 0;
+
+	if (frame + 1 < m_frameCount)
+	{
+		end = m_frameOffsets[frame + 1];
+	}
+	else
+	{
+		m_file.clear();
+		m_file.seekg(0, std::ios::end);
+		end = uint64_t(m_file.tellg());
+	}
+
+	m_buffer.resize(size_t(end - begin));
+	m_file.clear();
+	m_file.seekg(std::streamoff(begin));
+
+	if (!m_file.read(reinterpret_cast<char*>(m_buffer.data()), std::streamsize(m_buffer.size())) || m_buffer.size() < headerSize)
+		return false;
+
+	positions.resize(m_atomCount);
+
+	if (m_atomCount < uint(minimumCompressedAtoms))
+	{
+		if (m_buffer.size() < headerSize + m_atomCount * 3 * sizeof(float))
+			return false;
+
+		for (uint i = 0; i < m_atomCount; i++)
+		{
+			for (uint c = 0; c < 3; c++)
+				positions[i][c] = readFloat(m_buffer.data() + headerSize + (i * 3 + c) * sizeof(float)) * nanometersToAngstrom;
+		}
+
+		return true;
+	}
+
+	if (m_buffer.size() < headerSize + compressionHeaderSize)
+		return false;
+
+	const uint8_t* parameters = m_buffer.data() + headerSize;
+	const float precision = readFloat(parameters);
+	const size_t byteCount = std::min(size_t(uint32_t(readInt(parameters + 32))), m_buffer.size() - size_t(headerSize + compressionHeaderSize));
+
+	if (!(precision > 0.0f) || !decompressCoordinates(parameters, parameters + compressionHeaderSize, byteCount, int32_t(m_atomCount), m_integers))
+	{
+		globjects::warning() << "Could not decompress XTC frame " << frame << "!";
+		return false;
+	}
+
+	const float scale = nanometersToAngstrom / precision;
+
+	for (uint i = 0; i < m_atomCount; i++)
+		positions[i] = vec3(float(m_integers[i * 3]), float(m_integers[i * 3 + 1]), float(m_integers[i * 3 + 2])) * scale;
+
+	return true;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Trajectory.h"
+#include <fstream>
+#include <cstdint>
+
+namespace dynamol
+{
+	// GROMACS XTC trajectories with compressed coordinates
+	// Frames have varying sizes, their offsets are collected when the file is opened
+	class XtcTrajectory : public Trajectory
+	{
+	public:
+		XtcTrajectory(const std::string& filename);
+		virtual bool readFrame(glm::uint frame, std::vector<glm::vec3>& positions) override;
+
+	protected:
+		virtual bool readHeader() override;
+
+	private:
+		std::ifstream m_file;
+		std::vector<uint64_t> m_frameOffsets;
+		std::vector<uint8_t> m_buffer;
+		std::vector<int32_t> m_integers;
+	};
+}
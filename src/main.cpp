@@ -1,4 +1,6 @@
 #include <iostream>
+#include <vector>
+#include <string>
 
 #include <glbinding/Version.h>
 #include <glbinding/Binding.h>
@@ -19,13 +21,15 @@
 
 #include <globjects/globjects.h>
 #include <globjects/logging.h>
-#include <tinyfiledialogs.h>
 
 #include "Scene.h"
 #include "Protein.h"
 #include "Viewer.h"
 #include "Interactor.h"
 #include "Renderer.h"
+#include "LoaderCheck.h"
+#include "SpatialCheck.h"
+#include "Profiler.h"
 
 using namespace gl;
 using namespace glm;
@@ -39,6 +43,17 @@ void error_callback(int errnum, const char * errmsg)
 
 int main(int argc, char *argv[])
 {
+	// Check the loaders and compare the spatial data structures with brute-force queries instead of opening the viewer
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--check")
+		{
+			bool passed = LoaderCheck::run();
+			passed = SpatialCheck::run(i + 1 < argc ? argv[i + 1] : "./dat/6b0x.pdb") && passed;
+			return passed ? 0 : 1;
+		}
+	}
+
 	// Initialize GLFW
 	if (!glfwInit())
 		return 1;
@@ -83,29 +98,47 @@ int main(int argc, char *argv[])
 		<< "OpenGL Renderer: " << glbinding::aux::ContextInfo::renderer() << std::endl;
 
 	std::string fileName = "./dat/6b0x.pdb";
+	std::vector<std::string> arguments;
+	bool quantize = false;
+	bool lazy = false;
+	bool reorder = false;
 
-	if (argc > 1)
-		fileName = std::string(argv[1]);
+	Profiler::setThreadName("Main");
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::string(argv[i]) == "--quantize")
+			quantize = true;
+		else if (std::string(argv[i]) == "--lazy")
+			lazy = true;
+		else if (std::string(argv[i]) == "--reorder")
+			reorder = true;
+		else if (std::string(argv[i]) == "--profile")
+			Profiler::setEnabled(true);
+		else
+			arguments.push_back(argv[i]);
+	}
+
+	if (arguments.size() > 0)
+		fileName = arguments[0];
 	else
 	{
-		const char *filterExtensions[] = { "*.pdb" };
-		const char *openfileName = tinyfd_openFileDialog("Open File", "./", 1, filterExtensions, "Protein Data Bank Files (*.pdb)", 0);
+		const std::string openfileName = Viewer::openFileDialog();
 
-		if (openfileName)
-			fileName = std::string(openfileName);
+		if (!openfileName.empty())
+			fileName = openfileName;
 	}
 	
 	auto scene = std::make_unique<Scene>();
-	scene->protein()->load(fileName);
-	auto viewer = std::make_unique<Viewer>(window, scene.get());
+	scene->protein()->setQuantizationEnabled(quantize);
+	scene->protein()->setLazyLoadingEnabled(lazy);
+	scene->protein()->setSpatialOrderingEnabled(reorder);
 
-	// Scaling the model's bounding box to the canonical view volume
-	vec3 boundingBoxSize = scene->protein()->maximumBounds() - scene->protein()->minimumBounds();
-	float maximumSize = std::max( boundingBoxSize.x, std::max(boundingBoxSize.y, boundingBoxSize.z) );
-	mat4 modelTransform =  scale(vec3(2.0f) / vec3(maximumSize)); 
-	modelTransform = modelTransform * translate(-0.5f*(scene->protein()->minimumBounds() + scene->protein()->maximumBounds()));
-	viewer->setModelTransform(modelTransform);
+	// the structure is loaded in the background, the viewer picks it up once it is complete
+	// an optional second argument is a DCD or XTC trajectory for the loaded topology
+	scene->load(fileName, arguments.size() > 1 ? arguments[1] : std::string());
 
+	auto viewer = std::make_unique<Viewer>(window, scene.get());
 
 	glfwSwapInterval(0);
 